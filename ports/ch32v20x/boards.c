@@ -129,6 +129,26 @@ void board_dfu_complete(void) {
   NVIC_SystemReset();
 }
 
+board_reset_cause_t board_reset_cause(void) {
+  board_reset_cause_t cause = BOARD_RESET_UNKNOWN;
+
+  // NRST pin is also asserted by internal resets, check it last
+  if (RCC_GetFlagStatus(RCC_FLAG_PORRST)) {
+    cause = BOARD_RESET_POWER_ON;
+  } else if (RCC_GetFlagStatus(RCC_FLAG_IWDGRST) || RCC_GetFlagStatus(RCC_FLAG_WWDGRST)) {
+    cause = BOARD_RESET_WATCHDOG;
+  } else if (RCC_GetFlagStatus(RCC_FLAG_SFTRST)) {
+    cause = BOARD_RESET_SOFTWARE;
+  } else if (RCC_GetFlagStatus(RCC_FLAG_PINRST)) {
+    cause = BOARD_RESET_PIN;
+  }
+
+  TINYUF2_RESET_FLAGS_REG = (uint16_t) (RCC->RSTSCKR >> 16);
+  RCC_ClearFlag();
+
+  return cause;
+}
+
 bool board_app_valid(void) {
   uint32_t app_start_contents = *((volatile uint32_t const*) ADDR_ABS(BOARD_FLASH_APP_START));
   TUF2_LOG1_HEX(app_start_contents);
@@ -212,8 +232,9 @@ void board_flash_read(uint32_t addr, void* buffer, uint32_t len) {
   memcpy(buffer, (void*) addr, len);
 }
 
-void board_flash_flush(void) {
+bool board_flash_flush(void) {
   // nothing to do
+  return true;
 }
 
 bool board_flash_write(uint32_t addr, void const* data, uint32_t len) {
@@ -36,6 +36,9 @@
 #define TINYUF2_DBL_TAP_REG       BKP->DATAR10
 #define TINYUF2_DBL_TAP_REG_SIZE  16
 
+// Reset flags (upper half of RCC_RSTSCKR) saved by board_reset_cause() before they are cleared
+#define TINYUF2_RESET_FLAGS_REG   BKP->DATAR9
+
 // symbol from linker
 extern uint32_t __flash_size[];
 extern uint32_t __flash_boot_size[];
@@ -28,76 +28,395 @@
 #include "esp_partition.h"
 #include "esp_ota_ops.h"
 
+#include "esp_heap_caps.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
 #include "spi_flash_chip_driver.h"
 #include "board_api.h"
 
 #define FLASH_CACHE_SIZE          (64*1024)
 #define FLASH_CACHE_INVALID_ADDR  0xffffffff
 
-static uint32_t _fl_addr = FLASH_CACHE_INVALID_ADDR;
-static uint8_t _fl_buf[FLASH_CACHE_SIZE] __attribute__((aligned(4)));
+// Number of 64KB cache slots: one is filled by the usbd task while the others are
+// erased/programmed by the flash writer task
+#ifndef CFG_FLASH_WRITER_SLOTS
+#define CFG_FLASH_WRITER_SLOTS    2
+#endif
+
+#define FLASH_WRITER_STACK_SIZE   (4*1024)
+
+// Same priority as usbd: busy writes are retried by usbd without blocking, time slicing still lets
+// the writer run when both end up on the same core
+#define FLASH_WRITER_PRIORITY     (configMAX_PRIORITIES - 2)
+
+// Stage the whole image in PSRAM and program ota0 in one pass once it is complete
+#ifndef CFG_FLASH_PSRAM_STAGING
+  #ifdef CONFIG_SPIRAM
+    #define CFG_FLASH_PSRAM_STAGING   1
+  #else
+    #define CFG_FLASH_PSRAM_STAGING   0
+  #endif
+#endif
+
+#define STAGE_MAX_BLOCKS          256 // 16MB
+
+typedef struct {
+  uint32_t addr;  // FLASH_CACHE_INVALID_ADDR if not in use
+  uint32_t count; // payload bytes written by host, slot is handed to writer once full
+  uint8_t buf[FLASH_CACHE_SIZE] __attribute__((aligned(4)));
+} flash_slot_t;
+
+// Allocated from internal RAM only when the writer task is used i.e not staging in PSRAM
+static flash_slot_t* _fl_slots = NULL;
+
+// Single-producer single-consumer ring of slots, indexes are free-running.
+// usbd fills slot [head] and advances head, writer programs slot [tail] then advances tail.
+static uint32_t _fl_head = 0;
+static uint32_t _fl_tail = 0;
+
+static TaskHandle_t _fl_writer = NULL;
+
+// Set by writer task when erase or program fails, reported and cleared by board_flash_flush()
+static volatile bool _fl_failed = false;
+static StackType_t _fl_writer_stack[FLASH_WRITER_STACK_SIZE];
+static StaticTask_t _fl_writer_taskdef;
 
 // uf2 will always write to ota0 partition
 static esp_partition_t const* _part_ota0 = NULL;
 
-void board_flash_init(void) {
-  _fl_addr = FLASH_CACHE_INVALID_ADDR;
+// ota0 mapped into data address space for readback and verify, NULL if it could not be mapped.
+// esp_partition_erase_range()/write() flush the cache of mapped ranges they modify.
+static uint8_t const* _ota0_map = NULL;
+static esp_partition_mmap_handle_t _ota0_map_handle;
+
+#if CFG_FLASH_PSRAM_STAGING
+// Copy of ota0 in PSRAM, NULL if PSRAM is missing or too small. 64KB blocks are loaded
+// from flash on first write, written blocks are programmed together on flush
+static uint8_t* _stage_buf = NULL;
+static uint32_t _stage_written[STAGE_MAX_BLOCKS / 32];
+
+static inline bool stage_block_written(uint32_t block) {
+  return _stage_written[block / 32] & (1UL << (block % 32));
+}
+#endif
 
+static void flash_writer_task(void* param);
+
+void board_flash_init(void) {
   _part_ota0 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
   assert(_part_ota0 != NULL);
+
+  if (_ota0_map == NULL) {
+    void const* ptr = NULL;
+    if (ESP_OK == esp_partition_mmap(_part_ota0, 0, _part_ota0->size, ESP_PARTITION_MMAP_DATA, &ptr, &_ota0_map_handle)) {
+      _ota0_map = (uint8_t const*) ptr;
+    } else {
+      // not enough free MMU pages e.g large ota0 on ESP32-S2, fall back to SPI reads
+      TUF2_LOG1("ota0 mmap failed");
+    }
+  }
+
+#if CFG_FLASH_PSRAM_STAGING
+  if (_stage_buf == NULL && _part_ota0->size <= STAGE_MAX_BLOCKS * FLASH_CACHE_SIZE) {
+    _stage_buf = heap_caps_malloc(_part_ota0->size, MALLOC_CAP_SPIRAM);
+    TUF2_LOG1("PSRAM staging %s", _stage_buf ? "enabled" : "not available");
+  }
+  if (_stage_buf) return;
+#endif
+
+  if (_fl_writer == NULL) {
+    _fl_slots = heap_caps_malloc(CFG_FLASH_WRITER_SLOTS * sizeof(flash_slot_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    assert(_fl_slots != NULL);
+
+    for (uint32_t i = 0; i < CFG_FLASH_WRITER_SLOTS; i++) {
+      _fl_slots[i].addr = FLASH_CACHE_INVALID_ADDR;
+    }
+
+    // on the other core than usbd for dual-core ESP32-S3
+    _fl_writer = xTaskCreateStaticPinnedToCore(flash_writer_task, "flash", FLASH_WRITER_STACK_SIZE, NULL,
+                                               FLASH_WRITER_PRIORITY, _fl_writer_stack, &_fl_writer_taskdef,
+                                               portNUM_PROCESSORS - 1);
+  }
 }
 
 uint32_t board_flash_size(void) {
   return _part_ota0->size;
 }
 
+static void ota0_read(uint32_t addr, void* buffer, uint32_t len) {
+  if (_ota0_map) {
+    memcpy(buffer, _ota0_map + addr, len);
+  } else {
+    esp_partition_read(_part_ota0, addr, buffer, len);
+  }
+}
+
 void board_flash_read(uint32_t addr, void* buffer, uint32_t len) {
-  esp_partition_read(_part_ota0, addr, buffer, len);
+#if CFG_FLASH_PSRAM_STAGING
+  // staged blocks are newer than flash contents
+  if (_stage_buf && stage_block_written(addr / FLASH_CACHE_SIZE)) {
+    memcpy(buffer, _stage_buf + addr, len);
+    return;
+  }
+#endif
+
+  ota0_read(addr, buffer, len);
+}
+
+// Compare flash contents without copying when mapped
+static bool flash_content_matches(uint32_t addr, uint8_t const* data, uint32_t len) {
+  if (_ota0_map) {
+    return 0 == memcmp(_ota0_map + addr, data, len);
+  }
+
+  uint8_t verify_buf[256];
+  for (uint32_t count = 0; count < len; count += sizeof(verify_buf)) {
+    esp_partition_read(_part_ota0, addr + count, verify_buf, sizeof(verify_buf));
+    if (0 != memcmp(data + count, verify_buf, sizeof(verify_buf))) {
+      return false;
+    }
+  }
+  return true;
 }
 
-void board_flash_flush(void) {
-  if (_fl_addr == FLASH_CACHE_INVALID_ADDR) return;
+//--------------------------------------------------------------------+
+// PSRAM staging
+//--------------------------------------------------------------------+
+#if CFG_FLASH_PSRAM_STAGING
 
-  TUF2_LOG1("Erase and Write at 0x%08lX", _fl_addr);
+static void stage_write(uint32_t addr, void const* data, uint32_t len) {
+  uint32_t const block = addr / FLASH_CACHE_SIZE;
 
-  // Check if contents already matched
-  bool content_matches = true;
-  uint32_t const verify_sz = 4096;
-  uint8_t* verify_buf = malloc(verify_sz);
-
-  for (uint32_t count = 0; count < FLASH_CACHE_SIZE; count += verify_sz) {
-    board_flash_read(_fl_addr + count, verify_buf, verify_sz);
-    if (0 != memcmp(_fl_buf + count, verify_buf, verify_sz)) {
-      content_matches = false;
-      break;
+  // load the rest of the block once, repeated and out-of-order writes only update PSRAM
+  if (!stage_block_written(block)) {
+    ota0_read(block * FLASH_CACHE_SIZE, _stage_buf + block * FLASH_CACHE_SIZE, FLASH_CACHE_SIZE);
+    _stage_written[block / 32] |= 1UL << (block % 32);
+  }
+
+  memcpy(_stage_buf + addr, data, len);
+}
+
+// Program runs of changed blocks in address order, each with a single erase (64KB block erase).
+// Stops at the first erase, program or verify failure.
+static bool stage_program(void) {
+  bool ok = true;
+  uint32_t const block_count = _part_ota0->size / FLASH_CACHE_SIZE;
+  uint32_t block = 0;
+
+  while (ok && block < block_count) {
+    uint32_t const first = block;
+    while (block < block_count && stage_block_written(block) &&
+           !flash_content_matches(block * FLASH_CACHE_SIZE, _stage_buf + block * FLASH_CACHE_SIZE, FLASH_CACHE_SIZE)) {
+      block++;
+    }
+
+    if (block == first) {
+      block++; // not written or already up to date
+      continue;
+    }
+
+    uint32_t const addr = first * FLASH_CACHE_SIZE;
+    uint32_t const size = (block - first) * FLASH_CACHE_SIZE;
+
+    TUF2_LOG1("Erase and Write at 0x%08lX, %lu KB", addr, size / 1024);
+    ok = (ESP_OK == esp_partition_erase_range(_part_ota0, addr, size)) &&
+         (ESP_OK == esp_partition_write(_part_ota0, addr, _stage_buf + addr, size));
+
+    if (ok && !flash_content_matches(addr, _stage_buf + addr, size)) {
+      TUF2_LOG1("Verify failed at 0x%08lX", addr);
+      ok = false;
     }
   }
-  free(verify_buf);
 
-  // skip erase & write if content already matches
-  if (!content_matches) {
-    esp_partition_erase_range(_part_ota0, _fl_addr, FLASH_CACHE_SIZE);
-    esp_partition_write(_part_ota0, _fl_addr, _fl_buf, FLASH_CACHE_SIZE);
+  memset(_stage_written, 0, sizeof(_stage_written));
+  return ok;
+}
+
+#endif
+
+//--------------------------------------------------------------------+
+// Flash writer task
+//--------------------------------------------------------------------+
+
+static void flash_writer_task(void* param) {
+  (void) param;
+
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    while (_fl_tail != __atomic_load_n(&_fl_head, __ATOMIC_ACQUIRE)) {
+      flash_slot_t* slot = &_fl_slots[_fl_tail % CFG_FLASH_WRITER_SLOTS];
+
+      TUF2_LOG1("Erase and Write at 0x%08lX", slot->addr);
+
+      // skip erase & write if content already matches
+      if (!flash_content_matches(slot->addr, slot->buf, FLASH_CACHE_SIZE)) {
+        if (ESP_OK != esp_partition_erase_range(_part_ota0, slot->addr, FLASH_CACHE_SIZE) ||
+            ESP_OK != esp_partition_write(_part_ota0, slot->addr, slot->buf, FLASH_CACHE_SIZE)) {
+          TUF2_LOG1("Erase and Write failed at 0x%08lX", slot->addr);
+          _fl_failed = true;
+        }
+      }
+
+      slot->addr = FLASH_CACHE_INVALID_ADDR;
+      __atomic_store_n(&_fl_tail, _fl_tail + 1, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+// Slot being filled by usbd, NULL if all slots are still queued for the writer
+static flash_slot_t* fill_slot(void) {
+  if (_fl_head - __atomic_load_n(&_fl_tail, __ATOMIC_ACQUIRE) >= CFG_FLASH_WRITER_SLOTS) return NULL;
+  return &_fl_slots[_fl_head % CFG_FLASH_WRITER_SLOTS];
+}
+
+// Hand filled slot over to the writer task
+static void fill_slot_submit(void) {
+  __atomic_store_n(&_fl_head, _fl_head + 1, __ATOMIC_RELEASE);
+  xTaskNotifyGive(_fl_writer);
+}
+
+// Check if a block is queued but not yet programmed
+static bool block_queued(uint32_t addr) {
+  for (uint32_t i = __atomic_load_n(&_fl_tail, __ATOMIC_ACQUIRE); i != _fl_head; i++) {
+    if (_fl_slots[i % CFG_FLASH_WRITER_SLOTS].addr == addr) return true;
+  }
+  return false;
+}
+
+static void writer_wait(uint32_t queued) {
+  while (_fl_head - __atomic_load_n(&_fl_tail, __ATOMIC_ACQUIRE) > queued) {
+    vTaskDelay(1);
+  }
+}
+
+// ota0 is partially programmed: boot the factory app (tinyuf2) until an update succeeds
+static void flash_failed(void) {
+  esp_partition_t const* factory = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_FACTORY, NULL);
+  if (factory) {
+    esp_ota_set_boot_partition(factory);
+  }
+}
+
+bool board_flash_flush(void) {
+#if CFG_FLASH_PSRAM_STAGING
+  if (_stage_buf) {
+    if (!stage_program()) {
+      flash_failed();
+      return false;
+    }
+    return true;
+  }
+#endif
+
+  flash_slot_t* slot = fill_slot();
+  if (slot && slot->addr != FLASH_CACHE_INVALID_ADDR) {
+    fill_slot_submit();
   }
 
-  _fl_addr = FLASH_CACHE_INVALID_ADDR;
+  writer_wait(0);
+
+  bool const ok = !_fl_failed;
+  _fl_failed = false;
+  if (!ok) flash_failed();
+  return ok;
 }
 
 bool board_flash_write(uint32_t addr, void const* data, uint32_t len) {
+#if CFG_FLASH_PSRAM_STAGING
+  if (_stage_buf) {
+    stage_write(addr, data, len);
+    return true;
+  }
+#endif
+
+  // a previous block could not be programmed, update is aborted anyway
+  if (_fl_failed) return false;
+
   uint32_t new_addr = addr & ~(FLASH_CACHE_SIZE - 1);
+  flash_slot_t* slot = fill_slot();
+
+  if (slot == NULL || slot->addr != new_addr) {
+    if (slot && slot->addr != FLASH_CACHE_INVALID_ADDR) {
+      fill_slot_submit();
+    }
 
-  if (new_addr != _fl_addr) {
-    board_flash_flush();
+    // normally prevented by board_flash_busy(), but e.g vendor SCSI writes don't check it
+    writer_wait(CFG_FLASH_WRITER_SLOTS - 1);
 
-    _fl_addr = new_addr;
-    board_flash_read(new_addr, _fl_buf, FLASH_CACHE_SIZE);
+    // host re-wrote a block that is not programmed yet
+    if (block_queued(new_addr)) {
+      writer_wait(0);
+    }
+
+    slot = fill_slot();
+    slot->addr = new_addr;
+    slot->count = 0;
+    ota0_read(new_addr, slot->buf, FLASH_CACHE_SIZE);
   }
 
-  memcpy(_fl_buf + (addr & (FLASH_CACHE_SIZE - 1)), data, len);
+  memcpy(slot->buf + (addr & (FLASH_CACHE_SIZE - 1)), data, len);
+
+  // uf2 blocks are usually written in order, start programming as soon as the block is complete
+  slot->count += len;
+  if (slot->count >= FLASH_CACHE_SIZE) {
+    fill_slot_submit();
+  }
 
   return true;
 }
 
+// No free slot for the next block: host retries the write while the writer task catches up
+bool board_flash_busy(void) {
+#if CFG_FLASH_PSRAM_STAGING
+  if (_stage_buf) return false;
+#endif
+
+  return fill_slot() == NULL;
+}
+
+//--------------------------------------------------------------------+
+// Data flash for second MSC LUN: ffat data partition
+//--------------------------------------------------------------------+
+#if TINYUF2_MSC_DATA_LUN
+
+static esp_partition_t const* data_partition(void) {
+  static esp_partition_t const* _part_data = NULL;
+  if (_part_data == NULL) {
+    _part_data = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_FAT, NULL);
+  }
+  return _part_data;
+}
+
+uint32_t board_data_flash_size(void) {
+  esp_partition_t const* part = data_partition();
+  return part ? part->size : 0;
+}
+
+void board_data_flash_read(uint32_t addr, void* buffer, uint32_t len) {
+  esp_partition_read(data_partition(), addr, buffer, len);
+}
+
+bool board_data_flash_write(uint32_t addr, void const* data, uint32_t len) {
+  esp_partition_t const* part = data_partition();
+
+  // skip erase & write if content already matches
+  uint8_t verify_buf[256];
+  bool content_matches = true;
+  for (uint32_t count = 0; count < len && content_matches; count += sizeof(verify_buf)) {
+    esp_partition_read(part, addr + count, verify_buf, sizeof(verify_buf));
+    content_matches = (0 == memcmp(((uint8_t const*) data) + count, verify_buf, sizeof(verify_buf)));
+  }
+  if (content_matches) return true;
+
+  return (ESP_OK == esp_partition_erase_range(part, addr, len)) &&
+         (ESP_OK == esp_partition_write(part, addr, data, len));
+}
+
+#endif
+
 bool board_flash_protect_bootloader(bool protect) {
   // TODO implement later
   (void) protect;
@@ -43,6 +43,7 @@
 
 #ifndef TINYUF2_SELF_UPDATE
 #include "tusb.h"
+#include "uf2.h"
 #endif
 
 //--------------------------------------------------------------------+
@@ -117,6 +118,7 @@ void usb_device_task(void* param) {
   // RTOS forever loop
   while (1) {
     tud_task();
+    uf2_task();
   }
 }
 
@@ -39,6 +39,11 @@
   #define UF2_DETECTION_DELAY_MS     500
 #endif
 
+#ifndef DOUBLE_RESET_RC_CHARGE_US
+  // Time to charge double reset RC when it is left to discharge by itself instead of waiting
+  #define DOUBLE_RESET_RC_CHARGE_US  1000
+#endif
+
 uint8_t const RGB_DOUBLE_TAP[] = { 0x80, 0x00, 0xff }; // Purple
 uint8_t const RGB_OFF[]        = { 0x00, 0x00, 0x00 };
 
@@ -77,6 +82,33 @@ static void esp_reset_reason_clear_hint(void) {
     REG_WRITE(RTC_RESET_CAUSE_REG, 0);
 }
 
+// Return false if user could not have caused this reset i.e brownout, watchdog or software reset
+// (app request with hint is handled separately), GPIO is then sampled only once without delay.
+// Note: reset button (EN/CHIP_PU) is reported as power-on, the same as plugging in.
+static bool reset_reason_user_intent(soc_reset_reason_t reset_reason) {
+    switch (reset_reason) {
+        case RESET_REASON_CORE_SW:
+        case RESET_REASON_CPU0_SW:
+        case RESET_REASON_SYS_BROWN_OUT:
+        case RESET_REASON_CORE_MWDT0:
+        case RESET_REASON_CORE_MWDT1:
+        case RESET_REASON_CORE_RTC_WDT:
+        case RESET_REASON_CPU0_MWDT0:
+        case RESET_REASON_CPU0_MWDT1:
+        case RESET_REASON_CPU0_RTC_WDT:
+        case RESET_REASON_SYS_RTC_WDT:
+        case RESET_REASON_SYS_SUPER_WDT:
+#if CONFIG_IDF_TARGET_ESP32S3
+        case RESET_REASON_CORE_USB_UART:
+        case RESET_REASON_CORE_USB_JTAG:
+#endif
+            return false;
+
+        default:
+            return true;
+    }
+}
+
 /*
  * We arrive here after the ROM bootloader finished loading this second stage bootloader from flash.
  * The hardware is mostly uninitialized, flash cache is down and the app CPU is in reset.
@@ -202,7 +234,16 @@ static int selected_boot_partition(const bootloader_state_t *bs) {
         // UF2: check if GPIO0 is pressed and/or 1-bit RC on specific GPIO detect double reset
         // during this time. If yes then to load uf2 "bootloader".
         if ( boot_index != FACTORY_INDEX ) {
+          // no detection delay if reset is not caused by user
+          uint32_t detect_delay_ms = reset_reason_user_intent(reset_reason) ? UF2_DETECTION_DELAY_MS : 0;
+          if ( detect_delay_ms == 0 && UF2_DETECTION_DELAY_MS > 0 ) {
+            ESP_LOGI(TAG, "Skip UF2 detection delay");
+          }
+
 #ifdef PIN_DOUBLE_RESET_RC
+          // RC is charged and left to discharge through its resistor rather than pulled low
+          bool rc_hold = false;
+
           // Double reset detect if board implements 1-bit memory with RC components
           esp_rom_gpio_pad_select_gpio(PIN_DOUBLE_RESET_RC);
           PIN_INPUT_ENABLE(GPIO_PIN_MUX_REG[PIN_DOUBLE_RESET_RC]);
@@ -215,11 +256,19 @@ static int selected_boot_partition(const bootloader_state_t *bs) {
             // Set to high to charge the RC, indicating we are in reset
             gpio_ll_output_enable(&GPIO, PIN_DOUBLE_RESET_RC);
             gpio_ll_set_level(&GPIO, PIN_DOUBLE_RESET_RC, 1);
+
+            // Power-on (plug in or first reset press): RC holds the charge over a second reset by itself,
+            // so there is no need to wait for it. Button is sampled once
+            if ( reset_reason == RESET_REASON_CHIP_POWER_ON && detect_delay_ms > 0 ) {
+              ESP_LOGI(TAG, "Skip UF2 detection delay, double reset is held by RC");
+              detect_delay_ms = 0;
+              rc_hold = true;
+            }
 #else
           {
 #endif
             // turn led on if there is actually waiting
-            if (UF2_DETECTION_DELAY_MS > 0){
+            if (detect_delay_ms > 0){
               board_led_on();
             }
 
@@ -227,7 +276,7 @@ static int selected_boot_partition(const bootloader_state_t *bs) {
             PIN_INPUT_ENABLE(GPIO_PIN_MUX_REG[PIN_BUTTON_UF2]);
             esp_rom_gpio_pad_pullup_only(PIN_BUTTON_UF2);
 
-            // run the GPIO detection at least once even if UF2_DETECTION_DELAY_MS is set to zero
+            // run the GPIO detection at least once even if delay is zero: button held through reset
             uint32_t tm_start = esp_log_early_timestamp();
             do {
               if ( gpio_ll_get_level(&GPIO, PIN_BUTTON_UF2) == 0 ) {
@@ -237,16 +286,24 @@ static int selected_boot_partition(const bootloader_state_t *bs) {
                 boot_index = FACTORY_INDEX;
                 break;
               }
-            } while (UF2_DETECTION_DELAY_MS > (esp_log_early_timestamp() - tm_start) );
+            } while (detect_delay_ms > (esp_log_early_timestamp() - tm_start) );
 
-            board_led_off();
+            if (detect_delay_ms > 0){
+              board_led_off();
+            }
           }
 
 #if PIN_DOUBLE_RESET_RC
-          // Set to low to discharge the RC
-          gpio_ll_output_enable(&GPIO, PIN_DOUBLE_RESET_RC);
-          gpio_ll_set_level(&GPIO, PIN_DOUBLE_RESET_RC, 0);
-          gpio_ll_output_disable(&GPIO, PIN_DOUBLE_RESET_RC);
+          if ( rc_hold ) {
+            // Release charged RC, a reset before it has discharged is a double reset
+            esp_rom_delay_us(DOUBLE_RESET_RC_CHARGE_US);
+            gpio_ll_output_disable(&GPIO, PIN_DOUBLE_RESET_RC);
+          } else {
+            // Set to low to discharge the RC
+            gpio_ll_output_enable(&GPIO, PIN_DOUBLE_RESET_RC);
+            gpio_ll_set_level(&GPIO, PIN_DOUBLE_RESET_RC, 0);
+            gpio_ll_output_disable(&GPIO, PIN_DOUBLE_RESET_RC);
+          }
 #endif
         }
 
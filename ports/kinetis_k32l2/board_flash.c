@@ -82,12 +82,12 @@ void board_flash_read(uint32_t addr, void* buffer, uint32_t len)
   memcpy(buffer, (void*) addr, len);
 }
 
-void board_flash_flush(void)
+bool board_flash_flush(void)
 {
-  status_t result;
+  status_t result = kStatus_FTFx_Success;
 //  uint32_t failedAddress, failedData;
 
-  if ( bf_flash_page_addr == NO_CACHE ) return;
+  if ( bf_flash_page_addr == NO_CACHE ) return true;
 
 //  result = FLASH_VerifyProgram(&_flash_config, _flash_page_addr, FLASH_PAGE_SIZE, (const uint8_t *)_flash_cache, &failedAddress, &failedData);
 //  if (result != kStatus_Success) {
@@ -106,9 +106,11 @@ void board_flash_flush(void)
         TU_LOG1("FLASH_Erase failed at address = 0x%08lX\r\n",bf_flash_page_addr);
     }
     TU_LOG1("Erased...\r\n");
-    result = FLASH_Program(&bf_flash_config, bf_flash_page_addr, bf_flash_cache, FLASH_PAGE_SIZE);
-    if (kStatus_FTFx_Success != result) {
-        TU_LOG1("FLASH_Program failed at address = 0x%08lX\r\n",bf_flash_page_addr);
+    if (kStatus_FTFx_Success == result) {
+      result = FLASH_Program(&bf_flash_config, bf_flash_page_addr, bf_flash_cache, FLASH_PAGE_SIZE);
+      if (kStatus_FTFx_Success != result) {
+          TU_LOG1("FLASH_Program failed at address = 0x%08lX\r\n",bf_flash_page_addr);
+      }
     }
     __enable_irq();
     TU_LOG1("Programmed.\r\n");
@@ -118,6 +120,7 @@ void board_flash_flush(void)
   }
 
   bf_flash_page_addr = NO_CACHE;
+  return kStatus_FTFx_Success == result;
 }
 
 
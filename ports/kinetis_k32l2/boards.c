@@ -108,6 +108,20 @@ void board_dfu_complete(void)
   NVIC_SystemReset();
 }
 
+board_reset_cause_t board_reset_cause(void)
+{
+  // RCM status is read-only and updated on every reset, nothing to clear
+  uint8_t const srs0 = RCM->SRS0;
+  uint8_t const srs1 = RCM->SRS1;
+
+  if ( srs0 & (RCM_SRS0_POR_MASK | RCM_SRS0_LVD_MASK) ) return BOARD_RESET_POWER_ON;
+  if ( srs0 & RCM_SRS0_WDOG_MASK ) return BOARD_RESET_WATCHDOG;
+  if ( srs1 & (RCM_SRS1_SW_MASK | RCM_SRS1_LOCKUP_MASK) ) return BOARD_RESET_SOFTWARE;
+  if ( srs0 & RCM_SRS0_PIN_MASK ) return BOARD_RESET_PIN;
+
+  return BOARD_RESET_UNKNOWN;
+}
+
 bool board_app_valid(void)
 {
   volatile uint32_t const * app_vector = (volatile uint32_t const*) BOARD_FLASH_APP_START;
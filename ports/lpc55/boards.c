@@ -113,22 +113,25 @@ void board_flash_read(uint32_t addr, void* buffer, uint32_t len)
   FLASH_Read(&_flash_config, addr, buffer, len);
 }
 
-void board_flash_flush(void)
+bool board_flash_flush(void)
 {
   status_t status;
   uint32_t failedAddress, failedData;
 
-  if ( _flash_page_addr == NO_CACHE ) return;
+  if ( _flash_page_addr == NO_CACHE ) return true;
 
   status = FLASH_VerifyProgram(&_flash_config, _flash_page_addr, FLASH_PAGE_SIZE, (const uint8_t *)_flash_cache, &failedAddress, &failedData);
 
   if (status != kStatus_Success) {
     TU_LOG1("Erase and Write at address = 0x%08lX\r\n",_flash_page_addr);
     status = FLASH_Erase(&_flash_config, _flash_page_addr, FLASH_PAGE_SIZE, kFLASH_ApiEraseKey);
-    status = FLASH_Program(&_flash_config, _flash_page_addr, _flash_cache, FLASH_PAGE_SIZE);
+    if (status == kStatus_Success) {
+      status = FLASH_Program(&_flash_config, _flash_page_addr, _flash_cache, FLASH_PAGE_SIZE);
+    }
   }
 
   _flash_page_addr = NO_CACHE;
+  return status == kStatus_Success;
 }
 
 bool board_flash_write(uint32_t addr, void const* data, uint32_t len)
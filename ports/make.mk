@@ -77,11 +77,17 @@ CFLAGS += \
 
 # Bootloader src, board folder and TinyUSB stack
 SRC_C += \
+  src/app_check.c \
+  src/checksum.c \
   src/ghostfat.c \
   src/images.c \
   src/main.c \
   src/msc.c \
+  src/nor_erase.c \
   src/screen.c \
+  src/sd_update.c \
+  src/sfdp.c \
+  src/staged_update.c \
   src/usb_descriptors.c \
   $(subst $(TOP)/,,$(wildcard $(TOP)/$(BOARD_DIR)/*.c))
 
@@ -186,3 +192,19 @@ endif
 # Board specific define
 # TODO should be moved to port.mk
 include $(TOP)/$(BOARD_DIR)/board.mk
+
+#-------------- SD card update --------------
+# Offline update from SD card: board.mk sets TINYUF2_SD_UPDATE = 1 and board provides board_sd_*() API
+ifeq ($(TINYUF2_SD_UPDATE),1)
+ifndef BUILD_APPLICATION
+
+CFLAGS += -DTINYUF2_SD_UPDATE=1
+
+SRC_C += \
+  lib/fatfs/source/ff.c \
+  lib/fatfs/source/ffunicode.c
+
+INC += $(TOP)/lib/fatfs/source
+
+endif
+endif
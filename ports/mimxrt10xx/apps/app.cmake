@@ -9,13 +9,20 @@ function(family_add_bin_hex TARGET)
 endfunction()
 
 function(configure_app TARGET)
+  # app can provide its own memory layout
+  if (EXISTS ${CMAKE_CURRENT_SOURCE_DIR}/memory.ld)
+    set(APP_MEMORY_LD ${CMAKE_CURRENT_SOURCE_DIR}/memory.ld)
+  else ()
+    set(APP_MEMORY_LD ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/memory.ld)
+  endif ()
+
   family_configure_common(${TARGET})
   target_compile_definitions(${TARGET} PUBLIC
     BUILD_APPLICATION
     )
   target_link_options(${TARGET} PUBLIC
     "LINKER:--script=${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../linker/${MCU_VARIANT}_ram.ld"
-    "LINKER:--script=${CMAKE_CURRENT_FUNCTION_LIST_DIR}/memory.ld"
+    "LINKER:--script=${APP_MEMORY_LD}"
     "LINKER:--script=${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../linker/common.ld"
     )
 
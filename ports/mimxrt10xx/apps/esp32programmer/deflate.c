@@ -0,0 +1,224 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Ha Thach (tinyusb.org) for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <string.h>
+#include "deflate.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+#define HASH_BITS     10
+#define MIN_MATCH     3
+#define MAX_MATCH     258
+
+typedef struct
+{
+  deflate_output_t output;
+  void* ctx;
+
+  uint32_t total;
+  uint32_t bitbuf;
+  uint8_t bitcount;
+
+  uint8_t count;
+  uint8_t buf[32];
+} bit_writer_t;
+
+static const uint16_t len_base[29] =
+{
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t len_extra[29] =
+{
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t dist_base[30] =
+{
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+  257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const uint8_t dist_extra[30] =
+{
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+  7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// last position + 1 of each hash, 0 is empty
+static uint16_t _head[1u << HASH_BITS];
+
+//--------------------------------------------------------------------+
+// Bit writer
+//--------------------------------------------------------------------+
+
+static void put_byte(bit_writer_t* bw, uint8_t b)
+{
+  bw->total++;
+  if ( !bw->output ) return;
+
+  bw->buf[bw->count++] = b;
+  if ( bw->count == sizeof(bw->buf) )
+  {
+    bw->output(bw->ctx, bw->buf, bw->count);
+    bw->count = 0;
+  }
+}
+
+// write value LSB first
+static void put_bits(bit_writer_t* bw, uint32_t value, uint8_t nbits)
+{
+  bw->bitbuf |= value << bw->bitcount;
+  bw->bitcount += nbits;
+
+  while ( bw->bitcount >= 8 )
+  {
+    put_byte(bw, (uint8_t) bw->bitbuf);
+    bw->bitbuf >>= 8;
+    bw->bitcount -= 8;
+  }
+}
+
+// Huffman codes are packed MSB first
+static void put_code(bit_writer_t* bw, uint32_t code, uint8_t nbits)
+{
+  uint32_t rev = 0;
+  for ( uint8_t i = 0; i < nbits; i++ )
+  {
+    rev = (rev << 1) | (code & 1);
+    code >>= 1;
+  }
+  put_bits(bw, rev, nbits);
+}
+
+// fixed Huffman literal/length alphabet, RFC 1951 section 3.2.6
+static void put_symbol(bit_writer_t* bw, uint16_t sym)
+{
+  if      ( sym < 144 ) put_code(bw, 0x30 + sym, 8);
+  else if ( sym < 256 ) put_code(bw, 0x190 + (sym - 144), 9);
+  else if ( sym < 280 ) put_code(bw, sym - 256, 7);
+  else                  put_code(bw, 0xC0 + (sym - 280), 8);
+}
+
+static void put_match(bit_writer_t* bw, uint32_t len, uint32_t dist)
+{
+  uint8_t i = 28;
+  while ( len_base[i] > len ) i--;
+  put_symbol(bw, 257 + i);
+  put_bits(bw, len - len_base[i], len_extra[i]);
+
+  i = 29;
+  while ( dist_base[i] > dist ) i--;
+  put_code(bw, i, 5);
+  put_bits(bw, dist - dist_base[i], dist_extra[i]);
+}
+
+//--------------------------------------------------------------------+
+// Compressor
+//--------------------------------------------------------------------+
+
+static inline uint32_t hash3(uint8_t const* p)
+{
+  uint32_t const v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+uint32_t deflate_zlib(uint8_t const* src, uint32_t len, deflate_output_t output, void* ctx)
+{
+  bit_writer_t bw = { .output = output, .ctx = ctx };
+
+  if ( len > DEFLATE_MAX_INPUT ) return 0;
+
+  memset(_head, 0, sizeof(_head));
+
+  // zlib header: deflate with 32KB window, fastest compression level
+  put_byte(&bw, 0x78);
+  put_byte(&bw, 0x01);
+
+  // single final block with fixed Huffman codes
+  put_bits(&bw, 1, 1);
+  put_bits(&bw, 1, 2);
+
+  uint32_t pos = 0;
+  while ( pos < len )
+  {
+    uint32_t match_len = 0;
+    uint32_t match_pos = 0;
+
+    if ( pos + MIN_MATCH <= len )
+    {
+      uint32_t const h = hash3(src + pos);
+      match_pos = _head[h];
+      _head[h] = (uint16_t) (pos + 1);
+
+      if ( match_pos-- )
+      {
+        uint32_t const max_len = (len - pos < MAX_MATCH) ? (len - pos) : MAX_MATCH;
+        while ( match_len < max_len && src[match_pos + match_len] == src[pos + match_len] ) match_len++;
+      }
+    }
+
+    if ( match_len >= MIN_MATCH )
+    {
+      put_match(&bw, match_len, pos - match_pos);
+
+      // insert skipped positions so that later data can refer to them
+      uint32_t const end = pos + match_len;
+      for ( pos++; pos < end; pos++ )
+      {
+        if ( pos + MIN_MATCH <= len ) _head[hash3(src + pos)] = (uint16_t) (pos + 1);
+      }
+    }
+    else
+    {
+      put_symbol(&bw, src[pos]);
+      pos++;
+    }
+  }
+
+  put_symbol(&bw, 256); // end of block
+  if ( bw.bitcount ) put_bits(&bw, 0, 8 - bw.bitcount);
+
+  // Adler-32 of uncompressed data, big endian
+  uint32_t s1 = 1, s2 = 0;
+  for ( uint32_t i = 0; i < len; i++ )
+  {
+    s1 = (s1 + src[i]) % 65521;
+    s2 = (s2 + s1) % 65521;
+  }
+
+  put_byte(&bw, (uint8_t) (s2 >> 8));
+  put_byte(&bw, (uint8_t) s2);
+  put_byte(&bw, (uint8_t) (s1 >> 8));
+  put_byte(&bw, (uint8_t) s1);
+
+  if ( output && bw.count ) output(ctx, bw.buf, bw.count);
+
+  return bw.total;
+}
@@ -0,0 +1,45 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Ha Thach (tinyusb.org) for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef DEFLATE_H_
+#define DEFLATE_H_
+
+#include <stdint.h>
+
+// Minimal zlib compressor for ESP32 ROM FLASH_DEFL_* commands. Input is encoded as a single
+// fixed-Huffman block with greedy LZ77 matching, which is good enough for firmware images
+// and needs no RAM other than the hash table.
+
+// Longest input of one stream, matches can not be farther than deflate window size
+#define DEFLATE_MAX_INPUT   (32*1024)
+
+// Called with compressed output, in order
+typedef void (*deflate_output_t)(void* ctx, uint8_t const* data, uint32_t len);
+
+// Compress src into a zlib stream, return size of compressed stream.
+// output can be NULL to only compute the size, result is the same for the same input
+uint32_t deflate_zlib(uint8_t const* src, uint32_t len, deflate_output_t output, void* ctx);
+
+#endif
@@ -0,0 +1,288 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Ha Thach (tinyusb.org) for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "board_api.h"
+#include "tusb.h"
+
+#include "checksum.h"
+#include "deflate.h"
+#include "esp_rom.h"
+#include "esp_flasher.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+// Flash size of ESP32 co-processor
+#ifndef ESP32_FLASH_SIZE
+#define ESP32_FLASH_SIZE          (4*1024*1024)
+#endif
+
+// Consecutive UF2 blocks are collected in a window of this size, then compressed and flashed
+// in one FLASH_DEFL_BEGIN/DATA session. Larger window compresses better but costs RAM.
+#ifndef ESP_FLASHER_WINDOW_SIZE
+#define ESP_FLASHER_WINDOW_SIZE   (8*1024)
+#endif
+
+// Session ends if host stops sending UF2 blocks without completing the file
+#ifndef ESP_FLASHER_IDLE_TIMEOUT
+#define ESP_FLASHER_IDLE_TIMEOUT  5000
+#endif
+
+#define SECTOR_SIZE               4096
+
+// window is complete once all its 256-byte units are written
+#define UNIT_SIZE                 256
+#define UNIT_COUNT                (ESP_FLASHER_WINDOW_SIZE / UNIT_SIZE)
+
+TU_VERIFY_STATIC(ESP_FLASHER_WINDOW_SIZE <= DEFLATE_MAX_INPUT, "window is larger than deflate input");
+TU_VERIFY_STATIC((ESP_FLASHER_WINDOW_SIZE % SECTOR_SIZE) == 0, "window must be multiple of sector");
+
+enum
+{
+  FLASHER_IDLE = 0,
+  FLASHER_CONNECTED,
+  FLASHER_FAILED,
+};
+
+static uint8_t _state = FLASHER_IDLE;
+
+// Window starts at sector of its first block, bytes not written by UF2 are left as 0xFF
+// since the ROM erases whole sectors anyway. Blocks may come in any order within a window, but
+// windows are expected in increasing address order (as uf2conv.py generates): a block going
+// back to an already flashed sector would erase it.
+static uint8_t _win_buf[ESP_FLASHER_WINDOW_SIZE];
+static uint32_t _win_addr;
+static uint32_t _win_len; // highest written offset, 0 if empty
+static uint32_t _win_units;
+static uint32_t _win_mask[(UNIT_COUNT + 31) / 32];
+
+// Part of block that does not fit current window, goes to the next window
+static uint8_t _stash_buf[476];
+static uint32_t _stash_addr;
+static uint32_t _stash_len;
+
+static volatile bool _win_ready; // window is closed and waiting to be flashed
+static volatile bool _flush;     // last UF2 block is received
+static uint32_t _last_write_ms;
+
+// Contiguous range flashed so far, verified with MD5 once complete
+static uint32_t _run_addr;
+static uint32_t _run_len;
+static tuf2_md5_t _run_md5;
+
+//--------------------------------------------------------------------+
+// Window
+//--------------------------------------------------------------------+
+
+// copy as much as fits into current window (opened if empty), return number of copied bytes
+static uint32_t window_write(uint32_t addr, uint8_t const* src, uint32_t len)
+{
+  if ( !_win_len )
+  {
+    _win_addr = addr & ~(SECTOR_SIZE - 1);
+    _win_units = 0;
+    memset(_win_buf, 0xff, sizeof(_win_buf));
+    memset(_win_mask, 0, sizeof(_win_mask));
+  }
+
+  uint32_t const win_end = _win_addr + ESP_FLASHER_WINDOW_SIZE;
+  if ( addr < _win_addr || addr >= win_end ) return 0;
+
+  uint32_t const count = tu_min32(len, win_end - addr);
+  uint32_t const offset = addr - _win_addr;
+
+  memcpy(_win_buf + offset, src, count);
+  _win_len = tu_max32(_win_len, offset + count);
+
+  for ( uint32_t i = offset / UNIT_SIZE; i < (offset + count + UNIT_SIZE - 1) / UNIT_SIZE; i++ )
+  {
+    uint32_t const bit = 1UL << (i % 32);
+    if ( !(_win_mask[i / 32] & bit) )
+    {
+      _win_mask[i / 32] |= bit;
+      _win_units++;
+    }
+  }
+
+  return count;
+}
+
+static bool run_verify(void)
+{
+  if ( !_run_len ) return true;
+
+  uint32_t const len = _run_len;
+  uint8_t expected[16];
+  uint8_t actual[16];
+
+  tuf2_md5_final(&_run_md5, expected);
+  _run_len = 0;
+
+  return esp_rom_flash_md5(_run_addr, len, actual) && (0 == memcmp(expected, actual, 16));
+}
+
+// Flash current window, data is verified per contiguous run to save MD5 round trips
+static bool window_flash(void)
+{
+  uint32_t const len = (_win_len + SECTOR_SIZE - 1) & ~(SECTOR_SIZE - 1);
+  _win_len = 0;
+
+  if ( _run_len && (_win_addr != _run_addr + _run_len) )
+  {
+    if ( !run_verify() ) return false;
+  }
+
+  if ( !_run_len )
+  {
+    _run_addr = _win_addr;
+    tuf2_md5_init(&_run_md5);
+  }
+
+  if ( !esp_rom_flash_defl(_win_addr, _win_buf, len) ) return false;
+
+  tuf2_md5_update(&_run_md5, _win_buf, len);
+  _run_len += len;
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Flasher
+//--------------------------------------------------------------------+
+
+bool esp_flasher_active(void)
+{
+  return _state != FLASHER_IDLE || _win_ready || _flush;
+}
+
+bool esp_flasher_task(void)
+{
+  // incomplete file, flash what has been received and give UART back
+  if ( (_state != FLASHER_IDLE || _win_len) && !_win_ready && (millis() - _last_write_ms > ESP_FLASHER_IDLE_TIMEOUT) )
+  {
+    _flush = true;
+  }
+
+  if ( !(_win_ready || _flush) ) return false;
+
+  board_led_write(0xff);
+
+  if ( _state == FLASHER_IDLE )
+  {
+    _run_len = 0;
+    _state = esp_rom_connect(ESP32_FLASH_SIZE) ? FLASHER_CONNECTED : FLASHER_FAILED;
+  }
+
+  // window with stashed data also needs flashing if it is the last one
+  while ( _win_ready || (_flush && _win_len) )
+  {
+    if ( _state == FLASHER_CONNECTED && !window_flash() ) _state = FLASHER_FAILED;
+    _win_len = 0;
+    _win_units = 0;
+
+    if ( _stash_len )
+    {
+      uint32_t const count = window_write(_stash_addr, _stash_buf, _stash_len);
+      _stash_addr += count;
+      _stash_len -= count;
+    }
+
+    // keep accepting UF2 blocks while the window is not complete
+    _win_ready = (_stash_len > 0) || (_win_units == UNIT_COUNT);
+  }
+
+  board_led_write(0);
+
+  if ( !_flush ) return false;
+
+  if ( _state == FLASHER_CONNECTED && !run_verify() ) _state = FLASHER_FAILED;
+
+  // run new firmware or leave failed loader, either way UART goes back to bridge
+  esp_rom_disconnect();
+
+  _state = FLASHER_IDLE;
+  _flush = false;
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// Board flash API for ghostfat
+//--------------------------------------------------------------------+
+
+// ESP32 flash can not be read back, CURRENT.UF2 is empty
+uint32_t board_flash_size(void)
+{
+  return 0;
+}
+
+void board_flash_read(uint32_t addr, void* buffer, uint32_t len)
+{
+  (void) addr;
+  memset(buffer, 0xff, len);
+}
+
+bool board_flash_write(uint32_t addr, void const* src, uint32_t len)
+{
+  uint8_t const* data = (uint8_t const*) src;
+
+  _last_write_ms = millis();
+
+  if ( _state == FLASHER_FAILED ) return false;
+  if ( addr + len > ESP32_FLASH_SIZE || len > sizeof(_stash_buf) ) return false;
+
+  uint32_t const count = window_write(addr, data, len);
+
+  if ( count < len )
+  {
+    // flash current window in main loop, the rest goes to the next one
+    memcpy(_stash_buf, data + count, len - count);
+    _stash_addr = addr + count;
+    _stash_len = len - count;
+    _win_ready = true;
+  }
+  else if ( _win_units == UNIT_COUNT )
+  {
+    _win_ready = true;
+  }
+
+  return true;
+}
+
+bool board_flash_flush(void)
+{
+  // window is flashed to ESP32 by esp_flasher_task()
+  _flush = true;
+  return true;
+}
+
+// hold off UF2 blocks while window is being flashed, host will retry them
+bool board_flash_busy(void)
+{
+  return _win_ready || _flush;
+}
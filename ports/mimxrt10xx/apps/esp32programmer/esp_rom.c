@@ -0,0 +1,438 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Ha Thach (tinyusb.org) for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "board_api.h"
+#include "tusb.h"
+
+#include "deflate.h"
+#include "esp_rom.h"
+#include "uart_bridge.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+enum
+{
+  CMD_SYNC             = 0x08,
+  CMD_SPI_SET_PARAMS   = 0x0B,
+  CMD_SPI_ATTACH       = 0x0D,
+  CMD_CHANGE_BAUDRATE  = 0x0F,
+  CMD_FLASH_DEFL_BEGIN = 0x10,
+  CMD_FLASH_DEFL_DATA  = 0x11,
+  CMD_FLASH_DEFL_END   = 0x12,
+  CMD_SPI_FLASH_MD5    = 0x13,
+};
+
+enum
+{
+  SLIP_END     = 0xC0,
+  SLIP_ESC     = 0xDB,
+  SLIP_ESC_END = 0xDC,
+  SLIP_ESC_ESC = 0xDD,
+};
+
+#define ROM_BAUDRATE        115200
+
+// ESP32 ROM FLASH_WRITE_SIZE, compressed data is sent in blocks of this size
+#define ROM_BLOCK_SIZE      0x400
+
+#define CHECKSUM_SEED       0xEF
+
+#define DEFAULT_TIMEOUT     3000
+#define SYNC_TIMEOUT        100
+#define SYNC_RETRY          5
+
+// same as esptool.py
+#define ERASE_MS_PER_MB     30000
+#define MD5_MS_PER_MB       8000
+
+static uint32_t const _baud_list[] = { ESP_ROM_BAUDRATE_LIST };
+
+// SLIP encoded output is collected and written to UART in one go
+static uint8_t _tx_buf[64];
+static uint32_t _tx_count;
+
+// header (8) + MD5 as hex (32) + status (4)
+static uint8_t _rx_buf[64];
+
+typedef struct
+{
+  uint32_t seq;
+  uint32_t count;
+  bool ok;
+  uint8_t buf[ROM_BLOCK_SIZE];
+} defl_data_t;
+
+static defl_data_t _defl;
+
+//--------------------------------------------------------------------+
+// SLIP
+//--------------------------------------------------------------------+
+
+static void tx_flush(void)
+{
+  if ( _tx_count ) uart_bridge_write(_tx_buf, (int) _tx_count);
+  _tx_count = 0;
+}
+
+static void tx_byte(uint8_t b)
+{
+  if ( _tx_count == sizeof(_tx_buf) ) tx_flush();
+  _tx_buf[_tx_count++] = b;
+}
+
+static void slip_write(void const* data, uint32_t len)
+{
+  uint8_t const* p = (uint8_t const*) data;
+  while ( len-- )
+  {
+    uint8_t const b = *p++;
+    if ( b == SLIP_END )
+    {
+      tx_byte(SLIP_ESC);
+      tx_byte(SLIP_ESC_END);
+    }
+    else if ( b == SLIP_ESC )
+    {
+      tx_byte(SLIP_ESC);
+      tx_byte(SLIP_ESC_ESC);
+    }
+    else
+    {
+      tx_byte(b);
+    }
+  }
+}
+
+static bool uart_getc(uint8_t* ch, uint32_t deadline)
+{
+  while ( 1 )
+  {
+    if ( uart_bridge_read(ch, 1) ) return true;
+
+    // nothing is lost while waiting, RX is buffered by DMA
+    if ( (int32_t) (millis() - deadline) >= 0 ) return false;
+  }
+}
+
+// Receive a SLIP frame, return its decoded length (truncated to rx buffer) or -1 if timed out
+static int32_t slip_read(uint32_t deadline)
+{
+  uint8_t ch;
+
+  // wait for frame start
+  do
+  {
+    if ( !uart_getc(&ch, deadline) ) return -1;
+  } while ( ch != SLIP_END );
+
+  uint32_t count = 0;
+  bool esc = false;
+
+  while ( 1 )
+  {
+    if ( !uart_getc(&ch, deadline) ) return -1;
+
+    if ( esc )
+    {
+      ch = (ch == SLIP_ESC_END) ? SLIP_END : (ch == SLIP_ESC_ESC) ? SLIP_ESC : ch;
+      esc = false;
+    }
+    else if ( ch == SLIP_ESC )
+    {
+      esc = true;
+      continue;
+    }
+    else if ( ch == SLIP_END )
+    {
+      // back to back END of previous frame end and next frame start
+      if ( count == 0 ) continue;
+      return (int32_t) count;
+    }
+
+    if ( count < sizeof(_rx_buf) ) _rx_buf[count] = ch;
+    count++;
+  }
+}
+
+static void uart_drain(void)
+{
+  uint8_t buf[16];
+  delay_blocking(20);
+  while ( uart_bridge_read(buf, sizeof(buf)) ) {}
+}
+
+//--------------------------------------------------------------------+
+// Command
+//--------------------------------------------------------------------+
+
+static inline void u32_le(uint8_t* p, uint32_t v)
+{
+  p[0] = (uint8_t) v;
+  p[1] = (uint8_t) (v >> 8);
+  p[2] = (uint8_t) (v >> 16);
+  p[3] = (uint8_t) (v >> 24);
+}
+
+static void command_send(uint8_t cmd, void const* params, uint32_t params_len,
+                         void const* data, uint32_t data_len, uint32_t checksum)
+{
+  uint8_t header[8];
+  uint32_t const size = params_len + data_len;
+
+  header[0] = 0x00; // request
+  header[1] = cmd;
+  header[2] = (uint8_t) size;
+  header[3] = (uint8_t) (size >> 8);
+  u32_le(header + 4, checksum);
+
+  tx_byte(SLIP_END);
+  slip_write(header, sizeof(header));
+  slip_write(params, params_len);
+  if ( data_len ) slip_write(data, data_len);
+  tx_byte(SLIP_END);
+  tx_flush();
+}
+
+// Wait for response of cmd, resp_len is the size of response data before status bytes
+static bool command_response(uint8_t cmd, uint32_t resp_len, uint32_t timeout)
+{
+  uint32_t const deadline = millis() + timeout;
+
+  while ( 1 )
+  {
+    int32_t const count = slip_read(deadline);
+    if ( count < 0 ) return false;
+
+    // skip other responses e.g extra replies of SYNC
+    if ( count < 8 || _rx_buf[0] != 0x01 || _rx_buf[1] != cmd ) continue;
+
+    uint32_t const size = _rx_buf[2] | (_rx_buf[3] << 8);
+    if ( size < resp_len + 2 || (uint32_t) count < 8 + resp_len + 2 ) return false;
+
+    // status follows response data: 0 is success, next byte is error reason
+    return _rx_buf[8 + resp_len] == 0;
+  }
+}
+
+static bool command(uint8_t cmd, void const* params, uint32_t params_len, uint32_t timeout)
+{
+  command_send(cmd, params, params_len, NULL, 0, 0);
+  return command_response(cmd, 0, timeout);
+}
+
+static inline uint32_t timeout_per_mb(uint32_t ms_per_mb, uint32_t size)
+{
+  uint32_t const ms = (uint32_t) (((uint64_t) ms_per_mb * size) / (1024*1024));
+  return (ms < DEFAULT_TIMEOUT) ? DEFAULT_TIMEOUT : ms;
+}
+
+//--------------------------------------------------------------------+
+// Connection
+//--------------------------------------------------------------------+
+
+static bool sync(void)
+{
+  uint8_t params[36] = { 0x07, 0x07, 0x12, 0x20 };
+  memset(params + 4, 0x55, 32);
+
+  for ( uint32_t i = 0; i < SYNC_RETRY; i++ )
+  {
+    command_send(CMD_SYNC, params, sizeof(params), NULL, 0, 0);
+    if ( command_response(CMD_SYNC, 0, SYNC_TIMEOUT) )
+    {
+      // ROM replies to SYNC several times
+      uart_drain();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Enter download mode and sync with ROM at its default baud rate
+static bool rom_start(void)
+{
+  uart_bridge_set_baudrate(ROM_BAUDRATE);
+  esp32_manual_enter_dfu();
+  uart_drain();
+
+  return sync();
+}
+
+static bool change_baudrate(uint32_t baud)
+{
+  uint8_t params[8];
+  u32_le(params, baud);
+  u32_le(params + 4, 0); // old baud rate, 0 for ROM
+
+  if ( !command(CMD_CHANGE_BAUDRATE, params, sizeof(params), DEFAULT_TIMEOUT) ) return false;
+
+  uart_bridge_set_baudrate(baud);
+  uart_drain();
+
+  // ROM can not always keep up with the highest rates, check link with another sync
+  return sync();
+}
+
+bool esp_rom_connect(uint32_t flash_size)
+{
+  bool synced = false;
+
+  for ( uint32_t i = 0; i < TU_ARRAY_SIZE(_baud_list); i++ )
+  {
+    if ( !rom_start() ) return false;
+
+    if ( change_baudrate(_baud_list[i]) )
+    {
+      synced = true;
+      break;
+    }
+  }
+
+  // all fast rates failed, stay at ROM default
+  if ( !synced && !rom_start() ) return false;
+
+  uint8_t params[24];
+
+  // SPI attach with default pins
+  memset(params, 0, 8);
+  if ( !command(CMD_SPI_ATTACH, params, 8, DEFAULT_TIMEOUT) ) return false;
+
+  // id, total size, block size, sector size, page size, status mask
+  u32_le(params +  0, 0);
+  u32_le(params +  4, flash_size);
+  u32_le(params +  8, 64*1024);
+  u32_le(params + 12, 4*1024);
+  u32_le(params + 16, 256);
+  u32_le(params + 20, 0xFFFF);
+
+  return command(CMD_SPI_SET_PARAMS, params, sizeof(params), DEFAULT_TIMEOUT);
+}
+
+void esp_rom_disconnect(void)
+{
+  uint8_t params[4];
+  u32_le(params, 1); // stay in loader, reset is done with EN pin
+  (void) command(CMD_FLASH_DEFL_END, params, sizeof(params), DEFAULT_TIMEOUT);
+
+  esp32_manual_reset();
+}
+
+//--------------------------------------------------------------------+
+// Flash
+//--------------------------------------------------------------------+
+
+static void defl_data_send(defl_data_t* defl)
+{
+  uint8_t params[16];
+  uint8_t checksum = CHECKSUM_SEED;
+
+  for ( uint32_t i = 0; i < defl->count; i++ ) checksum ^= defl->buf[i];
+
+  u32_le(params, defl->count);
+  u32_le(params + 4, defl->seq);
+  u32_le(params + 8, 0);
+  u32_le(params + 12, 0);
+
+  command_send(CMD_FLASH_DEFL_DATA, params, sizeof(params), defl->buf, defl->count, checksum);
+  if ( !command_response(CMD_FLASH_DEFL_DATA, 0, DEFAULT_TIMEOUT) ) defl->ok = false;
+
+  defl->seq++;
+  defl->count = 0;
+}
+
+static void defl_output(void* ctx, uint8_t const* data, uint32_t len)
+{
+  defl_data_t* defl = (defl_data_t*) ctx;
+
+  while ( len && defl->ok )
+  {
+    uint32_t const n = tu_min32(len, ROM_BLOCK_SIZE - defl->count);
+    memcpy(defl->buf + defl->count, data, n);
+    defl->count += n;
+    data += n;
+    len -= n;
+
+    if ( defl->count == ROM_BLOCK_SIZE ) defl_data_send(defl);
+  }
+}
+
+bool esp_rom_flash_defl(uint32_t addr, uint8_t const* data, uint32_t len)
+{
+  // compressed size is needed for FLASH_DEFL_BEGIN, compress twice rather than buffer the output
+  uint32_t const zlen = deflate_zlib(data, len, NULL, NULL);
+  if ( !zlen ) return false;
+
+  // uncompressed size (erased by ROM), number of data packets, packet size, offset.
+  // ROM loader (unlike esptool stub) expects the erase size rounded up to whole packets
+  uint8_t params[16];
+  u32_le(params, ((len + ROM_BLOCK_SIZE - 1) / ROM_BLOCK_SIZE) * ROM_BLOCK_SIZE);
+  u32_le(params + 4, (zlen + ROM_BLOCK_SIZE - 1) / ROM_BLOCK_SIZE);
+  u32_le(params + 8, ROM_BLOCK_SIZE);
+  u32_le(params + 12, addr);
+
+  if ( !command(CMD_FLASH_DEFL_BEGIN, params, sizeof(params), timeout_per_mb(ERASE_MS_PER_MB, len)) ) return false;
+
+  _defl.seq = 0;
+  _defl.count = 0;
+  _defl.ok = true;
+
+  deflate_zlib(data, len, defl_output, &_defl);
+  if ( _defl.ok && _defl.count ) defl_data_send(&_defl);
+
+  return _defl.ok;
+}
+
+bool esp_rom_flash_md5(uint32_t addr, uint32_t len, uint8_t digest[16])
+{
+  uint8_t params[16];
+  u32_le(params, addr);
+  u32_le(params + 4, len);
+  u32_le(params + 8, 0);
+  u32_le(params + 12, 0);
+
+  command_send(CMD_SPI_FLASH_MD5, params, sizeof(params), NULL, 0, 0);
+
+  // ROM replies with MD5 as 32 hex characters
+  if ( !command_response(CMD_SPI_FLASH_MD5, 32, timeout_per_mb(MD5_MS_PER_MB, len)) ) return false;
+
+  for ( uint32_t i = 0; i < 16; i++ )
+  {
+    uint8_t byte = 0;
+    for ( uint32_t j = 0; j < 2; j++ )
+    {
+      uint8_t const c = _rx_buf[8 + 2*i + j];
+      uint8_t const nibble = (c >= 'a') ? (c - 'a' + 10) : (c >= 'A') ? (c - 'A' + 10) : (c - '0');
+      byte = (uint8_t) ((byte << 4) | (nibble & 0x0f));
+    }
+    digest[i] = byte;
+  }
+
+  return true;
+}
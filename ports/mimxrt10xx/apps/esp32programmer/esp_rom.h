@@ -0,0 +1,66 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Ha Thach (tinyusb.org) for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef ESP_ROM_H_
+#define ESP_ROM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// ESP32 ROM serial loader (same protocol as esptool.py without flasher stub): SLIP framed
+// commands over UART, data is sent deflate compressed with FLASH_DEFL_* commands.
+// Only ESP32 is supported, later chips take an extra word in FLASH_DEFL_BEGIN.
+
+// Baud rates tried in order after sync, the first one that ESP32 can still sync with is used
+#ifndef ESP_ROM_BAUDRATE_LIST
+#define ESP_ROM_BAUDRATE_LIST   2000000, 921600, 460800
+#endif
+
+//--------------------------------------------------------------------+
+// Implemented by application (main.c)
+//--------------------------------------------------------------------+
+uint32_t millis(void);
+void delay_blocking(uint32_t ms);
+void esp32_manual_enter_dfu(void);
+void esp32_manual_reset(void);
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+// Put ESP32 into download mode, sync, attach SPI flash of flash_size and switch to highest working baud rate
+bool esp_rom_connect(uint32_t flash_size);
+
+// Erase and write data to flash. addr and len must be multiple of 4KB flash sector,
+// len must not be larger than DEFLATE_MAX_INPUT
+bool esp_rom_flash_defl(uint32_t addr, uint8_t const* data, uint32_t len);
+
+// MD5 of flash contents computed by ESP32
+bool esp_rom_flash_md5(uint32_t addr, uint32_t len, uint8_t digest[16]);
+
+// Leave loader and reset ESP32 to run new firmware, UART is left at loader baud rate
+void esp_rom_disconnect(void);
+
+#endif
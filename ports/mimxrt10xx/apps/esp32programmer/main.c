@@ -29,22 +29,24 @@
 
 #include "fsl_gpio.h"
 #include "fsl_iomuxc.h"
-#include "fsl_lpuart.h"
 
 #include "board_api.h"
+#include "uf2.h"
 #include "tusb.h"
 
+#include "esp_rom.h"
+#include "esp_flasher.h"
+#include "uart_bridge.h"
+
 /* This is an application to act as USB <-> Uart and
- * used to program ESP32 Co-Processors
+ * used to program ESP32 Co-Processors, either with esptool.py over CDC
+ * or by dropping an ESP32 UF2 file onto the MSC drive (see esp_flasher.c)
  */
 
 // Enable this for more reliable connection require esptool.py default reset option "--before default_reset"
 // i.e "--before no_reset" should not be include in the esptool.py command
 #define ESP32_DTR_RTS_BOOT_RESET_SUPPORT    0
 
-// optional API, not included in board_api.h
-int board_uart_read(uint8_t* buf, int len);
-
 //--------------------------------------------------------------------+
 // MACRO TYPEDEF CONSTANT ENUM DECLARATION
 //--------------------------------------------------------------------+
@@ -59,12 +61,12 @@ static uint32_t baud_rate = 115200;
 // Timer
 //--------------------------------------------------------------------+
 
-TU_ATTR_ALWAYS_INLINE static inline uint32_t millis(void)
+uint32_t millis(void)
 {
   return _timer_count;
 }
 
-static inline void delay_blocking(uint32_t ms)
+void delay_blocking(uint32_t ms)
 {
   uint32_t start = _timer_count;
   while(_timer_count - start < ms)
@@ -106,6 +108,16 @@ void esp32_manual_enter_dfu(void)
   esp32_set_io0(1);
 }
 
+void esp32_manual_reset(void)
+{
+  // Reset ESP to run its firmware
+  esp32_set_io0(1);
+  esp32_set_en(0);
+  delay_blocking(100);
+
+  esp32_set_en(1);
+}
+
 //--------------------------------------------------------------------+
 // Main
 //--------------------------------------------------------------------+
@@ -126,7 +138,9 @@ int main(void)
   GPIO_PinInit(ESP32_RESET_PORT, ESP32_RESET_PIN, &pin_config);
 
   board_uart_init(115200);
+  uart_bridge_init();
   board_usb_init();
+  uf2_init();
   tusb_init();
 
   board_timer_start(1);
@@ -137,33 +151,18 @@ int main(void)
 
   while(1)
   {
-    uint8_t serial_buf[512];
-    uint32_t count;
+    tud_task();
+    uf2_task();
 
-    // UART -> USB
-    count = (uint32_t) board_uart_read(serial_buf, sizeof(serial_buf));
-    if (count)
+    // ESP32 UF2 file is being flashed, UART is owned by ROM loader
+    if ( esp_flasher_task() )
     {
-      board_led_write(0xff);
-
-      tud_cdc_write(serial_buf, count);
-      tud_cdc_write_flush();
-
-      board_led_write(0);
+      uart_bridge_set_baudrate(baud_rate);
     }
 
-    // USB -> UART
-    while ( tud_cdc_available() )
-    {
-      board_led_write(0xff);
-
-      count = tud_cdc_read(serial_buf, sizeof(serial_buf));
-      board_uart_write(serial_buf, count);
+    if ( esp_flasher_active() ) continue;
 
-      board_led_write(0);
-    }
-
-    tud_task();
+    uart_bridge_task();
   }
 }
 
@@ -192,18 +191,8 @@ void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const* line_coding)
   {
     baud_rate = line_coding->bit_rate;
 
-    // must be the same freq as board_init()
-    uint32_t freq;
-    if (CLOCK_GetMux(kCLOCK_UartMux) == 0) /* PLL3 div6 80M */
-    {
-      freq = (CLOCK_GetPllFreq(kCLOCK_PllUsb1) / 6U) / (CLOCK_GetDiv(kCLOCK_UartDiv) + 1U);
-    }
-    else
-    {
-      freq = CLOCK_GetOscFreq() / (CLOCK_GetDiv(kCLOCK_UartDiv) + 1U);
-    }
-
-    LPUART_SetBaudRate(UART_DEV, baud_rate, freq);
+    // applied once flasher is done with UART
+    if ( !esp_flasher_active() ) uart_bridge_set_baudrate(baud_rate);
   }
 }
 
@@ -222,6 +211,8 @@ void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
   bool const en = !rts;
   bool const io0 = !dtr;
 
+  if ( esp_flasher_active() ) return;
+
   esp32_set_io0(io0);
   esp32_set_en(en);
 }
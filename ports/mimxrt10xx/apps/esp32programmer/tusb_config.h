@@ -76,6 +76,7 @@
 
 //------------- CLASS -------------//
 #define CFG_TUD_CDC              1
+#define CFG_TUD_MSC              1
 
 // CDC FIFO size of TX and RX
 #define CFG_TUD_CDC_RX_BUFSIZE   1024
@@ -83,6 +84,9 @@
 
 #define CFG_TUD_CDC_EP_BUFSIZE   (TUD_OPT_HIGH_SPEED ? 512 : 64)
 
+// MSC Buffer size of Device Mass storage, one UF2 block at a time
+#define CFG_TUD_MSC_BUFSIZE      512
+
 #ifdef __cplusplus
  }
 #endif
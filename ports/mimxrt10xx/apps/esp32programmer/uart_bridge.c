@@ -0,0 +1,338 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Ha Thach (tinyusb.org) for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <string.h>
+
+#include "fsl_dmamux.h"
+#include "fsl_edma.h"
+#include "fsl_lpuart.h"
+
+#include "board_api.h"
+#include "tusb.h"
+
+#include "uart_bridge.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+// DMA resources of UART_DEV
+#ifndef UART_DMA_RX_REQUEST
+#define UART_DMA_RX_REQUEST     kDmaRequestMuxLPUART1Rx
+#define UART_DMA_TX_REQUEST     kDmaRequestMuxLPUART1Tx
+#define UART_IRQn               LPUART1_IRQn
+#define UART_IRQHandler         LPUART1_IRQHandler
+#endif
+
+#ifndef UART_DMA_RX_CHANNEL
+#define UART_DMA_RX_CHANNEL     0
+#define UART_DMA_TX_CHANNEL     1
+#define UART_DMA_RX_IRQn        DMA0_IRQn
+#define UART_DMA_RX_IRQHandler  DMA0_IRQHandler
+#endif
+
+// Partial USB packet is sent after line is idle, or after this long if idle is missed
+#define RX_FLUSH_MS             2
+
+TU_VERIFY_STATIC((UART_BRIDGE_RX_SIZE & (UART_BRIDGE_RX_SIZE - 1)) == 0, "RX size must be power of 2");
+
+// Implemented by main.c
+uint32_t millis(void);
+
+// RX buffer is filled by DMA endlessly, positions are free running byte counts
+static uint8_t _rx_buf[UART_BRIDGE_RX_SIZE] __attribute__((aligned(4)));
+static volatile uint32_t _rx_wraps;
+static uint32_t _rx_rd;
+
+static volatile bool _rx_idle;
+static bool _rx_pending;        // data written to CDC but not flushed yet
+static uint32_t _rx_pending_ms;
+
+// TX ping-pong buffers: one is sent by DMA while the other is filled
+static uint8_t _tx_buf[2][UART_BRIDGE_TX_SIZE] __attribute__((aligned(4)));
+static uint8_t _tx_idx;         // buffer being filled
+static uint32_t _tx_count;
+static bool _tx_active;
+
+static uart_bridge_stats_t _stats;
+static uint32_t _stats_ms;
+static uint32_t _stats_rx;
+static uint32_t _stats_tx;
+
+//--------------------------------------------------------------------+
+// Helper
+//--------------------------------------------------------------------+
+
+static uint32_t uart_clock_freq(void)
+{
+  // must be the same freq as board_init()
+  if (CLOCK_GetMux(kCLOCK_UartMux) == 0) /* PLL3 div6 80M */
+  {
+    return (CLOCK_GetPllFreq(kCLOCK_PllUsb1) / 6U) / (CLOCK_GetDiv(kCLOCK_UartDiv) + 1U);
+  }
+  else
+  {
+    return CLOCK_GetOscFreq() / (CLOCK_GetDiv(kCLOCK_UartDiv) + 1U);
+  }
+}
+
+// Total bytes written by RX DMA
+static uint32_t rx_written(void)
+{
+  uint32_t const int_mask = 1UL << UART_DMA_RX_CHANNEL;
+  uint32_t wraps, remaining, pending;
+
+  // CITER reloads at end of major loop before the interrupt bumps wrap count,
+  // take a snapshot that is consistent with the pending interrupt
+  do
+  {
+    wraps = _rx_wraps;
+    pending = DMA0->INT & int_mask;
+    remaining = EDMA_GetRemainingMajorLoopCount(DMA0, UART_DMA_RX_CHANNEL);
+  } while ( wraps != _rx_wraps || pending != (DMA0->INT & int_mask) );
+
+  if ( pending ) wraps++;
+
+  return wraps * UART_BRIDGE_RX_SIZE + (UART_BRIDGE_RX_SIZE - remaining);
+}
+
+// Number of bytes available to read, skip data that is already overwritten
+static uint32_t rx_available(void)
+{
+  uint32_t const wr = rx_written();
+  uint32_t count = wr - _rx_rd;
+
+  if ( count > UART_BRIDGE_RX_SIZE )
+  {
+    _stats.rx_overflow += count - UART_BRIDGE_RX_SIZE;
+    _rx_rd = wr - UART_BRIDGE_RX_SIZE;
+    count = UART_BRIDGE_RX_SIZE;
+  }
+
+  if ( count > _stats.rx_level_max ) _stats.rx_level_max = count;
+
+  return count;
+}
+
+static bool tx_busy(void)
+{
+  if ( _tx_active && (EDMA_GetChannelStatusFlags(DMA0, UART_DMA_TX_CHANNEL) & kEDMA_DoneFlag) )
+  {
+    EDMA_ClearChannelStatusFlags(DMA0, UART_DMA_TX_CHANNEL, kEDMA_DoneFlag);
+    _tx_active = false;
+  }
+
+  return _tx_active;
+}
+
+// Send filled buffer with DMA, must not be busy
+static void tx_kick(void)
+{
+  edma_transfer_config_t xfer;
+  EDMA_PrepareTransfer(&xfer, _tx_buf[_tx_idx], 1, (void*) LPUART_GetDataRegisterAddress(UART_DEV), 1, 1,
+                       _tx_count, kEDMA_MemoryToPeripheral);
+  EDMA_SetTransferConfig(DMA0, UART_DMA_TX_CHANNEL, &xfer, NULL);
+  EDMA_EnableAutoStopRequest(DMA0, UART_DMA_TX_CHANNEL, true);
+
+  _tx_active = true;
+  EDMA_EnableChannelRequest(DMA0, UART_DMA_TX_CHANNEL);
+
+  _tx_idx ^= 1;
+  _tx_count = 0;
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void uart_bridge_init(void)
+{
+  edma_config_t dma_config;
+  EDMA_GetDefaultConfig(&dma_config);
+  EDMA_Init(DMA0, &dma_config);
+  DMAMUX_Init(DMAMUX);
+
+  DMAMUX_SetSource(DMAMUX, UART_DMA_RX_CHANNEL, UART_DMA_RX_REQUEST);
+  DMAMUX_EnableChannel(DMAMUX, UART_DMA_RX_CHANNEL);
+  DMAMUX_SetSource(DMAMUX, UART_DMA_TX_CHANNEL, UART_DMA_TX_REQUEST);
+  DMAMUX_EnableChannel(DMAMUX, UART_DMA_TX_CHANNEL);
+
+  // RX: endless transfer, destination goes back to start of buffer after each major loop
+  edma_transfer_config_t xfer;
+  EDMA_ResetChannel(DMA0, UART_DMA_RX_CHANNEL);
+  EDMA_PrepareTransfer(&xfer, (void*) LPUART_GetDataRegisterAddress(UART_DEV), 1, _rx_buf, 1, 1,
+                       sizeof(_rx_buf), kEDMA_PeripheralToMemory);
+  EDMA_SetTransferConfig(DMA0, UART_DMA_RX_CHANNEL, &xfer, NULL);
+  DMA0->TCD[UART_DMA_RX_CHANNEL].DLAST_SGA = (uint32_t) (-(int32_t) sizeof(_rx_buf));
+  EDMA_EnableChannelInterrupts(DMA0, UART_DMA_RX_CHANNEL, kEDMA_MajorInterruptEnable);
+  EDMA_EnableChannelRequest(DMA0, UART_DMA_RX_CHANNEL);
+
+  EDMA_ResetChannel(DMA0, UART_DMA_TX_CHANNEL);
+
+  LPUART_EnableRxDMA(UART_DEV, true);
+  LPUART_EnableTxDMA(UART_DEV, true);
+  LPUART_EnableInterrupts(UART_DEV, kLPUART_IdleLineInterruptEnable);
+
+  NVIC_EnableIRQ(UART_DMA_RX_IRQn);
+  NVIC_EnableIRQ(UART_IRQn);
+
+  _stats_ms = millis();
+}
+
+void uart_bridge_task(void)
+{
+  //------------- UART -> USB -------------//
+  uint32_t count = rx_available();
+
+  if ( count && !_rx_pending )
+  {
+    _rx_pending = true;
+    _rx_pending_ms = millis();
+  }
+
+  while ( count )
+  {
+    uint32_t const offset = _rx_rd & (UART_BRIDGE_RX_SIZE - 1);
+    uint32_t const n = tu_min32(tu_min32(count, UART_BRIDGE_RX_SIZE - offset), tud_cdc_write_available());
+    if ( !n ) break;
+
+    // tinyusb sends full packets by itself
+    tud_cdc_write(_rx_buf + offset, n);
+
+    _rx_rd += n;
+    count -= n;
+    _stats.rx_bytes += n;
+  }
+
+  // partial packet: flush when line goes idle
+  if ( _rx_pending && !count && (_rx_idle || (millis() - _rx_pending_ms >= RX_FLUSH_MS)) )
+  {
+    tud_cdc_write_flush();
+
+    uint32_t const latency = millis() - _rx_pending_ms;
+    if ( latency > _stats.rx_latency_max ) _stats.rx_latency_max = latency;
+
+    _rx_pending = false;
+    _rx_idle = false;
+  }
+
+  //------------- USB -> UART -------------//
+  if ( _tx_count < UART_BRIDGE_TX_SIZE && tud_cdc_available() )
+  {
+    uint32_t const n = tud_cdc_read(_tx_buf[_tx_idx] + _tx_count, UART_BRIDGE_TX_SIZE - _tx_count);
+    _tx_count += n;
+    _stats.tx_bytes += n;
+  }
+
+  if ( _tx_count && !tx_busy() ) tx_kick();
+
+  board_led_write((_rx_pending || _tx_active) ? 0xff : 0);
+
+  //------------- Statistics -------------//
+  if ( millis() - _stats_ms >= 1000 )
+  {
+    _stats.rx_bps = _stats.rx_bytes - _stats_rx;
+    _stats.tx_bps = _stats.tx_bytes - _stats_tx;
+
+    _stats_rx = _stats.rx_bytes;
+    _stats_tx = _stats.tx_bytes;
+    _stats_ms += 1000;
+  }
+}
+
+void uart_bridge_set_baudrate(uint32_t baud)
+{
+  // data queued so far still goes out with old baud rate
+  while ( tx_busy() ) {}
+  if ( _tx_count ) tx_kick();
+  while ( tx_busy() ) {}
+  while ( !(LPUART_GetStatusFlags(UART_DEV) & kLPUART_TransmissionCompleteFlag) ) {}
+
+  LPUART_SetBaudRate(UART_DEV, baud, uart_clock_freq());
+
+  // received data around the switch is garbage
+  _rx_rd = rx_written();
+}
+
+int uart_bridge_read(uint8_t* buf, int len)
+{
+  uint32_t const count = tu_min32(rx_available(), (uint32_t) len);
+
+  for ( uint32_t i = 0; i < count; i++ )
+  {
+    buf[i] = _rx_buf[(_rx_rd + i) & (UART_BRIDGE_RX_SIZE - 1)];
+  }
+  _rx_rd += count;
+
+  return (int) count;
+}
+
+int uart_bridge_write(void const* buf, int len)
+{
+  uint8_t const* data = (uint8_t const*) buf;
+  uint32_t remain = (uint32_t) len;
+
+  while ( remain )
+  {
+    uint32_t const n = tu_min32(remain, UART_BRIDGE_TX_SIZE - _tx_count);
+    memcpy(_tx_buf[_tx_idx] + _tx_count, data, n);
+    _tx_count += n;
+    data += n;
+    remain -= n;
+
+    // other buffer must be done before this one can go
+    while ( tx_busy() ) {}
+    tx_kick();
+  }
+
+  return len;
+}
+
+uart_bridge_stats_t const* uart_bridge_stats(void)
+{
+  return &_stats;
+}
+
+//--------------------------------------------------------------------+
+// Interrupt
+//--------------------------------------------------------------------+
+
+void UART_IRQHandler(void)
+{
+  uint32_t const flags = LPUART_GetStatusFlags(UART_DEV);
+
+  if ( flags & kLPUART_IdleLineFlag ) _rx_idle = true;
+
+  // overrun stops receiver until cleared
+  LPUART_ClearStatusFlags(UART_DEV, flags & (kLPUART_IdleLineFlag | kLPUART_RxOverrunFlag));
+  __DSB();
+}
+
+void UART_DMA_RX_IRQHandler(void)
+{
+  EDMA_ClearChannelStatusFlags(DMA0, UART_DMA_RX_CHANNEL, kEDMA_InterruptFlag);
+  _rx_wraps++;
+  __DSB();
+}
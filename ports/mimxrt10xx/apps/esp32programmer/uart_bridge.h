@@ -0,0 +1,74 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020 Ha Thach (tinyusb.org) for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef UART_BRIDGE_H_
+#define UART_BRIDGE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// USB CDC <-> LPUART bridge with eDMA in both directions:
+// - RX: DMA runs continuously into a circular buffer, data is forwarded to CDC as soon as
+//   a full USB packet is available or the line goes idle (LPUART idle-line interrupt)
+// - TX: CDC RX FIFO is drained into ping-pong buffers, each sent with one DMA transfer
+
+// Size of RX circular buffer, must be power of 2
+#ifndef UART_BRIDGE_RX_SIZE
+#define UART_BRIDGE_RX_SIZE   4096
+#endif
+
+// Size of each of the two TX buffers
+#ifndef UART_BRIDGE_TX_SIZE
+#define UART_BRIDGE_TX_SIZE   512
+#endif
+
+typedef struct
+{
+  uint32_t rx_bytes;        // UART -> USB total
+  uint32_t tx_bytes;        // USB -> UART total
+  uint32_t rx_bps;          // bytes per second, measured over last second
+  uint32_t tx_bps;
+  uint32_t rx_overflow;     // bytes lost since USB did not keep up with UART
+  uint32_t rx_level_max;    // highest RX buffer level
+  uint32_t rx_latency_max;  // longest time in ms received data waited before CDC flush
+} uart_bridge_stats_t;
+
+// Start DMA, call after board_uart_init()
+void uart_bridge_init(void);
+
+// Move data between CDC and UART, run in main loop
+void uart_bridge_task(void);
+
+// Change baud rate once pending TX data is sent, RX data received so far is dropped
+void uart_bridge_set_baudrate(uint32_t baud);
+
+// Raw UART access for other users (e.g ESP32 ROM loader) while bridge task is not running
+int uart_bridge_read(uint8_t* buf, int len);
+int uart_bridge_write(void const* buf, int len);
+
+// Throughput/latency counters, e.g to inspect with a debugger
+uart_bridge_stats_t const* uart_bridge_stats(void);
+
+#endif
@@ -24,16 +24,27 @@
 
 #include "board_api.h"
 #include "romapi_flash.h"
-
-#define FLASH_CACHE_SIZE          4096
-#define FLASH_CACHE_INVALID_ADDR  0xffffffff
+#include "sfdp.h"
 
 // FLASH
 #define NO_CACHE        0xffffffff
 
 #define SECTOR_SIZE     (4*1024)
+#define BLOCK_SIZE      (64*1024)
 #define FLASH_PAGE_SIZE 256
 
+// Write cache covers a whole 64KB erase block if there is enough OCRAM for it (RT104x and later)
+#ifndef BOARD_FLASH_CACHE_SIZE
+  #if defined(MIMXRT1011_SERIES) || defined(MIMXRT1015_SERIES) || defined(MIMXRT1021_SERIES) || defined(MIMXRT1024_SERIES)
+    #define BOARD_FLASH_CACHE_SIZE  SECTOR_SIZE
+  #else
+    #define BOARD_FLASH_CACHE_SIZE  BLOCK_SIZE
+  #endif
+#endif
+
+// Block erase is about as long as 3-4 sector erases (e.g W25Q 150 ms vs 45 ms typical)
+#define BLOCK_ERASE_MIN_SECTORS  4
+
 // on-board flash is connected to FLEXSPI2 on rt1064
 #if defined(MIMXRT1064_SERIES)
   #define FLEXSPI_INSTANCE    1
@@ -58,7 +69,60 @@ extern flexspi_nor_config_t const qspiflash_config;
 static flexspi_nor_config_t* flash_cfg = (flexspi_nor_config_t*)(uintptr_t) &qspiflash_config;
 
 static uint32_t _flash_page_addr = NO_CACHE;
-static uint8_t  _flash_cache[SECTOR_SIZE] __attribute__((aligned(4)));
+// in OCRAM (see .ocram_bss in linker script) to keep DTCM for stack and USB buffers
+static uint8_t  _flash_cache[BOARD_FLASH_CACHE_SIZE] __attribute__((section(".ocram_bss"), aligned(4)));
+
+// Geometry discovered from SFDP, size is 0 if the flash has no valid table.
+// Only size and the 64KB erase type are used: read/program LUT, page and sector size
+// come from the board's FlexSPI configuration block that the ROM also boots with.
+static sfdp_flash_t _sfdp;
+
+static bool sfdp_read(uint32_t addr, void* buffer, uint32_t len)
+{
+  return ROM_FLEXSPI_NorFlash_ReadSFDP(FLEXSPI_INSTANCE, addr, buffer, len) == kStatus_Success;
+}
+
+static bool is_blank(uint32_t addr, uint32_t len)
+{
+  uint32_t const* flash_word = (uint32_t const*) addr;
+
+  for ( uint32_t i = 0; i < len / 4; i++ )
+  {
+    if ( flash_word[i] != 0xFFFFFFFFUL ) return false;
+  }
+
+  return true;
+}
+
+// Check if flash can be turned into data by programming only: every page that differs is still blank.
+// Programming a page twice is not supported by all NOR flashes (e.g with ECC), those sectors are erased.
+static bool is_programmable(uint32_t addr, uint8_t const* data, uint32_t len)
+{
+  for ( uint32_t offset = 0; offset < len; offset += FLASH_PAGE_SIZE )
+  {
+    if ( memcmp((void const*) (addr + offset), data + offset, FLASH_PAGE_SIZE) == 0 ) continue;
+    if ( !is_blank(addr + offset, FLASH_PAGE_SIZE) ) return false;
+  }
+
+  return true;
+}
+
+// Erase sector or block, ROM uses block erase for block aligned range
+static bool flash_erase(uint32_t addr, uint32_t len)
+{
+  status_t const status = ROM_FLEXSPI_NorFlash_Erase(FLEXSPI_INSTANCE, flash_cfg, addr - FLEXSPI_FLASH_BASE, len);
+
+  // drop stale contents so that pages are compared against erased flash
+  SCB_InvalidateDCache_by_Addr((uint32_t *) addr, len);
+
+  if ( status != kStatus_Success )
+  {
+    TUF2_LOG1("Erase failed: status = %ld!\r\n", status);
+    return false;
+  }
+
+  return true;
+}
 
 // compare and write tinyuf2 to flash every time it is running
 #define COMPARE_AND_WRITE_TINYUF2   0
@@ -103,6 +167,16 @@ void board_flash_init(void)
 {
   ROM_FLEXSPI_NorFlash_Init(FLEXSPI_INSTANCE, flash_cfg);
 
+  if ( sfdp_parse(sfdp_read, &_sfdp) )
+  {
+    TUF2_LOG1("SFDP: size = %lu, page = %lu, 64K erase = %u\r\n", _sfdp.size, _sfdp.page_size,
+              sfdp_find_erase(&_sfdp, BLOCK_SIZE) != NULL);
+  }
+  else
+  {
+    _sfdp.size = 0;
+  }
+
   // TinyUF2 will copy its image to flash if one of conditions meets:
   // - Boot Mode is '01' i.e Serial Download Mode (BootRom)
   // - Flash FCFB is invalid e.g blank flash
@@ -122,7 +196,11 @@ void board_flash_init(void)
 uint32_t board_flash_size(void)
 {
   // TODO currently limit at 8MB since the CURRENT.UF2 can occupies all 32MB virtual disk
-  uint32_t const max_size = 8*1024*1024;
+  uint32_t max_size = 8*1024*1024;
+
+  // smaller parts than configured for the board are reported by SFDP
+  if ( _sfdp.size && _sfdp.size < max_size ) max_size = _sfdp.size;
+
   return (BOARD_FLASH_SIZE < max_size) ? BOARD_FLASH_SIZE : max_size;
 }
 
@@ -134,70 +212,100 @@ void board_flash_read(uint32_t addr, void* buffer, uint32_t len)
   memcpy(buffer, (uint8_t*) addr, len);
 }
 
-void board_flash_flush(void)
+// Write cache contents to its page in flash
+static bool cache_write(void)
 {
-  status_t status;
-
-  if ( _flash_page_addr == NO_CACHE ) return;
-
-  TUF2_LOG1("Erase and Write at address = 0x%08lX\r\n",_flash_page_addr);
-
   // Skip if data is the same
-  if ( memcmp(_flash_cache, (void*) _flash_page_addr, SECTOR_SIZE) != 0 )
+  if ( memcmp(_flash_cache, (void*) _flash_page_addr, BOARD_FLASH_CACHE_SIZE) != 0 )
   {
-    uint32_t const sector_addr = (_flash_page_addr - FLEXSPI_FLASH_BASE);
+    TUF2_LOG1("Erase and Write at address = 0x%08lX\r\n",_flash_page_addr);
 
-    __disable_irq();
-    status = ROM_FLEXSPI_NorFlash_Erase(FLEXSPI_INSTANCE, flash_cfg, sector_addr, SECTOR_SIZE);
-    __enable_irq();
+    // Interrupts are left enabled: TinyUF2 including vector table and USB driver runs from RAM,
+    // and no interrupt handler accesses FlexSPI memory while it is busy with IP commands.
+    uint32_t erase_count = 0;
+    for ( uint32_t offset = 0; offset < BOARD_FLASH_CACHE_SIZE; offset += SECTOR_SIZE )
+    {
+      if ( !is_programmable(_flash_page_addr + offset, _flash_cache + offset, SECTOR_SIZE) ) erase_count++;
+    }
 
-    SCB_InvalidateDCache_by_Addr((uint32_t *)sector_addr, SECTOR_SIZE);
+    // block erase unless SFDP says the part does not have one
+    bool const has_block_erase = (_sfdp.size == 0) || (sfdp_find_erase(&_sfdp, BLOCK_SIZE) != NULL);
 
-    if ( status != kStatus_Success )
+    if ( BOARD_FLASH_CACHE_SIZE == BLOCK_SIZE && has_block_erase && erase_count >= BLOCK_ERASE_MIN_SECTORS )
     {
-      TUF2_LOG1("Erase failed: status = %ld!\r\n", status);
-      return;
+      if ( !flash_erase(_flash_page_addr, BLOCK_SIZE) ) return false;
+    }
+    else if ( erase_count )
+    {
+      for ( uint32_t offset = 0; offset < BOARD_FLASH_CACHE_SIZE; offset += SECTOR_SIZE )
+      {
+        uint32_t const sector_addr = _flash_page_addr + offset;
+        if ( !is_programmable(sector_addr, _flash_cache + offset, SECTOR_SIZE) )
+        {
+          if ( !flash_erase(sector_addr, SECTOR_SIZE) ) return false;
+        }
+      }
     }
 
-    for ( int i = 0; i < SECTOR_SIZE / FLASH_PAGE_SIZE; ++i )
+    // Program pages back to back, pages already matching (e.g blank) are skipped.
+    // All other pages are blank: found blank by is_programmable() or just erased
+    for ( uint32_t offset = 0; offset < BOARD_FLASH_CACHE_SIZE; offset += FLASH_PAGE_SIZE )
     {
-      uint32_t const page_addr = sector_addr + i * FLASH_PAGE_SIZE;
-      void* page_data =  _flash_cache + i * FLASH_PAGE_SIZE;
+      uint32_t const page_addr = _flash_page_addr + offset;
+      void* page_data = _flash_cache + offset;
 
-      __disable_irq();
-      status = ROM_FLEXSPI_NorFlash_ProgramPage(FLEXSPI_INSTANCE, flash_cfg, page_addr, (uint32_t*) page_data);
-      __enable_irq();
+      if ( memcmp((void const*) page_addr, page_data, FLASH_PAGE_SIZE) == 0 ) continue;
 
+      status_t const status = ROM_FLEXSPI_NorFlash_ProgramPage(FLEXSPI_INSTANCE, flash_cfg, page_addr - FLEXSPI_FLASH_BASE, (uint32_t*) page_data);
       if ( status != kStatus_Success )
       {
         TUF2_LOG1("Page program failed: status = %ld!\r\n", status);
-        return;
+        SCB_InvalidateDCache_by_Addr((uint32_t *) _flash_page_addr, BOARD_FLASH_CACHE_SIZE);
+        return false;
       }
     }
 
-    SCB_InvalidateDCache_by_Addr((uint32_t *)sector_addr, SECTOR_SIZE);
+    SCB_InvalidateDCache_by_Addr((uint32_t *) _flash_page_addr, BOARD_FLASH_CACHE_SIZE);
   }
 
+  return true;
+}
+
+bool board_flash_flush(void)
+{
+  if ( _flash_page_addr == NO_CACHE ) return true;
+
+  // cache is dropped even if writing failed, failure is reported to caller
+  bool const ret = cache_write();
   _flash_page_addr = NO_CACHE;
+
+  return ret;
 }
 
 bool board_flash_write (uint32_t addr, void const *src, uint32_t len)
 {
-  uint32_t const page_addr = addr & ~(SECTOR_SIZE - 1);
+  // RAM run image is loaded as is
+  if ( board_ram_run_range(addr, len) )
+  {
+    memcpy((void*) addr, src, len);
+    return true;
+  }
+
+  uint32_t const page_addr = addr & ~(BOARD_FLASH_CACHE_SIZE - 1);
 
   if ( page_addr != _flash_page_addr )
   {
     // Write out anything in cache before overwriting it.
-    board_flash_flush();
+    if ( !board_flash_flush() ) return false;
 
     _flash_page_addr = page_addr;
 
     // Copy the current contents of the entire page into the cache.
-    memcpy(_flash_cache, (void*) page_addr, SECTOR_SIZE);
+    memcpy(_flash_cache, (void*) page_addr, BOARD_FLASH_CACHE_SIZE);
   }
 
   // Overwrite part or all of the page cache with the src data.
-  memcpy(_flash_cache + (addr & (SECTOR_SIZE - 1)), src, len);
+  memcpy(_flash_cache + (addr & (BOARD_FLASH_CACHE_SIZE - 1)), src, len);
 
   return true;
 }
@@ -200,6 +200,38 @@ void board_dfu_complete(void)
   NVIC_SystemReset();
 }
 
+board_reset_cause_t board_reset_cause(void)
+{
+  board_reset_cause_t cause = BOARD_RESET_UNKNOWN;
+  uint32_t const srsr = SRC->SRSR;
+
+  uint32_t wdog_mask = SRC_SRSR_WDOG_RST_B_MASK;
+#ifdef SRC_SRSR_WDOG3_RST_B_MASK
+  wdog_mask |= SRC_SRSR_WDOG3_RST_B_MASK;
+#endif
+
+  // POR_B is shared by power-on and the reset button (IPP_RESET_B) on most boards, treat it as pin reset
+  if ( srsr & wdog_mask )
+  {
+    cause = BOARD_RESET_WATCHDOG;
+  }
+  else if ( srsr & SRC_SRSR_LOCKUP_SYSRESETREQ_MASK )
+  {
+    cause = BOARD_RESET_SOFTWARE;
+  }
+  else if ( srsr & SRC_SRSR_IPP_RESET_B_MASK )
+  {
+    cause = BOARD_RESET_PIN;
+  }
+
+  TINYUF2_RESET_FLAGS_REG = srsr;
+
+  // write 1 to clear
+  SRC->SRSR = srsr;
+
+  return cause;
+}
+
 bool board_app_valid(void)
 {
   volatile uint32_t const * app_vector = (volatile uint32_t const*) BOARD_FLASH_APP_START;
@@ -214,7 +246,7 @@ bool board_app_valid(void)
   return true;
 }
 
-void board_app_jump(void)
+static void app_jump(uint32_t app_start)
 {
   // Create the function call to the user application.
   // Static variables are needed since changed the stack pointer out from under the compiler
@@ -222,14 +254,14 @@ void board_app_jump(void)
   static uint32_t stack_pointer;
   static uint32_t app_entry;
 
-  uint32_t const * app_vector = (uint32_t const*) BOARD_FLASH_APP_START;
+  uint32_t const * app_vector = (uint32_t const*) app_start;
   stack_pointer = app_vector[0];
   app_entry = app_vector[1];
 
   // TODO protect bootloader region
 
   /* switch exception handlers to the application */
-  SCB->VTOR = (uint32_t) BOARD_FLASH_APP_START;
+  SCB->VTOR = app_start;
 
   // Set stack pointer
   __set_MSP(stack_pointer);
@@ -239,6 +271,45 @@ void board_app_jump(void)
   asm("bx %0" ::"r"(app_entry));
 }
 
+void board_app_jump(void)
+{
+  app_jump(BOARD_FLASH_APP_START);
+}
+
+//--------------------------------------------------------------------+
+// RAM run
+//--------------------------------------------------------------------+
+
+// symbols defined in linker script: OCRAM after the part used by bootrom and tinyuf2 (.ocram_bss)
+extern uint32_t _ram_run_start[];
+extern uint32_t _ram_run_end[];
+
+#define RAM_RUN_START   ((uint32_t) _ram_run_start)
+#define RAM_RUN_END     ((uint32_t) _ram_run_end)
+
+bool board_ram_run_range(uint32_t addr, uint32_t len)
+{
+  return (addr >= RAM_RUN_START) && (addr + len <= RAM_RUN_END);
+}
+
+void board_ram_run(uint32_t addr)
+{
+  board_timer_stop();
+
+  // No interrupt (e.g USB) must fire before the application sets up its own handlers
+  for (uint32_t i = 0; i < sizeof(NVIC->ICER) / sizeof(NVIC->ICER[0]); i++)
+  {
+    NVIC->ICER[i] = 0xFFFFFFFFu;
+    NVIC->ICPR[i] = 0xFFFFFFFFu;
+  }
+
+  // image was written through DCache
+  SCB_CleanDCache();
+  SCB_InvalidateICache();
+
+  app_jump(addr);
+}
+
 //--------------------------------------------------------------------+
 // Timer
 //--------------------------------------------------------------------+
@@ -411,7 +482,7 @@ int board_uart_read(uint8_t* buf, int len)
       break;
     }
 
-    for(int i=0; i<rx_count; i++)
+    for(int i=0; i<rx_count && count<len; i++)
     {
       buf[count] = LPUART_ReadByte(UART_DEV);
       count++;
@@ -439,6 +510,144 @@ int board_uart_read(uint8_t* buf, int len) {
 #endif
 
 
+//--------------------------------------------------------------------+
+// SD Card
+//--------------------------------------------------------------------+
+
+#if TINYUF2_SD_UPDATE
+#include "fsl_lpspi.h"
+#include "fsl_sdspi.h"
+
+static bool _sd_cs_forced = false;
+
+static void sdhost_init(void)
+{
+  GPIO_PinWrite(SD_CS_PORT, SD_CS_PIN, 1);
+}
+
+static void sdhost_deinit(void)
+{
+  LPSPI_Deinit(SD_SPI);
+}
+
+static void sdhost_cs_polarity(sdspi_cs_active_polarity_t polarity)
+{
+  // high: keep card deselected while clocking init sequence
+  _sd_cs_forced = (polarity == kSDSPI_CsActivePolarityHigh);
+  GPIO_PinWrite(SD_CS_PORT, SD_CS_PIN, _sd_cs_forced ? 1 : 0);
+}
+
+static status_t sdhost_set_frequency(uint32_t frequency)
+{
+  lpspi_master_config_t config;
+  LPSPI_MasterGetDefaultConfig(&config);
+
+  uint32_t const ns_delay = (1000000000U / frequency) * 2;
+  config.baudRate = frequency;
+  config.pcsToSckDelayInNanoSec = ns_delay;
+  config.lastSckToPcsDelayInNanoSec = ns_delay;
+  config.betweenTransferDelayInNanoSec = ns_delay;
+  config.dataOutConfig = kLpspiDataOutRetained;
+
+  LPSPI_Deinit(SD_SPI);
+  LPSPI_MasterInit(SD_SPI, &config, SD_SPI_CLOCK_FREQ);
+
+  return kStatus_Success;
+}
+
+static status_t sdhost_exchange(uint8_t* out, uint8_t* in, uint32_t size)
+{
+  lpspi_transfer_t xfer =
+  {
+    .txData = out,
+    .rxData = in,
+    .dataSize = size,
+    .configFlags = kLPSPI_MasterPcsContinuous,
+  };
+
+  status_t status;
+
+  if ( !_sd_cs_forced ) GPIO_PinWrite(SD_CS_PORT, SD_CS_PIN, 0);
+
+  do
+  {
+    status = LPSPI_MasterTransferBlocking(SD_SPI, &xfer);
+  } while ( status == kStatus_LPSPI_Busy );
+
+  if ( !_sd_cs_forced ) GPIO_PinWrite(SD_CS_PORT, SD_CS_PIN, 1);
+
+  return status;
+}
+
+static sdspi_host_t _sd_host =
+{
+  .busBaudRate      = SD_SPI_MAX_FREQ,
+  .setFrequency     = sdhost_set_frequency,
+  .exchange         = sdhost_exchange,
+  .init             = sdhost_init,
+  .deinit           = sdhost_deinit,
+  .csActivePolarity = sdhost_cs_polarity,
+};
+
+static sdspi_card_t _sd_card;
+
+bool board_sd_init(void)
+{
+  gpio_pin_config_t cs_config = { kGPIO_DigitalOutput, 1, kGPIO_NoIntmode };
+  IOMUXC_SetPinMux(SD_CS_PINMUX, 0);
+  IOMUXC_SetPinConfig(SD_CS_PINMUX, 0x10B0U);
+  GPIO_PinInit(SD_CS_PORT, SD_CS_PIN, &cs_config);
+
+  // with pull-up
+  gpio_pin_config_t detect_config = { kGPIO_DigitalInput, 0, kGPIO_NoIntmode };
+  IOMUXC_SetPinMux(SD_DETECT_PINMUX, 0);
+  IOMUXC_SetPinConfig(SD_DETECT_PINMUX, 0xB0B0U);
+  GPIO_PinInit(SD_DETECT_PORT, SD_DETECT_PIN, &detect_config);
+
+  if ( !GPIO_PinRead(SD_DETECT_PORT, SD_DETECT_PIN) ) return false;
+
+  IOMUXC_SetPinMux(SD_SPI_SDI_PINMUX, 0U);
+  IOMUXC_SetPinMux(SD_SPI_SDO_PINMUX, 0U);
+  IOMUXC_SetPinMux(SD_SPI_SCK_PINMUX, 0U);
+
+  IOMUXC_SetPinConfig(SD_SPI_SDI_PINMUX, 0x10A0U);
+  IOMUXC_SetPinConfig(SD_SPI_SDO_PINMUX, 0x10A0U);
+  IOMUXC_SetPinConfig(SD_SPI_SCK_PINMUX, 0x10A0U);
+
+  // SDSPI_Deinit() clears card struct including host
+  _sd_card.host = &_sd_host;
+
+  if ( kStatus_Success != SDSPI_Init(&_sd_card) )
+  {
+    TUF2_LOG1("SD: init failed\r\n");
+    SDSPI_Deinit(&_sd_card);
+    return false;
+  }
+
+  TUF2_LOG1("SD: %lu blocks\r\n", _sd_card.blockCount);
+  return true;
+}
+
+void board_sd_deinit(void)
+{
+  SDSPI_Deinit(&_sd_card);
+  GPIO_PinWrite(SD_CS_PORT, SD_CS_PIN, 1);
+}
+
+uint32_t board_sd_block_count(void)
+{
+  return _sd_card.blockCount;
+}
+
+bool board_sd_read(uint32_t block, void* buffer, uint32_t count)
+{
+  // multi-block read (CMD18) when count > 1
+  return kStatus_Success == SDSPI_ReadBlocks(&_sd_card, (uint8_t*) buffer, block, count);
+}
+
+#endif
+
+
 //--------------------------------------------------------------------+
 // USB Interrupt Handler
 //--------------------------------------------------------------------+
@@ -60,6 +60,12 @@ extern uint32_t _board_boot_length[];
 #define TINYUF2_DBL_TAP_DFU     1
 #define TINYUF2_DBL_TAP_REG     SNVS->LPGPR[3]
 
+// Reset flags (SRC_SRSR) saved by board_reset_cause() before they are cleared
+#define TINYUF2_RESET_FLAGS_REG SNVS->LPGPR[2]
+
+// Application check verdict, kept across warm reset (boards with TINYUF2_APP_CHECK)
+#define TINYUF2_APP_CHECK_REG   SNVS->LPGPR[1]
+
 // Brightness percentage from 1 to 255
 #ifndef NEOPIXEL_BRIGHTNESS
 #define NEOPIXEL_BRIGHTNESS     0x10
@@ -4,6 +4,9 @@ set(JLINK_DEVICE MIMXRT1011DAE5A)
 set(PYOCD_TARGET mimxrt1010)
 set(NXPLINK_DEVICE MIMXRT1011xxxxx:EVK-MIMXRT1010)
 
+# Update application from firmware.uf2/.bin on SD card at boot
+set(TINYUF2_SD_UPDATE 1)
+
 function(update_board TARGET)
   target_sources(${TARGET} PRIVATE
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/clock_config.c
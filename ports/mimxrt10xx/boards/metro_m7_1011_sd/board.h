@@ -31,6 +31,13 @@
 // Size of on-board external flash
 #define BOARD_FLASH_SIZE     (8*1024*1024)
 
+// Last 4KB sector records firmware file applied from SD card, application must not use it
+#define BOARD_FLASH_SD_UPDATE_ADDR  (FlexSPI_AMBA_BASE + BOARD_FLASH_SIZE - 4096)
+
+// Sector below it holds CRC descriptor of application, checked at boot (see app_check.h)
+#define TINYUF2_APP_CHECK           1
+#define BOARD_FLASH_APP_CHECK_ADDR  (FlexSPI_AMBA_BASE + BOARD_FLASH_SIZE - 8192)
+
 //--------------------------------------------------------------------+
 // LED
 //--------------------------------------------------------------------+
@@ -77,5 +84,25 @@
 #define UART_RX_PINMUX        IOMUXC_GPIO_09_LPUART1_RXD
 #define UART_TX_PINMUX        IOMUXC_GPIO_10_LPUART1_TXD
 
+//--------------------------------------------------------------------+
+// SD Card (offline update, see TINYUF2_SD_UPDATE in board.mk)
+//--------------------------------------------------------------------+
+
+#define SD_SPI                LPSPI1
+#define SD_SPI_CLOCK_FREQ     105600000UL
+#define SD_SPI_MAX_FREQ       25000000UL
+#define SD_SPI_SCK_PINMUX     IOMUXC_GPIO_AD_06_LPSPI1_SCK
+#define SD_SPI_SDO_PINMUX     IOMUXC_GPIO_AD_04_LPSPI1_SDO
+#define SD_SPI_SDI_PINMUX     IOMUXC_GPIO_AD_03_LPSPI1_SDI
+
+#define SD_CS_PINMUX          IOMUXC_GPIO_AD_14_GPIOMUX_IO28
+#define SD_CS_PORT            GPIO1
+#define SD_CS_PIN             28
+
+// high when card is inserted
+#define SD_DETECT_PINMUX      IOMUXC_GPIO_AD_11_GPIOMUX_IO25
+#define SD_DETECT_PORT        GPIO1
+#define SD_DETECT_PIN         25
+
 
 #endif /* BOARD_H_ */
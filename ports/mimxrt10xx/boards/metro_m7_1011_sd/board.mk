@@ -1,6 +1,9 @@
 MCU = MIMXRT1011
 CFLAGS += -DCPU_MIMXRT1011DAE5A
 
+# Update application from firmware.uf2/.bin on SD card at boot
+TINYUF2_SD_UPDATE = 1
+
 # For flash-jlink target
 JLINK_DEVICE = MIMXRT1011DAE5A
 
@@ -61,6 +61,17 @@ ifndef BUILD_NO_TINYUSB
 SRC_C += lib/tinyusb/src/portable/chipidea/ci_hs/dcd_ci_hs.c
 endif
 
+# SD card over SPI for offline update, driver is shared with factory_test_metro_sd
+ifeq ($(TINYUF2_SD_UPDATE),1)
+ifndef BUILD_APPLICATION
+SDMMC_DIR = $(PORT_DIR)/apps/factory_test_metro_sd/middleware-sdmmc
+SRC_C += $(SDMMC_DIR)/sdspi/fsl_sdspi.c
+INC += \
+	$(TOP)/$(SDMMC_DIR)/sdspi \
+	$(TOP)/$(SDMMC_DIR)/common
+endif
+endif
+
 
 # Port include
 INC += \
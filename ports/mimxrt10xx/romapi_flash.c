@@ -24,6 +24,7 @@
  * THE SOFTWARE.
  */
 
+#include <string.h>
 #include "romapi_flash.h"
 
 //--------------------------------------------------------------------+
@@ -175,7 +176,8 @@ status_t ROM_FLEXSPI_NorFlash_Init (uint32_t instance, flexspi_nor_config_t *con
   return status;
 }
 
-status_t ROM_FLEXSPI_NorFlash_EraseSector (uint32_t instance, flexspi_nor_config_t *config, uint32_t address)
+// Erase sector or block depending on LUT sequence
+static status_t nor_flash_erase (uint32_t instance, flexspi_nor_config_t *config, uint32_t address, uint32_t seq_id)
 {
   status_t status;
   flexspi_xfer_t flashXfer;
@@ -194,7 +196,7 @@ status_t ROM_FLEXSPI_NorFlash_EraseSector (uint32_t instance, flexspi_nor_config
     flashXfer.baseAddress = address;
     flashXfer.operation = kFlexSpiOperation_Command;
     flashXfer.seqNum = 1;
-    flashXfer.seqId = NOR_CMD_LUT_SEQ_IDX_ERASESECTOR;
+    flashXfer.seqId = seq_id;
     flashXfer.isParallelModeEnable = isParallelMode;
 
     status = flexspi_command_xfer(instance, &flashXfer);
@@ -217,6 +219,16 @@ status_t ROM_FLEXSPI_NorFlash_EraseSector (uint32_t instance, flexspi_nor_config
   return status;
 }
 
+status_t ROM_FLEXSPI_NorFlash_EraseSector (uint32_t instance, flexspi_nor_config_t *config, uint32_t address)
+{
+  return nor_flash_erase(instance, config, address, NOR_CMD_LUT_SEQ_IDX_ERASESECTOR);
+}
+
+status_t ROM_FLEXSPI_NorFlash_EraseBlock (uint32_t instance, flexspi_nor_config_t *config, uint32_t address)
+{
+  return nor_flash_erase(instance, config, address, NOR_CMD_LUT_SEQ_IDX_ERASEBLOCK);
+}
+
 status_t ROM_FLEXSPI_NorFlash_Erase (uint32_t instance, flexspi_nor_config_t *config, uint32_t start, uint32_t length)
 {
   uint32_t aligned_start;
@@ -236,12 +248,26 @@ status_t ROM_FLEXSPI_NorFlash_Erase (uint32_t instance, flexspi_nor_config_t *co
 
     while ( aligned_start < aligned_end )
     {
-      status = ROM_FLEXSPI_NorFlash_EraseSector(instance, config, aligned_start);
-      if ( status != kStatus_Success )
+      // same as ROM: use block erase for block aligned range
+      if ( config->blockSize && (aligned_start % config->blockSize) == 0 &&
+           (aligned_end - aligned_start) >= config->blockSize )
       {
-        return status;
+        status = ROM_FLEXSPI_NorFlash_EraseBlock(instance, config, aligned_start);
+        if ( status != kStatus_Success )
+        {
+          return status;
+        }
+        aligned_start += config->blockSize;
+      }
+      else
+      {
+        status = ROM_FLEXSPI_NorFlash_EraseSector(instance, config, aligned_start);
+        if ( status != kStatus_Success )
+        {
+          return status;
+        }
+        aligned_start += config->sectorSize;
       }
-      aligned_start += config->sectorSize;
     }
   } while ( 0 );
 
@@ -337,3 +363,72 @@ status_t ROM_FLEXSPI_NorFlash_EraseAll (uint32_t instance, flexspi_nor_config_t
 }
 
 #endif
+
+//--------------------------------------------------------------------+
+// SFDP
+//--------------------------------------------------------------------+
+
+#if defined(FSL_FEATURE_BOOT_ROM_HAS_ROMAPI) && FSL_FEATURE_BOOT_ROM_HAS_ROMAPI
+  #define SFDP_UPDATE_LUT       ROM_FLEXSPI_NorFlash_UpdateLut
+  #define SFDP_COMMAND_XFER     ROM_FLEXSPI_NorFlash_CommandXfer
+  #define SFDP_OPERATION_READ   kFLEXSPIOperation_Read
+#else
+  #define SFDP_UPDATE_LUT       flexspi_update_lut
+  #define SFDP_COMMAND_XFER     flexspi_command_xfer
+  #define SFDP_OPERATION_READ   kFlexSpiOperation_Read
+#endif
+
+#ifndef NOR_CMD_LUT_SEQ_IDX_READ_SFDP
+#define NOR_CMD_LUT_SEQ_IDX_READ_SFDP   13
+#endif
+
+// LUT instruction encoding, same as FLEXSPI_LUT_SEQ() which is not available with fsl_romapi.h
+#define SFDP_LUT_INSTR(opcode, pads, operand)   ( ((uint32_t) (opcode) << 10) | ((uint32_t) (pads) << 8) | (operand) )
+#define SFDP_LUT_SEQ(opc0, pads0, opr0, opc1, pads1, opr1) \
+  ( SFDP_LUT_INSTR(opc0, pads0, opr0) | (SFDP_LUT_INSTR(opc1, pads1, opr1) << 16) )
+
+// Read SFDP 5Ah, 1-1-1 with 24-bit address and 8 dummy clocks
+static const uint32_t sfdp_lut[4] =
+{
+  SFDP_LUT_SEQ(0x01 /* CMD_SDR */  , 0, 0x5A, 0x02 /* RADDR_SDR */, 0, 24),
+  SFDP_LUT_SEQ(0x0C /* DUMMY_SDR */, 0, 8   , 0x09 /* READ_SDR */ , 0, 4 ),
+  0, 0
+};
+
+status_t ROM_FLEXSPI_NorFlash_ReadSFDP (uint32_t instance, uint32_t address, void *buffer, uint32_t length)
+{
+  status_t status;
+  flexspi_xfer_t flashXfer;
+  uint32_t chunk[16];
+  uint8_t *dst = (uint8_t *) buffer;
+
+  // Sequence is reserved for SFDP in the configuration block, AHB read sequence is not affected
+  status = SFDP_UPDATE_LUT(instance, NOR_CMD_LUT_SEQ_IDX_READ_SFDP, sfdp_lut, 1);
+  if ( status != kStatus_Success ) return status;
+
+  while ( length )
+  {
+    uint32_t const count = (length < sizeof(chunk)) ? length : sizeof(chunk);
+
+    // transfer in 4-byte granularity into aligned buffer
+    flashXfer.operation = SFDP_OPERATION_READ;
+    flashXfer.baseAddress = address;
+    flashXfer.seqId = NOR_CMD_LUT_SEQ_IDX_READ_SFDP;
+    flashXfer.seqNum = 1;
+    flashXfer.isParallelModeEnable = false;
+    flashXfer.txBuffer = NULL;
+    flashXfer.txSize = 0;
+    flashXfer.rxBuffer = chunk;
+    flashXfer.rxSize = (count + 3) & ~3UL;
+
+    status = SFDP_COMMAND_XFER(instance, &flashXfer);
+    if ( status != kStatus_Success ) return status;
+
+    memcpy(dst, chunk, count);
+    dst += count;
+    address += count;
+    length -= count;
+  }
+
+  return kStatus_Success;
+}
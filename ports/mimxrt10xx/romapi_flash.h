@@ -39,6 +39,9 @@ status_t ROM_FLEXSPI_NorFlash_ProgramPage(uint32_t instance, flexspi_nor_config_
 #endif
 
 
+// Read from SFDP address space using LUT sequence NOR_CMD_LUT_SEQ_IDX_READ_SFDP
+status_t ROM_FLEXSPI_NorFlash_ReadSFDP(uint32_t instance, uint32_t address, void *buffer, uint32_t length);
+
 #if !( defined(FSL_ROM_FLEXSPINOR_API_HAS_FEATURE_ERASE_ALL) && FSL_ROM_FLEXSPINOR_API_HAS_FEATURE_ERASE_ALL )
 status_t ROM_FLEXSPI_NorFlash_EraseAll(uint32_t instance, flexspi_nor_config_t *config);
 #endif
@@ -0,0 +1,321 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "board_api.h"
+#include "stm32_flash.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM
+//--------------------------------------------------------------------+
+
+static stm32_flash_map_t const* _map = NULL;
+
+// Start address and first linear index of each run, _group_addr[_group_count] is end of flash
+static uint32_t _group_addr[STM32_FLASH_GROUP_MAX + 1];
+static uint16_t _group_index[STM32_FLASH_GROUP_MAX];
+static uint8_t  _group_shift[STM32_FLASH_GROUP_MAX];
+static uint8_t  _group_count = 0;
+
+// Sectors that are erased or found blank since init, don't erase them anymore
+static uint32_t _checked[(STM32_FLASH_SECTOR_MAX + 31) / 32];
+
+// Sectors that are actually erased by us since init
+static uint32_t _erased[(STM32_FLASH_SECTOR_MAX + 31) / 32];
+
+// Last resolved sector, consecutive writes mostly land in the same one
+static stm32_flash_sector_t _last_sector;
+
+// Write held back while its sector is erased in background (read-while-write)
+static struct {
+  stm32_flash_sector_t sector;
+  uint32_t addr;
+  uint32_t len;
+  bool     active;
+  bool     failed;  // sticky until init, reported by all following writes
+  uint8_t  data[STM32_FLASH_DEFER_MAX];
+} _deferred;
+
+//--------------------------------------------------------------------+
+// Internal Helper
+//--------------------------------------------------------------------+
+
+static bool is_blank(uint32_t addr, uint32_t size) {
+  for (uint32_t i = 0; i < size; i += sizeof(uint32_t)) {
+    if (*(uint32_t*) (addr + i) != 0xffffffff) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static inline bool bitmap_test(uint32_t const* bitmap, uint16_t index) {
+  return (bitmap[index / 32] >> (index % 32)) & 1u;
+}
+
+static inline void bitmap_set(uint32_t* bitmap, uint16_t index) {
+  bitmap[index / 32] |= (1u << (index % 32));
+}
+
+static bool program_verify(stm32_flash_sector_t const* sector, uint32_t addr, uint8_t const* src, uint32_t len) {
+  TUF2_LOG1("Write flash at address %08lX\r\n", addr);
+  TUF2_ASSERT(_map->program(sector, addr, src, len));
+
+  // verify contents
+  if (memcmp((void const*) addr, src, len) != 0) {
+    TUF2_LOG1("Failed to write\r\n");
+    return false;
+  }
+
+  return true;
+}
+
+// Sector is in the bank we are not running from and the whole write fits in the deferred buffer
+static bool can_defer(stm32_flash_sector_t const* sector, uint32_t addr, uint32_t len) {
+  return _map->erase_start && sector->bank && sector->bank != _map->exec_bank &&
+         len <= STM32_FLASH_DEFER_MAX && (addr - sector->addr) + len <= sector->size;
+}
+
+static bool deferred_finish(void) {
+  if (!_deferred.active) return !_deferred.failed;
+  _deferred.active = false;
+
+  bool const ret = _map->erase_finish(&_deferred.sector) &&
+                   program_verify(&_deferred.sector, _deferred.addr, _deferred.data, _deferred.len);
+  TUF2_LOG1("Erase: %08lX done, held back write %s\r\n", _deferred.sector.addr, ret ? "OK" : "failed");
+
+  if (!ret) _deferred.failed = true;
+  return ret;
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void stm32_flash_init(stm32_flash_map_t const* map) {
+  if (_map) deferred_finish();
+  _deferred.failed = false;
+
+  _map = map;
+  _group_count = 0;
+  memset(_checked, 0, sizeof(_checked));
+  memset(_erased, 0, sizeof(_erased));
+  memset(&_last_sector, 0, sizeof(_last_sector));
+
+  uint32_t const end = map->base + map->size;
+  uint32_t addr = map->base;
+  uint16_t index = 0;
+
+  for (uint8_t g = 0; g < map->group_count && g < STM32_FLASH_GROUP_MAX && addr < end; g++) {
+    stm32_flash_group_t const* group = &map->groups[g];
+
+    _group_addr[g] = addr;
+    _group_index[g] = index;
+    _group_shift[g] = (uint8_t) __builtin_ctz(group->size);
+    _group_count++;
+
+    uint32_t const run_size = group->size * group->count;
+    addr = (end - addr < run_size) ? end : (addr + run_size);
+    index += group->count;
+  }
+
+  _group_addr[_group_count] = addr;
+
+  if (index > STM32_FLASH_SECTOR_MAX) {
+    TUF2_LOG1("Flash map has %u sectors, only %u tracked\r\n", index, STM32_FLASH_SECTOR_MAX);
+  }
+}
+
+bool stm32_flash_find_sector(uint32_t addr, stm32_flash_sector_t* sector) {
+  if (_last_sector.size && (addr - _last_sector.addr) < _last_sector.size) {
+    *sector = _last_sector;
+    return true;
+  }
+
+  if (!_group_count || addr < _group_addr[0] || addr >= _group_addr[_group_count]) {
+    return false;
+  }
+
+  // binary search for the last run starting at or before addr
+  uint8_t lo = 0;
+  uint8_t hi = _group_count - 1;
+  while (lo < hi) {
+    uint8_t const mid = (lo + hi + 1) / 2;
+    if (_group_addr[mid] <= addr) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  stm32_flash_group_t const* group = &_map->groups[lo];
+  uint8_t const shift = _group_shift[lo];
+  uint32_t const offset = (addr - _group_addr[lo]) >> shift;
+
+  sector->addr = _group_addr[lo] + (offset << shift);
+  sector->size = group->size;
+  sector->index = (uint16_t) (_group_index[lo] + offset);
+  sector->number = (uint16_t) (group->first + offset);
+  sector->bank = group->bank;
+  sector->erased = false;
+
+  _last_sector = *sector;
+
+  return true;
+}
+
+bool stm32_flash_write(uint32_t addr, void const* data, uint32_t len) {
+  TUF2_ASSERT(_map);
+
+#ifndef TINYUF2_SELF_UPDATE
+  // skip writing bootloader if not self-update
+  TUF2_ASSERT(addr >= BOARD_FLASH_APP_START);
+#endif
+
+  // flash controller is shared by both banks
+  TUF2_ASSERT(deferred_finish());
+
+  uint8_t const* src = (uint8_t const*) data;
+
+  while (len) {
+    stm32_flash_sector_t sector;
+    TUF2_ASSERT(stm32_flash_find_sector(addr, &sector));
+    TUF2_ASSERT(sector.index < STM32_FLASH_SECTOR_MAX);
+
+    if (!bitmap_test(_checked, sector.index)) {
+      bitmap_set(_checked, sector.index); // don't erase anymore - we will continue writing here!
+
+      if (!is_blank(sector.addr, sector.size)) {
+        if (can_defer(&sector, addr, len)) {
+          // keep running from the other bank, data is written by stm32_flash_busy()/wait() when erase is done
+          TUF2_LOG1("Erase: %08lX size = %lu KB in background\r\n", sector.addr, sector.size / 1024);
+          TUF2_ASSERT(_map->erase_start(&sector));
+          bitmap_set(_erased, sector.index);
+
+          sector.erased = true;
+          _deferred.sector = sector;
+          _deferred.addr = addr;
+          _deferred.len = len;
+          memcpy(_deferred.data, src, len);
+          _deferred.active = true;
+
+          return true;
+        }
+
+        TUF2_LOG1("Erase: %08lX size = %lu KB ... ", sector.addr, sector.size / 1024);
+        TUF2_ASSERT(_map->erase(&sector));
+        bitmap_set(_erased, sector.index);
+        TUF2_LOG1("OK\r\n");
+      }
+    }
+
+    sector.erased = bitmap_test(_erased, sector.index);
+
+    uint32_t const sector_remain = sector.addr + sector.size - addr;
+    uint32_t const count = (len < sector_remain) ? len : sector_remain;
+
+    if (!program_verify(&sector, addr, src, count)) return false;
+
+    addr += count;
+    src += count;
+    len -= count;
+  }
+
+  return true;
+}
+
+bool stm32_flash_busy(void) {
+  if (!_deferred.active) return false;
+  if (_map->busy()) return true;
+
+  deferred_finish();
+  return false;
+}
+
+bool stm32_flash_wait(void) {
+  return deferred_finish();
+}
+
+bool stm32_flash_erase_range(uint32_t addr, uint32_t len) {
+  TUF2_ASSERT(_map);
+  TUF2_ASSERT(deferred_finish());
+
+#ifndef TINYUF2_SELF_UPDATE
+  // skip erasing bootloader if not self-update
+  TUF2_ASSERT(addr >= BOARD_FLASH_APP_START);
+#endif
+
+  uint32_t const end = addr + len;
+
+  // whole banks: runs of the same bank are consecutive
+  if (_map->erase_bank) {
+    for (uint8_t g = 0; g < _group_count; ) {
+      uint8_t const bank = _map->groups[g].bank;
+      uint8_t last = g;
+      while (last + 1 < _group_count && _map->groups[last + 1].bank == bank) last++;
+
+      uint32_t const bank_start = _group_addr[g];
+      uint32_t const bank_end = _group_addr[last + 1];
+
+      if (bank && addr <= bank_start && bank_end <= end && !is_blank(bank_start, bank_end - bank_start)) {
+        TUF2_LOG1("Erase bank %u: %08lX size = %lu KB ... ", bank, bank_start, (bank_end - bank_start) / 1024);
+        TUF2_ASSERT(_map->erase_bank(bank));
+        TUF2_LOG1("OK\r\n");
+
+        uint16_t const index_end = (uint16_t) (_group_index[last] + ((bank_end - _group_addr[last]) >> _group_shift[last]));
+        for (uint16_t i = _group_index[g]; i < index_end && i < STM32_FLASH_SECTOR_MAX; i++) {
+          bitmap_set(_checked, i);
+          bitmap_set(_erased, i);
+        }
+      }
+
+      g = last + 1;
+    }
+  }
+
+  // remaining sectors one by one
+  while (addr < end) {
+    stm32_flash_sector_t sector;
+    TUF2_ASSERT(stm32_flash_find_sector(addr, &sector));
+    TUF2_ASSERT(sector.index < STM32_FLASH_SECTOR_MAX);
+
+    uint32_t const sector_end = sector.addr + sector.size;
+
+    // only sectors entirely in range, banks erased above are found blank
+    if (sector.addr == addr && sector_end <= end) {
+      if (!is_blank(sector.addr, sector.size)) {
+        TUF2_LOG1("Erase: %08lX size = %lu KB ... ", sector.addr, sector.size / 1024);
+        TUF2_ASSERT(_map->erase(&sector));
+        bitmap_set(_erased, sector.index);
+        TUF2_LOG1("OK\r\n");
+      }
+      bitmap_set(_checked, sector.index);
+    }
+
+    addr = sector_end;
+  }
+
+  return true;
+}
@@ -0,0 +1,118 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef STM32_FLASH_H_
+#define STM32_FLASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//--------------------------------------------------------------------+
+// Internal flash sector map shared by STM32 ports
+//
+// Port describes its geometry as runs of equally sized sectors and provides
+// erase/program backends. Address to sector lookup is a binary search over
+// the runs (with the last hit cached), erased state is tracked in a bitmap.
+//--------------------------------------------------------------------+
+
+// Max number of sectors/pages tracked by the erased bitmap
+#ifndef STM32_FLASH_SECTOR_MAX
+#define STM32_FLASH_SECTOR_MAX   512
+#endif
+
+// Max number of sector runs in a map
+#ifndef STM32_FLASH_GROUP_MAX
+#define STM32_FLASH_GROUP_MAX    8
+#endif
+
+// Max bytes held back while their sector is erased in background
+#ifndef STM32_FLASH_DEFER_MAX
+#define STM32_FLASH_DEFER_MAX    256
+#endif
+
+// Run of consecutive sectors with the same size
+typedef struct {
+  uint32_t size;    // sector size in bytes, must be power of 2
+  uint16_t count;   // number of sectors in this run
+  uint16_t first;   // hardware sector/page number of the first sector as used by HAL erase
+  uint8_t  bank;    // bank number (1-based as HAL FLASH_BANK_x), 0 for single bank devices
+} stm32_flash_group_t;
+
+// Sector resolved from an address
+typedef struct {
+  uint32_t addr;
+  uint32_t size;
+  uint16_t index;   // linear index across all banks
+  uint16_t number;  // hardware sector/page number
+  uint8_t  bank;
+  bool     erased;  // erased by us since init (not just found blank), set when passed to program()
+} stm32_flash_sector_t;
+
+typedef struct {
+  uint32_t base;                      // address of the first sector
+  uint32_t size;                      // usable flash size, sectors beyond this are ignored
+  stm32_flash_group_t const* groups;
+  uint8_t  group_count;
+  uint8_t  program_width;             // bytes per program operation
+  uint8_t  exec_bank;                 // bank the running code is fetched from, 0 if it can't read while write
+
+  // erase a single sector
+  bool (*erase)(stm32_flash_sector_t const* sector);
+
+  // erase a whole bank (optional), used by stm32_flash_erase_range() when a bank is fully covered
+  bool (*erase_bank)(uint8_t bank);
+
+  // program len bytes to already erased flash, addr and len are multiple of program_width.
+  // Never cross a sector boundary.
+  bool (*program)(stm32_flash_sector_t const* sector, uint32_t addr, uint8_t const* src, uint32_t len);
+
+  // start erasing a sector without waiting (optional), only used for sectors outside of exec_bank.
+  // busy() and erase_finish() are required along with it.
+  bool (*erase_start)(stm32_flash_sector_t const* sector);
+  bool (*busy)(void);
+  bool (*erase_finish)(stm32_flash_sector_t const* sector);
+} stm32_flash_map_t;
+
+// Set up lookup tables for the map, also forget all erased sectors
+void stm32_flash_init(stm32_flash_map_t const* map);
+
+// Resolve the sector containing addr
+bool stm32_flash_find_sector(uint32_t addr, stm32_flash_sector_t* sector);
+
+// Write data, sectors are erased (if not blank) the first time they are written to.
+// If the sector can be erased in background, data is held back and written once erase is done.
+bool stm32_flash_write(uint32_t addr, void const* data, uint32_t len);
+
+// Check if background erase is still running, write held back data once it is done.
+// If that write fails, stm32_flash_write() and stm32_flash_wait() return false until next init.
+bool stm32_flash_busy(void);
+
+// Wait for background erase and write held back data, return false if it failed
+bool stm32_flash_wait(void);
+
+// Erase all sectors entirely within [addr, addr+len) up front, with bank erase where possible.
+// Partially covered sectors are left to be erased on write.
+bool stm32_flash_erase_range(uint32_t addr, uint32_t len);
+
+#endif
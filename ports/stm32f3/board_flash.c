@@ -23,6 +23,7 @@
  */
 
 #include "board_api.h"
+#include "stm32_flash.h"
 
 #ifndef BUILD_NO_TINYUSB
 #include "tusb.h"
@@ -39,102 +40,92 @@
 #define BOOTLOADER_PAGE_MASK (OB_WRP_PAGES0TO1 | OB_WRP_PAGES2TO3 | OB_WRP_PAGES4TO5 | OB_WRP_PAGES6TO7)
 #endif
 
-enum {
-  SECTOR_COUNT = (BOARD_FLASH_SIZE / BOARD_PAGE_SIZE),
-  BOOTLOADER_SECTOR_COUNT = ((BOARD_FLASH_APP_START - FLASH_BASE_ADDR) / BOARD_PAGE_SIZE)
+static const stm32_flash_group_t _flash_groups[] = {
+  { .size = BOARD_PAGE_SIZE, .count = BOARD_FLASH_SIZE / BOARD_PAGE_SIZE, .first = 0, .bank = 0 }
 };
 
-static uint8_t erased_sectors[SECTOR_COUNT] = {0};
-
 //--------------------------------------------------------------------+
 // Internal Helper
 //--------------------------------------------------------------------+
 
-static inline uint32_t flash_sector_size(uint32_t sector) {
-  (void) sector;
-  return BOARD_PAGE_SIZE;
+// SysTick handler (board_timer_handler) runs from flash and has the lowest priority (SysTick_Config),
+// it is masked with BASEPRI while flash is busy. USB interrupts have higher priority and are still served.
+static inline uint32_t flash_busy_basepri(void) {
+  return NVIC_GetPriority(SysTick_IRQn) << (8U - __NVIC_PRIO_BITS);
 }
 
-static bool is_blank(uint32_t addr, uint32_t size) {
-  for (uint32_t i = 0; i < size; i += sizeof(uint32_t)) {
-    if (*(uint32_t*) (addr + i) != 0xffffffff) {
-      return false;
-    }
-  }
-  return true;
-}
+// Erase page and wait for completion. Runs from RAM so that interrupts (vector table,
+// USB handlers and DCD are also in RAM) are still serviced while flash is busy.
+TINYUF2_RAMFUNC static void flash_erase_page(uint32_t addr, uint32_t basepri) {
+  uint32_t const prev_basepri = __get_BASEPRI();
+  __set_BASEPRI(basepri);
 
-static bool flash_erase_sector(uint32_t addr) {
-#ifndef TINYUF2_SELF_UPDATE
-  // skip erasing bootloader if not self-update
-  TUF2_ASSERT(addr >= BOARD_FLASH_APP_START);
-#endif
+  FLASH->CR |= FLASH_CR_PER;
+  FLASH->AR = addr;
+  FLASH->CR |= FLASH_CR_STRT;
+  while (FLASH->SR & FLASH_SR_BSY) {}
+  FLASH->CR &= ~FLASH_CR_PER;
+
+  __set_BASEPRI(prev_basepri);
+}
 
-  // starting address from 0x08000000
-  uint32_t sector_addr = FLASH_BASE_ADDR;
-  bool erased = false;
-  uint32_t size = 0;
+// Program half words with PG set, from RAM instead of HAL_FLASH_Program() which runs from flash
+TINYUF2_RAMFUNC static void flash_program_halfwords(uint32_t dst, const uint8_t* src, uint32_t len, uint32_t basepri) {
+  uint32_t const prev_basepri = __get_BASEPRI();
+  __set_BASEPRI(basepri);
 
-  for (uint32_t i = 0; i < SECTOR_COUNT; i++) {
-    TUF2_ASSERT(sector_addr < FLASH_BASE_ADDR + BOARD_FLASH_SIZE);
+  FLASH->CR |= FLASH_CR_PG;
 
-    size = flash_sector_size(i);
-    if (sector_addr + size > addr) {
-      erased = erased_sectors[i];
-      erased_sectors[i] = 1;    // don't erase anymore - we will continue writing here!
-      break;
-    }
-    sector_addr += size;
+  for (uint32_t i = 0; i < len; i += 2) {
+    *(__IO uint16_t*) (dst + i) = __UNALIGNED_UINT16_READ(src + i);
+    while (FLASH->SR & FLASH_SR_BSY) {}
   }
 
-  if (!erased && !is_blank(sector_addr, size)) {
-    TUF2_LOG1("Erase: %08lX size = %lu KB ... ", sector_addr, size / 1024);
+  FLASH->CR &= ~FLASH_CR_PG;
 
-    FLASH_EraseInitTypeDef EraseInit;
-    EraseInit.TypeErase = FLASH_TYPEERASE_PAGES;
-    EraseInit.PageAddress = sector_addr;
-    EraseInit.NbPages = 1;
+  __set_BASEPRI(prev_basepri);
+}
 
-    uint32_t SectorError = 0;
-    HAL_FLASHEx_Erase(&EraseInit, &SectorError);
-    FLASH_WaitForLastOperation(HAL_MAX_DELAY);
-    TUF2_ASSERT(SectorError == 0xFFFFFFFF);
+static bool flash_erase(stm32_flash_sector_t const* sector) {
+  // also clear pending errors
+  if (FLASH_WaitForLastOperation(HAL_MAX_DELAY) != HAL_OK) return false;
 
-    TUF2_LOG1("OK\r\n");
-  }
+  flash_erase_page(sector->addr, flash_busy_basepri());
 
-  return true;
+  return FLASH_WaitForLastOperation(HAL_MAX_DELAY) == HAL_OK;
 }
 
-static void flash_write(uint32_t dst, const uint8_t* src, int len) {
-  flash_erase_sector(dst);
+static bool flash_program(stm32_flash_sector_t const* sector, uint32_t dst, const uint8_t* src, uint32_t len) {
+  (void) sector;
 
-  TUF2_LOG1("Write flash at address %08lX\r\n", dst);
-  for (int i = 0; i < len; i += 4) {
-    uint32_t data = *((uint32_t*) ((void*) (src + i)));
+  // also clear pending errors
+  if (FLASH_WaitForLastOperation(HAL_MAX_DELAY) != HAL_OK) return false;
 
-    if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, dst + i, (uint64_t) data) != HAL_OK) {
-      TUF2_LOG1("Failed to write flash at address %08lX\r\n", dst + i);
-      break;
-    }
+  flash_program_halfwords(dst, src, len, flash_busy_basepri());
 
-    if (FLASH_WaitForLastOperation(HAL_MAX_DELAY) != HAL_OK) {
-      TUF2_LOG1("Waiting on last operation failed\r\n");
-      return;
-    }
+  if (FLASH_WaitForLastOperation(HAL_MAX_DELAY) != HAL_OK) {
+    TUF2_LOG1("Failed to write flash at address %08lX\r\n", dst);
+    return false;
   }
 
-  // verify contents
-  if (memcmp((void*) dst, src, len) != 0) {
-    TUF2_LOG1("Failed to write\r\n");
-  }
+  return true;
 }
 
+static const stm32_flash_map_t _flash_map = {
+  .base          = FLASH_BASE_ADDR,
+  .size          = BOARD_FLASH_SIZE,
+  .groups        = _flash_groups,
+  .group_count   = 1,
+  .program_width = 4,
+  .erase         = flash_erase,
+  .program       = flash_program
+};
+
 //--------------------------------------------------------------------+
 // Board API
 //--------------------------------------------------------------------+
 void board_flash_init(void) {
-  // nothing to do
+  stm32_flash_init(&_flash_map);
 }
 
 uint32_t board_flash_size(void) {
@@ -145,24 +136,36 @@ void board_flash_read(uint32_t addr, void* buffer, uint32_t len) {
   memcpy(buffer, (void*) addr, len);
 }
 
-void board_flash_flush(void) {
+bool board_flash_flush(void) {
   // nothing to do
+  return true;
 }
 
 // TODO not working quite yet
 bool board_flash_write(uint32_t addr, void const* data, uint32_t len) {
   // TODO skip matching contents
   HAL_FLASH_Unlock();
-  flash_write(addr, data, len);
+  bool const ret = stm32_flash_write(addr, data, len);
   HAL_FLASH_Lock();
 
-  return true;
+  return ret;
 }
 
 void board_flash_erase_app(void) {
   // TODO implement later
 }
 
+bool board_flash_erase_sector(uint32_t addr) {
+  stm32_flash_sector_t sector;
+  if (!stm32_flash_find_sector(addr, &sector)) return false;
+
+  HAL_FLASH_Unlock();
+  bool const ret = stm32_flash_erase_range(sector.addr, sector.size);
+  HAL_FLASH_Lock();
+
+  return ret;
+}
+
 bool board_flash_protect_bootloader(bool protect) {
   // F3 reset every time Option Bytes is programmed
   // skip protecting bootloader if we just reset by option byte changes
@@ -228,18 +231,9 @@ void board_self_update(const uint8_t* bootloader_bin, uint32_t bootloader_len) {
 
     // keep writing until flash contents matches new bootloader data
     while (memcmp((const void*) FLASH_BASE_ADDR, bootloader_bin, bootloader_len)) {
-      uint32_t sector_addr = FLASH_BASE_ADDR;
-      const uint8_t* data = bootloader_bin;
-      uint32_t len = bootloader_len;
-
-      for (uint32_t i = 0; i < BOOTLOADER_SECTOR_COUNT && len > 0; i++) {
-        uint32_t const size = (flash_sector_size(i) < len ? flash_sector_size(i) : len);
-        board_flash_write(sector_addr, data, size);
-
-        sector_addr += size;
-        data += size;
-        len -= size;
-      }
+      // re-init to erase bootloader pages again
+      board_flash_init();
+      board_flash_write(FLASH_BASE_ADDR, bootloader_bin, bootloader_len);
     }
   }
 
@@ -33,6 +33,10 @@
 // MACRO TYPEDEF CONSTANT ENUM DECLARATION
 //--------------------------------------------------------------------+
 
+// Vector table is copied to RAM in DFU mode, so that USB interrupt is still serviced while flash is busy
+extern uint32_t g_pfnVectors[];
+static uint32_t _ram_vectors[128] __attribute__((aligned(512)));
+
 #define STM32_UUID    ((volatile uint32_t *) UID_BASE)
 
 static UART_HandleTypeDef UartHandle;
@@ -112,6 +116,10 @@ void board_init(void)
 
 void board_dfu_init(void)
 {
+  // serve interrupts from RAM, USB handler and tinyusb DCD are also in RAM (TINYUF2_RAMFUNC)
+  memcpy(_ram_vectors, g_pfnVectors, sizeof(_ram_vectors));
+  SCB->VTOR = (uint32_t) _ram_vectors;
+
   __HAL_RCC_SYSCFG_CLK_ENABLE();
   __HAL_REMAPINTERRUPT_USB_ENABLE();
 
@@ -137,6 +145,34 @@ void board_dfu_complete(void)
   NVIC_SystemReset();
 }
 
+board_reset_cause_t board_reset_cause(void)
+{
+  board_reset_cause_t cause = BOARD_RESET_UNKNOWN;
+
+  // NRST pin is also asserted by internal resets, check it last
+  if ( __HAL_RCC_GET_FLAG(RCC_FLAG_PORRST) )
+  {
+    cause = BOARD_RESET_POWER_ON;
+  }
+  else if ( __HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST) || __HAL_RCC_GET_FLAG(RCC_FLAG_WWDGRST) )
+  {
+    cause = BOARD_RESET_WATCHDOG;
+  }
+  else if ( __HAL_RCC_GET_FLAG(RCC_FLAG_SFTRST) )
+  {
+    cause = BOARD_RESET_SOFTWARE;
+  }
+  else if ( __HAL_RCC_GET_FLAG(RCC_FLAG_PINRST) )
+  {
+    cause = BOARD_RESET_PIN;
+  }
+
+  TINYUF2_RESET_FLAGS_REG = RCC->CSR;
+  __HAL_RCC_CLEAR_RESET_FLAGS();
+
+  return cause;
+}
+
 bool board_app_valid(void)
 {
   if((((*(uint32_t*)BOARD_FLASH_APP_START) - BOARD_RAM_START) <= BOARD_RAM_SIZE)) // && ((*(uint32_t*)BOARD_FLASH_APP_START + 4) > BOARD_FLASH_APP_START) && ((*(uint32_t*)BOARD_FLASH_APP_START + 4) < BOARD_FLASH_APP_START + BOARD_FLASH_SIZE)
@@ -309,6 +345,7 @@ void board_timer_stop(void)
   SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
 }
 
+// Runs from flash, masked with BASEPRI while flash is busy (see board_flash.c)
 void SysTick_Handler (void)
 {
   board_timer_handler();
@@ -328,20 +365,20 @@ int board_uart_write(void const * buf, int len)
 
 #ifndef BUILD_NO_TINYUSB
 // Forward USB interrupt events to TinyUSB IRQ Handler
-void USB_HP_IRQHandler(void) {
+TINYUF2_RAMFUNC void USB_HP_IRQHandler(void) {
   tud_int_handler(0);
 }
 
 // USB low-priority interrupt (Channel 75): Triggered by all USB events
 // (Correct transfer, USB reset, etc.). The firmware has to check the
 // interrupt source before serving the interrupt.
-void USB_LP_IRQHandler(void) {
+TINYUF2_RAMFUNC void USB_LP_IRQHandler(void) {
   tud_int_handler(0);
 }
 
 // USB wakeup interrupt (Channel 76): Triggered by the wakeup event from the USB
 // Suspend mode.
-void USBWakeUp_RMP_IRQHandler(void) {
+TINYUF2_RAMFUNC void USBWakeUp_RMP_IRQHandler(void) {
   tud_int_handler(0);
 }
 
@@ -30,6 +30,7 @@ endif
 SRC_C += \
 	ports/stm32f3/boards.c \
 	ports/stm32f3/board_flash.c \
+	ports/stm32_common/stm32_flash.c \
 	$(ST_CMSIS)/Source/Templates/system_stm32f3xx.c \
 	$(ST_HAL_DRIVER)/Src/stm32f3xx_hal.c \
 	$(ST_HAL_DRIVER)/Src/stm32f3xx_hal_cortex.c \
@@ -46,6 +47,7 @@ endif
 
 # Port include
 INC += \
+	$(TOP)/ports/stm32_common \
 	$(TOP)/$(CMSIS_5)/CMSIS/Core/Include \
 	$(TOP)/$(ST_CMSIS)/Include \
 	$(TOP)/$(ST_HAL_DRIVER)/Inc
@@ -23,6 +23,7 @@
  */
 
 #include "board_api.h"
+#include "stm32_flash.h"
 
 #ifndef BUILD_NO_TINYUSB
 #include "tusb.h"
@@ -37,137 +38,222 @@
 // TinyUF2 resides in the first 2 flash sectors on STM32F4s, therefore these are write protected
 #define BOOTLOADER_SECTOR_MASK  0x3UL
 
-/* flash parameters that we should not really know */
-static const uint32_t sector_size[] =
-{
-  // First 4 sectors are for bootloader (64KB)
-  16 * 1024,
-	16 * 1024,
-	16 * 1024,
-	16 * 1024,
-	// Application (BOARD_FLASH_APP_START)
-	64 * 1024,
-	128 * 1024,
-	128 * 1024,
-	128 * 1024,
-
-	// flash sectors only in 1 MB devices
-	128 * 1024,
-	128 * 1024,
-	128 * 1024,
-	128 * 1024,
-
-	// flash sectors only in 2 MB devices
-	16 * 1024,
-	16 * 1024,
-	16 * 1024,
-	16 * 1024,
-	64 * 1024,
-	128 * 1024,
-	128 * 1024,
-	128 * 1024,
-	128 * 1024,
-	128 * 1024,
-	128 * 1024,
-	128 * 1024
-};
+// Parallelism (PSIZE) applies to both program and erase
+#if BOARD_FLASH_PARALLELISM == 8
+  #define FLASH_PROGRAM_PSIZE         FLASH_PSIZE_BYTE
+  typedef uint8_t flash_word_t;
+#elif BOARD_FLASH_PARALLELISM == 16
+  #define FLASH_PROGRAM_PSIZE         FLASH_PSIZE_HALF_WORD
+  typedef uint16_t flash_word_t;
+#elif BOARD_FLASH_PARALLELISM == 32
+  #define FLASH_PROGRAM_PSIZE         FLASH_PSIZE_WORD
+  typedef uint32_t flash_word_t;
+#elif BOARD_FLASH_PARALLELISM == 64
+  #define FLASH_PROGRAM_PSIZE         FLASH_PSIZE_DOUBLE_WORD
+  typedef uint64_t flash_word_t;
+#else
+  #error "BOARD_FLASH_PARALLELISM must be 8, 16, 32 or 64"
+#endif
 
-enum
+/* flash parameters that we should not really know */
+static const stm32_flash_group_t _flash_groups[] =
 {
-  SECTOR_COUNT = sizeof(sector_size)/sizeof(sector_size[0])
+  // Bank 1: first 4 sectors are for bootloader (64KB)
+  { .size =  16 * 1024, .count = 4, .first =  0, .bank = 1 },
+  // Application (BOARD_FLASH_APP_START), sectors 8-11 only in 1 MB devices
+  { .size =  64 * 1024, .count = 1, .first =  4, .bank = 1 },
+  { .size = 128 * 1024, .count = 7, .first =  5, .bank = 1 },
+
+  // Bank 2: flash sectors only in 2 MB devices
+  { .size =  16 * 1024, .count = 4, .first = 12, .bank = 2 },
+  { .size =  64 * 1024, .count = 1, .first = 16, .bank = 2 },
+  { .size = 128 * 1024, .count = 7, .first = 17, .bank = 2 },
 };
 
-static uint8_t erased_sectors[SECTOR_COUNT] = { 0 };
-
 //--------------------------------------------------------------------+
 // Internal Helper
 //--------------------------------------------------------------------+
 
-static inline uint32_t flash_sector_size(uint32_t sector)
+// SysTick handler (board_timer_handler) runs from flash and has the lowest priority (SysTick_Config),
+// it is masked with BASEPRI while flash is busy. USB interrupt has higher priority and is still served.
+static inline uint32_t flash_busy_basepri(void)
 {
-  return sector_size[sector];
+  return NVIC_GetPriority(SysTick_IRQn) << (8U - __NVIC_PRIO_BITS);
 }
 
-static bool is_blank(uint32_t addr, uint32_t size)
+// Start operation and wait for completion. Runs from RAM so that interrupts (vector table,
+// USB handler and DCD are also in RAM) are still serviced while flash is busy.
+TINYUF2_RAMFUNC static void flash_start_and_wait(uint32_t cr_bits, uint32_t basepri)
 {
-  for ( uint32_t i = 0; i < size; i += sizeof(uint32_t) )
-  {
-    if ( *(uint32_t*) (addr + i) != 0xffffffff )
-    {
-      return false;
-    }
-  }
-  return true;
+  uint32_t const prev_basepri = __get_BASEPRI();
+  __set_BASEPRI(basepri);
+
+  FLASH->CR |= cr_bits;
+  FLASH->CR |= FLASH_CR_STRT;
+  while ( FLASH->SR & FLASH_SR_BSY ) {}
+  FLASH->CR &= ~cr_bits;
+
+  __set_BASEPRI(prev_basepri);
 }
 
-static bool flash_erase(uint32_t addr)
+// Program words with PG set, also from RAM since flash is busy most of the time
+TINYUF2_RAMFUNC static void flash_program_words(uint32_t dst, const uint8_t *src, uint32_t len, uint32_t basepri)
 {
-  // starting address from 0x08000000
-  uint32_t sector_addr = FLASH_BASE_ADDR;
-  bool erased = false;
+  uint32_t const prev_basepri = __get_BASEPRI();
+  __set_BASEPRI(basepri);
 
-  uint32_t sector = 0;
-  uint32_t size = 0;
+  FLASH->CR |= FLASH_CR_PG;
 
-  for ( uint32_t i = 0; i < SECTOR_COUNT; i++ )
+  for ( uint32_t i = 0; i < len; i += sizeof(flash_word_t) )
   {
-    TUF2_ASSERT(sector_addr < FLASH_BASE_ADDR + BOARD_FLASH_SIZE);
+    flash_word_t data;
+    memcpy(&data, src + i, sizeof(data));
+
+#if BOARD_FLASH_PARALLELISM == 64
+    // double word is written as 2 consecutive words
+    *(__IO uint32_t*) (dst + i) = (uint32_t) data;
+    __ISB();
+    *(__IO uint32_t*) (dst + i + 4) = (uint32_t) (data >> 32);
+#else
+    *(__IO flash_word_t*) (dst + i) = data;
+#endif
 
-    size = flash_sector_size(i);
-    if ( sector_addr + size > addr )
-    {
-      sector = i;
-      erased = erased_sectors[i];
-      erased_sectors[i] = 1;    // don't erase anymore - we will continue writing here!
-      break;
-    }
-    sector_addr += size;
+    while ( FLASH->SR & FLASH_SR_BSY ) {}
   }
 
-#ifndef TINYUF2_SELF_UPDATE
-  // skip erasing sector0 if not self-update
-  TUF2_ASSERT(sector);
-#endif
+  FLASH->CR &= ~FLASH_CR_PG;
+
+  __set_BASEPRI(prev_basepri);
+}
+
+static void flash_set_psize(void)
+{
+  CLEAR_BIT(FLASH->CR, FLASH_CR_PSIZE);
+  SET_BIT(FLASH->CR, FLASH_PROGRAM_PSIZE);
+}
+
+// Erased contents may still be in ART caches
+static void flash_flush_caches(void)
+{
+  if ( READ_BIT(FLASH->ACR, FLASH_ACR_ICEN) )
+  {
+    __HAL_FLASH_INSTRUCTION_CACHE_DISABLE();
+    __HAL_FLASH_INSTRUCTION_CACHE_RESET();
+    __HAL_FLASH_INSTRUCTION_CACHE_ENABLE();
+  }
 
-  if ( !erased && !is_blank(sector_addr, size) )
+  if ( READ_BIT(FLASH->ACR, FLASH_ACR_DCEN) )
   {
-    TUF2_LOG1("Erase: %08lX size = %lu KB ... ", sector_addr, size / 1024);
-    FLASH_Erase_Sector(sector, FLASH_VOLTAGE_RANGE_3);
-    FLASH_WaitForLastOperation(HAL_MAX_DELAY);
-    TUF2_LOG1("OK\r\n");
-    TUF2_ASSERT( is_blank(sector_addr, size) );
+    __HAL_FLASH_DATA_CACHE_DISABLE();
+    __HAL_FLASH_DATA_CACHE_RESET();
+    __HAL_FLASH_DATA_CACHE_ENABLE();
   }
+}
+
+// bank 2 sectors are numbered from 16 in SNB
+static inline uint32_t flash_snb(stm32_flash_sector_t const* sector)
+{
+  return (sector->number > 11) ? (sector->number + 4) : sector->number;
+}
+
+// Sector erase with SER/SNB set directly (not HAL_FLASHEx_Erase), SER is cleared and ART caches
+// are flushed before returning so that following programming reads back erased contents
+static bool flash_erase(stm32_flash_sector_t const* sector)
+{
+  // also clear pending errors
+  if ( FLASH_WaitForLastOperation(HAL_MAX_DELAY) != HAL_OK ) return false;
+
+  flash_set_psize();
+  flash_start_and_wait(FLASH_CR_SER | (flash_snb(sector) << FLASH_CR_SNB_Pos), flash_busy_basepri());
+  flash_flush_caches();
+
+  return FLASH_WaitForLastOperation(HAL_MAX_DELAY) == HAL_OK;
+}
+
+#ifdef FLASH_BANK_2
+static bool flash_erase_bank(uint8_t bank)
+{
+  if ( FLASH_WaitForLastOperation(HAL_MAX_DELAY) != HAL_OK ) return false;
+
+  flash_set_psize();
+  flash_start_and_wait((bank == 2) ? FLASH_CR_MER1 : FLASH_CR_MER, flash_busy_basepri());
+  flash_flush_caches();
+
+  return FLASH_WaitForLastOperation(HAL_MAX_DELAY) == HAL_OK;
+}
+
+// Read-while-write: bank 2 sector is erased while we keep executing (and servicing USB) from bank 1
+static bool flash_erase_start(stm32_flash_sector_t const* sector)
+{
+  if ( FLASH_WaitForLastOperation(HAL_MAX_DELAY) != HAL_OK ) return false;
+
+  flash_set_psize();
+  FLASH->CR |= FLASH_CR_SER | (flash_snb(sector) << FLASH_CR_SNB_Pos);
+  FLASH->CR |= FLASH_CR_STRT;
 
   return true;
 }
 
-static void flash_write(uint32_t dst, const uint8_t *src, int len)
+static bool flash_busy(void)
 {
-  flash_erase(dst);
+  return (FLASH->SR & FLASH_SR_BSY) != 0;
+}
 
-  TUF2_LOG1("Write flash at address %08lX\r\n", dst);
-  for ( int i = 0; i < len; i += 4 )
-  {
-    uint32_t data = *((uint32_t*) ((void*) (src + i)));
+static bool flash_erase_finish(stm32_flash_sector_t const* sector)
+{
+  (void) sector;
 
-    if ( HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, dst + i, (uint64_t) data) != HAL_OK )
-    {
-      TUF2_LOG1("Failed to write flash at address %08lX\r\n", dst + i);
-      break;
-    }
+  bool const ret = (FLASH_WaitForLastOperation(HAL_MAX_DELAY) == HAL_OK);
+  CLEAR_BIT(FLASH->CR, FLASH_CR_SER | FLASH_CR_SNB);
+  flash_flush_caches();
 
-    if ( FLASH_WaitForLastOperation(HAL_MAX_DELAY) != HAL_OK )
-    {
-      TUF2_LOG1("Waiting on last operation failed\r\n");
-      return;
-    }
-  }
+  return ret;
+}
+#endif
+
+// Program the whole payload with PG set instead of a HAL round trip per word
+static bool flash_program(stm32_flash_sector_t const* sector, uint32_t dst, const uint8_t *src, uint32_t len)
+{
+  (void) sector;
+
+  if ( FLASH_WaitForLastOperation(HAL_MAX_DELAY) != HAL_OK ) return false;
+
+  flash_set_psize();
+  flash_program_words(dst, src, len, flash_busy_basepri());
 
-  // verify contents
-  if ( memcmp((void*) dst, src, len) != 0 )
+  if ( FLASH_WaitForLastOperation(HAL_MAX_DELAY) != HAL_OK )
   {
-    TUF2_LOG1("Failed to write\r\n");
+    TUF2_LOG1("Failed to write flash at address %08lX\r\n", dst);
+    return false;
   }
+
+  return true;
+}
+
+static const stm32_flash_map_t _flash_map =
+{
+  .base          = FLASH_BASE_ADDR,
+  .size          = BOARD_FLASH_SIZE,
+  .groups        = _flash_groups,
+  .group_count   = sizeof(_flash_groups) / sizeof(_flash_groups[0]),
+  .program_width = sizeof(flash_word_t),
+  .erase         = flash_erase,
+  .program       = flash_program,
+#ifdef FLASH_BANK_2
+  .exec_bank     = 1, // TinyUF2 is always in bank 1
+  .erase_bank    = flash_erase_bank,
+  .erase_start   = flash_erase_start,
+  .busy          = flash_busy,
+  .erase_finish  = flash_erase_finish,
+#endif
+};
+
+// Finish background erase and its held back write before flash is accessed
+static bool flash_sync(void)
+{
+  bool const ret = stm32_flash_wait();
+  HAL_FLASH_Lock();
+  return ret;
 }
 
 //--------------------------------------------------------------------+
@@ -175,7 +261,7 @@ static void flash_write(uint32_t dst, const uint8_t *src, int len)
 //--------------------------------------------------------------------+
 void board_flash_init(void)
 {
-
+  stm32_flash_init(&_flash_map);
 }
 
 uint32_t board_flash_size(void)
@@ -185,11 +271,13 @@ uint32_t board_flash_size(void)
 
 void board_flash_read(uint32_t addr, void* buffer, uint32_t len)
 {
+  (void) flash_sync(); // failure is reported by next write or flush
   memcpy(buffer, (void*) addr, len);
 }
 
-void board_flash_flush(void)
+bool board_flash_flush(void)
 {
+  return flash_sync();
 }
 
 // TODO not working quite yet
@@ -197,15 +285,42 @@ bool board_flash_write(uint32_t addr, void const* data, uint32_t len)
 {
   // TODO skip matching contents
   HAL_FLASH_Unlock();
-  flash_write(addr, data, len);
-  HAL_FLASH_Lock();
+  bool const ret = stm32_flash_write(addr, data, len);
 
-  return true;
+  // stay unlocked while erase is running in background, locked by board_flash_busy() when done
+  if ( !stm32_flash_busy() ) HAL_FLASH_Lock();
+
+  return ret;
+}
+
+bool board_flash_busy(void)
+{
+  if ( stm32_flash_busy() ) return true;
+
+  HAL_FLASH_Lock();
+  return false;
 }
 
 void board_flash_erase_app(void)
 {
-  // TODO implement later
+  // called before board_flash_init() when requested by double tap magic
+  board_flash_init();
+
+  HAL_FLASH_Unlock();
+  stm32_flash_erase_range(BOARD_FLASH_APP_START, FLASH_BASE_ADDR + BOARD_FLASH_SIZE - BOARD_FLASH_APP_START);
+  HAL_FLASH_Lock();
+}
+
+bool board_flash_erase_sector(uint32_t addr)
+{
+  stm32_flash_sector_t sector;
+  if ( !stm32_flash_find_sector(addr, &sector) ) return false;
+
+  HAL_FLASH_Unlock();
+  bool const ret = stm32_flash_erase_range(sector.addr, sector.size);
+  HAL_FLASH_Lock();
+
+  return ret;
 }
 
 bool board_flash_protect_bootloader(bool protect)
@@ -282,19 +397,9 @@ void board_self_update(const uint8_t * bootloader_bin, uint32_t bootloader_len)
     // keep writing until flash contents matches new bootloader data
     while( memcmp((const void*) FLASH_BASE_ADDR, bootloader_bin, bootloader_len) )
     {
-      uint32_t sector_addr = FLASH_BASE_ADDR;
-      const uint8_t * data = bootloader_bin;
-      uint32_t len = bootloader_len;
-
-      for ( uint32_t i = 0; i < 4 && len > 0; i++ )
-      {
-        uint32_t const size = (flash_sector_size(i) < len ? flash_sector_size(i) : len);
-        board_flash_write(sector_addr, data, size);
-
-        sector_addr += size;
-        data += size;
-        len -= size;
-      }
+      // re-init to erase bootloader sectors again
+      board_flash_init();
+      board_flash_write(FLASH_BASE_ADDR, bootloader_bin, bootloader_len);
     }
   }
 
@@ -303,8 +408,8 @@ void board_self_update(const uint8_t * bootloader_bin, uint32_t bootloader_len)
   __disable_irq();
   HAL_FLASH_Unlock();
 
-  HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, BOARD_FLASH_APP_START , 0);
-  HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, BOARD_FLASH_APP_START+4, 0);
+  uint8_t const zeros[8] = { 0 };
+  flash_program(NULL, BOARD_FLASH_APP_START, zeros, sizeof(zeros));
 
   HAL_FLASH_Lock();
 
@@ -32,6 +32,10 @@
 // MACRO TYPEDEF CONSTANT ENUM DECLARATION
 //--------------------------------------------------------------------+
 
+// Vector table is copied to RAM in DFU mode, so that USB interrupt is still serviced while flash is busy
+extern uint32_t g_pfnVectors[];
+static uint32_t _ram_vectors[128] __attribute__((aligned(512)));
+
 #define STM32_UUID    ((volatile uint32_t *) UID_BASE)
 
 UART_HandleTypeDef UartHandle;
@@ -103,6 +107,10 @@ void board_init(void)
 
 void board_dfu_init(void)
 {
+  // serve interrupts from RAM, USB handler and tinyusb DCD are also in RAM (TINYUF2_RAMFUNC)
+  memcpy(_ram_vectors, g_pfnVectors, sizeof(_ram_vectors));
+  SCB->VTOR = (uint32_t) _ram_vectors;
+
   GPIO_InitTypeDef  GPIO_InitStruct;
 
   // USB Pin Init
@@ -177,6 +185,34 @@ void board_dfu_complete(void)
   NVIC_SystemReset();
 }
 
+board_reset_cause_t board_reset_cause(void)
+{
+  board_reset_cause_t cause = BOARD_RESET_UNKNOWN;
+
+  // NRST pin is also asserted by internal resets, check it last
+  if ( __HAL_RCC_GET_FLAG(RCC_FLAG_PORRST) || __HAL_RCC_GET_FLAG(RCC_FLAG_BORRST) )
+  {
+    cause = BOARD_RESET_POWER_ON;
+  }
+  else if ( __HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST) || __HAL_RCC_GET_FLAG(RCC_FLAG_WWDGRST) )
+  {
+    cause = BOARD_RESET_WATCHDOG;
+  }
+  else if ( __HAL_RCC_GET_FLAG(RCC_FLAG_SFTRST) )
+  {
+    cause = BOARD_RESET_SOFTWARE;
+  }
+  else if ( __HAL_RCC_GET_FLAG(RCC_FLAG_PINRST) )
+  {
+    cause = BOARD_RESET_PIN;
+  }
+
+  TINYUF2_RESET_FLAGS_REG = RCC->CSR;
+  __HAL_RCC_CLEAR_RESET_FLAGS();
+
+  return cause;
+}
+
 bool board_app_valid(void)
 {
   volatile uint32_t const * app_vector = (volatile uint32_t const*) BOARD_FLASH_APP_START;
@@ -359,6 +395,7 @@ void board_timer_stop(void)
   SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
 }
 
+// Runs from flash, masked with BASEPRI while flash is busy (see board_flash.c)
 void SysTick_Handler(void)
 {
   board_timer_handler();
@@ -378,7 +415,7 @@ int board_uart_write(void const * buf, int len)
 
 #ifndef BUILD_NO_TINYUSB
 // Forward USB interrupt events to TinyUSB IRQ Handler
-void OTG_FS_IRQHandler(void)
+TINYUF2_RAMFUNC void OTG_FS_IRQHandler(void)
 {
   tud_int_handler(0);
 }
@@ -36,14 +36,27 @@
 
 #define BOARD_FLASH_ADDR_ZERO   0x08000000
 
+// Flash driver and USB interrupt run from RAM, see .data in linker script
+#define TINYUF2_RAMFUNC         __attribute__((section(".ramfunc"), noinline))
+
 // Flash Start Address of Application
 #ifndef BOARD_FLASH_APP_START
 #define BOARD_FLASH_APP_START   0x08010000
 #endif
 
+// Flash program/erase parallelism in bits: 8, 16, 32 or 64 (64 requires external VPP)
+#ifndef BOARD_FLASH_PARALLELISM
+#define BOARD_FLASH_PARALLELISM 32
+#endif
+
 // Double Reset tap to enter DFU
 #define TINYUF2_DBL_TAP_DFU  1
 
+// Reset flags (RCC_CSR) saved by board_reset_cause() before they are cleared, application
+// finds them at _board_reset_flags reserved by linker script next to the double tap word
+extern volatile uint32_t _board_reset_flags[];
+#define TINYUF2_RESET_FLAGS_REG  _board_reset_flags[0]
+
 // Enable write protection
 #ifndef TINYUF2_PROTECT_BOOTLOADER
 #define TINYUF2_PROTECT_BOOTLOADER    1
@@ -29,6 +29,7 @@ function(family_add_board_target BOARD_TARGET)
   endif ()
 
   add_library(${BOARD_TARGET} STATIC
+    ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../stm32_common/stm32_flash.c
     ${ST_CMSIS}/Source/Templates/system_stm32f4xx.c
     ${ST_HAL_DRIVER}/Src/stm32f4xx_hal.c
     ${ST_HAL_DRIVER}/Src/stm32f4xx_hal_cortex.c
@@ -43,6 +44,7 @@ function(family_add_board_target BOARD_TARGET)
     # port & board
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/boards/${BOARD}
+    ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../stm32_common
     # sdk
     ${CMSIS_5}/CMSIS/Core/Include
     ${ST_CMSIS}/Include
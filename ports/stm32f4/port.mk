@@ -30,6 +30,7 @@ endif
 SRC_C += \
 	ports/stm32f4/boards.c \
 	ports/stm32f4/board_flash.c \
+	ports/stm32_common/stm32_flash.c \
 	$(ST_CMSIS)/Source/Templates/system_stm32f4xx.c \
 	$(ST_HAL_DRIVER)/Src/stm32f4xx_hal.c \
 	$(ST_HAL_DRIVER)/Src/stm32f4xx_hal_cortex.c \
@@ -45,6 +46,7 @@ endif
 
 # Port include
 INC += \
+	$(TOP)/ports/stm32_common \
 	$(TOP)/$(CMSIS_5)/CMSIS/Core/Include \
 	$(TOP)/$(ST_CMSIS)/Include \
 	$(TOP)/$(ST_HAL_DRIVER)/Inc
@@ -1,5 +1,7 @@
 #include "board_api.h"
 #include "stm32h7xx_hal.h"
+#include "sfdp.h"
+#include "nor_erase.h"
 
 #ifdef W25Qx_SPI
 #include "components/w25qxx/w25qxx.h"
@@ -11,6 +13,33 @@
 
 #if BOARD_QSPI_FLASH_EN
 QSPI_HandleTypeDef _qspi_flash;
+
+// Geometry discovered from SFDP, size is 0 if the flash has no valid table
+static sfdp_flash_t _qspi_sfdp;
+
+// Read mode used while tinyuf2 is running: w25qxx_NormalMode or w25qxx_DTRMode
+#ifndef BOARD_QSPI_READ_MODE
+#define BOARD_QSPI_READ_MODE  w25qxx_NormalMode
+#endif
+
+// QSPI stays memory-mapped for reads, indirect mode is only used while erasing/programming
+static bool _qspi_mapped = false;
+
+// Range programmed since last mapped, to be invalidated from DCache
+static uint32_t _qspi_dirty_start = UINT32_MAX;
+static uint32_t _qspi_dirty_end = 0;
+
+// Sector erase runs in background (suspended for host reads), written data is merged
+// into the sector buffer and programmed once a write moves on to another sector
+#define QSPI_SECTOR_SIZE  4096
+#define QSPI_NO_SECTOR    UINT32_MAX
+
+static nor_erase_t _qspi_erase;
+static uint32_t _qspi_sector_addr = QSPI_NO_SECTOR;
+static uint8_t  _qspi_sector_buf[QSPI_SECTOR_SIZE] __attribute__((aligned(4)));
+
+// 4KB erase instruction, replaced by the one SFDP reports for QSPI_SECTOR_SIZE
+static uint8_t  _qspi_erase_opcode = W25X_SectorErase;
 #endif // BOARD_QSPI_FLASH_EN
 
 #if BOARD_SPI_FLASH_EN
@@ -40,8 +69,112 @@ uint32_t W25Qx_GetTick(void)
 {
   return HAL_GetTick();
 }
+
+static bool spi_sfdp_read(uint32_t addr, void * buffer, uint32_t len)
+{
+  return W25Qx_ReadSFDP(addr, (uint8_t *) buffer, len) == W25Qx_OK;
+}
 #endif // W25Qx_SPI
 
+#ifdef W25Qx_QSPI
+static bool qspi_sfdp_read(uint32_t addr, void * buffer, uint32_t len)
+{
+  return w25qxx_ReadSFDP(addr, (uint8_t *) buffer, len) == w25qxx_OK;
+}
+#endif // W25Qx_QSPI
+
+#if BOARD_QSPI_FLASH_EN
+static bool qspi_erase_start(uint32_t addr, uint32_t size)
+{
+  (void) size;
+  return W25qxx_EraseStart(_qspi_erase_opcode, addr) == w25qxx_OK;
+}
+
+static bool qspi_busy(void)
+{
+  return W25qxx_IsBusy() != 0;
+}
+
+static bool qspi_erase_suspend(void)
+{
+  return W25qxx_EraseSuspend() == w25qxx_OK;
+}
+
+static bool qspi_erase_resume(void)
+{
+  return W25qxx_EraseResume() == w25qxx_OK;
+}
+
+static bool qspi_read(uint32_t addr, void * buffer, uint32_t len)
+{
+  return W25qxx_Read((uint8_t *) buffer, addr, len) == w25qxx_OK;
+}
+
+// suspend is cleared if SFDP reports the flash does not support it
+static nor_erase_ops_t _qspi_erase_ops =
+{
+  .erase   = qspi_erase_start,
+  .busy    = qspi_busy,
+  .suspend = qspi_erase_suspend,
+  .resume  = qspi_erase_resume,
+  .read    = qspi_read,
+};
+
+// SFDP lists a 4-4-4 read i.e the flash can be switched to QPI
+static bool qspi_sfdp_has_qpi(void)
+{
+  for (uint8_t i = 0; i < _qspi_sfdp.read_count; i++)
+  {
+    if (_qspi_sfdp.read[i].inst_lines == 4) return true;
+  }
+  return false;
+}
+
+// Wait for background erase and program the pending sector, false if either failed
+static bool qspi_sector_flush(void)
+{
+  if (_qspi_sector_addr == QSPI_NO_SECTOR) return true;
+
+  bool ok = nor_erase_wait(&_qspi_erase);
+  if (ok)
+  {
+    ok = (W25qxx_WriteNoCheck(_qspi_sector_buf, _qspi_sector_addr, QSPI_SECTOR_SIZE) == w25qxx_OK);
+  }
+  _qspi_sector_addr = QSPI_NO_SECTOR;
+
+  return ok;
+}
+
+// Switch to memory-mapped mode if needed, return false if QSPI is still in indirect mode
+static bool qspi_memory_mapped(void)
+{
+  if (_qspi_mapped) return true;
+  if (_qspi_sector_addr != QSPI_NO_SECTOR) return false;
+
+  if (w25qxx_MemoryMapped(BOARD_QSPI_READ_MODE) != w25qxx_OK) return false;
+  _qspi_mapped = true;
+
+  // Drop lines cached before the flash was modified
+  if (_qspi_dirty_start < _qspi_dirty_end)
+  {
+    SCB_InvalidateDCache_by_Addr((uint32_t *) _qspi_dirty_start, (int32_t) (_qspi_dirty_end - _qspi_dirty_start));
+    _qspi_dirty_start = UINT32_MAX;
+    _qspi_dirty_end = 0;
+  }
+
+  return true;
+}
+
+// Leave memory-mapped mode to issue erase/program commands
+static void qspi_indirect(void)
+{
+  if (!_qspi_mapped) return;
+
+  (void) w25qxx_ExitMemoryMapped();
+  _qspi_mapped = false;
+}
+#endif // BOARD_QSPI_FLASH_EN
+
 //--------------------------------------------------------------------+
 // Flash LL for tinyuf2
 //--------------------------------------------------------------------+
@@ -84,26 +217,72 @@ void board_flash_early_init(void)
   qspi_flash_init(&_qspi_flash);
   // Initialize QSPI driver
   w25qxx_Init();
-  // SPI -> QPI
-  w25qxx_EnterQPI();
+  // SFDP is only readable in SPI mode
+  if (!sfdp_parse(qspi_sfdp_read, &_qspi_sfdp))
+  {
+    _qspi_sfdp.size = 0;
+  }
+  else
+  {
+    sfdp_erase_t const * er = sfdp_find_erase(&_qspi_sfdp, QSPI_SECTOR_SIZE);
+    if (er) _qspi_erase_opcode = er->opcode;
+    if (_qspi_sfdp.suspend_opcode == 0) _qspi_erase_ops.suspend = NULL;
+  }
+  nor_erase_init(&_qspi_erase, &_qspi_erase_ops);
+  // SPI -> QPI, parts without a 4-4-4 read stay in SPI mode and are mapped with 1-4-4 EBh
+  if (_qspi_sfdp.size == 0 || qspi_sfdp_has_qpi())
+  {
+    w25qxx_EnterQPI();
+  }
+  // reads e.g board_app_valid() are served from the memory-mapped region
+  (void) qspi_memory_mapped();
 #endif // BOARD_QSPI_FLASH_EN
 }
 
 void board_flash_init(void)
 {
+#if BOARD_QSPI_FLASH_EN
+  if (_qspi_sfdp.size)
+  {
+    // 1-1-1 fast read is always present in a parsed table
+    sfdp_read_mode_t const * rd = sfdp_fastest_read(&_qspi_sfdp, 4);
+    sfdp_erase_t const * er = sfdp_largest_erase(&_qspi_sfdp);
+    TUF2_LOG1("QSPI SFDP: %lu bytes, page %lu, read %02X (%u-%u-%u), erase %lu (%02X)\r\n",
+              _qspi_sfdp.size, _qspi_sfdp.page_size, rd->opcode, rd->inst_lines, rd->addr_lines, rd->data_lines,
+              er ? er->size : 0, er ? er->opcode : 0);
+  }
+#endif // BOARD_QSPI_FLASH_EN
+
 #if BOARD_SPI_FLASH_EN
   // Initialize SPI peripheral
   spi_flash_init(&_spi_flash);
   // Initialize SPI drivers
   W25Qx_Init();
+
+  // Prefer geometry from SFDP over the table of known IDs, driver only does 3-byte addressing
+  sfdp_flash_t sfdp;
+  if (sfdp_parse(spi_sfdp_read, &sfdp) && sfdp.size <= 16*1024*1024)
+  {
+    sfdp_erase_t const * subsector = sfdp_find_erase(&sfdp, 4096);
+    sfdp_erase_t const * sector = sfdp_largest_erase(&sfdp);
+
+    W25Qx_Para.FLASH_Size = sfdp.size;
+    W25Qx_Para.PAGE_SIZE = sfdp.page_size;
+    if (subsector) W25Qx_Para.SUBSECTOR_SIZE = subsector->size;
+    if (sector) W25Qx_Para.SECTOR_SIZE = sector->size;
+    W25Qx_Para.SUBSECTOR_COUNT = W25Qx_Para.FLASH_Size / W25Qx_Para.SUBSECTOR_SIZE;
+    W25Qx_Para.SECTOR_COUNT = W25Qx_Para.FLASH_Size / W25Qx_Para.SECTOR_SIZE;
+  }
 #endif // BOARD_SPI_FLASH_EN
 }
 
 void board_flash_deinit(void)
 {
 #if BOARD_QSPI_FLASH_EN
-  // Enable Memory Mapped Mode
+  // Enable Memory Mapped Mode with continuous read for the application
   // QSPI flash will be available at 0x90000000U (readonly)
+  qspi_indirect();
+  (void) qspi_sector_flush();
   w25qxx_Startup(w25qxx_DTRMode);
 #endif // BOARD_QSPI_FLASH_EN
 }
@@ -111,23 +290,61 @@ void board_flash_deinit(void)
 uint32_t board_flash_size(void)
 {
   // TODO: how do we handle more than 1 target here?
+#if BOARD_QSPI_FLASH_EN
+  // smaller parts are reported by SFDP, address decoding is limited to QSPI_FLASH_SIZE
+  if (_qspi_sfdp.size && _qspi_sfdp.size < QSPI_FLASH_SIZE)
+  {
+    return _qspi_sfdp.size;
+  }
+#endif // BOARD_QSPI_FLASH_EN
   return 8*1024*1024;
 }
 
-void board_flash_flush(void)
+bool board_flash_flush(void)
 {
-  // TODO: do we need to implement this if there no caching involved?
-  // maybe flush cached RAM here?
+  bool ok = true;
+
+#if BOARD_QSPI_FLASH_EN
+  // programming batch is done, restore memory-mapped reads
+  ok = qspi_sector_flush();
+  (void) qspi_memory_mapped();
+#endif // BOARD_QSPI_FLASH_EN
+
+  return ok;
 }
 
 void board_flash_read(uint32_t addr, void * data, uint32_t len)
 {
-  TUF2_LOG1("Reading %lu byte(s) from 0x%08lx\r\n", len, addr);
 #if BOARD_QSPI_FLASH_EN
-  // addr += QSPI_BASE_ADDR;
   if (IS_QSPI_ADDR(addr))
   {
-    (void) W25qxx_Read(data, addr - QSPI_BASE_ADDR, len);
+    uint32_t const offset = addr - QSPI_BASE_ADDR;
+
+    if (qspi_memory_mapped())
+    {
+      memcpy(data, (void *) addr, len);
+    }
+    else
+    {
+      // suspends sector erase if needed
+      (void) nor_erase_read(&_qspi_erase, offset, data, len);
+    }
+
+    // pending sector data is not programmed yet
+    if (_qspi_sector_addr != QSPI_NO_SECTOR && offset < _qspi_sector_addr + QSPI_SECTOR_SIZE && offset + len > _qspi_sector_addr)
+    {
+      uint32_t const start = (offset > _qspi_sector_addr) ? offset : _qspi_sector_addr;
+      uint32_t const end = (offset + len < _qspi_sector_addr + QSPI_SECTOR_SIZE) ? offset + len : _qspi_sector_addr + QSPI_SECTOR_SIZE;
+      memcpy((uint8_t *) data + (start - offset), _qspi_sector_buf + (start - _qspi_sector_addr), end - start);
+    }
+    return;
+  }
+#endif
+
+#if BOARD_SPI_FLASH_EN
+  if (IS_SPI_ADDR(addr))
+  {
+    (void) W25Qx_Read(data, addr - SPI_BASE_ADDR, len);
     return;
   }
 #endif
@@ -163,8 +380,7 @@ bool board_flash_write(uint32_t addr, void const * data, uint32_t len)
 #if (BOARD_SPI_FLASH_EN == 1U)
   if (IS_SPI_ADDR(addr) && IS_SPI_ADDR(addr + len - 1))
   {
-    W25Qx_Write((uint8_t *) data, (addr - SPI_BASE_ADDR), len);
-    return true;
+    return W25Qx_Write((uint8_t *) data, (addr - SPI_BASE_ADDR), len) == W25Qx_OK;
   }
 #endif
 
@@ -172,12 +388,46 @@ bool board_flash_write(uint32_t addr, void const * data, uint32_t len)
   if (IS_QSPI_ADDR(addr) && IS_QSPI_ADDR(addr + len - 1))
   {
     // SET_BOOT_ADDR(BOARD_AXISRAM_APP_ADDR);
-    // handles erasing internally
-    if (W25qxx_Write((uint8_t *)data, (addr - QSPI_BASE_ADDR), len) != w25qxx_OK)
+    qspi_indirect();
+
+    if (addr < _qspi_dirty_start) _qspi_dirty_start = addr;
+    if (addr + len > _qspi_dirty_end) _qspi_dirty_end = addr + len;
+
+    uint32_t const offset = addr - QSPI_BASE_ADDR;
+    uint32_t const sector = offset & ~(QSPI_SECTOR_SIZE - 1);
+    uint32_t const sector_offset = offset - sector;
+
+    if (sector_offset + len <= QSPI_SECTOR_SIZE)
     {
-      __asm("bkpt #9");
+      // more data for the sector being erased
+      if (sector == _qspi_sector_addr)
+      {
+        memcpy(_qspi_sector_buf + sector_offset, data, len);
+        return true;
+      }
+
+      if (!qspi_sector_flush()) return false;
+
+      if (W25qxx_Read(_qspi_sector_buf, sector, QSPI_SECTOR_SIZE) != w25qxx_OK) return false;
+      for (uint32_t i = 0; i < len; i++)
+      {
+        if (_qspi_sector_buf[sector_offset + i] != 0xFF)
+        {
+          // keep the rest of the sector, erase in background
+          memcpy(_qspi_sector_buf + sector_offset, data, len);
+          if (!nor_erase_start(&_qspi_erase, sector, QSPI_SECTOR_SIZE)) return false;
+          _qspi_sector_addr = sector;
+          return true;
+        }
+      }
+
+      return W25qxx_WriteNoCheck((uint8_t *) data, offset, len) == w25qxx_OK;
     }
-    return true;
+
+    if (!qspi_sector_flush()) return false;
+
+    // handles erasing internally
+    return W25qxx_Write((uint8_t *)data, offset, len) == w25qxx_OK;
   }
 #endif
 
@@ -207,6 +457,76 @@ bool board_flash_write(uint32_t addr, void const * data, uint32_t len)
   return false;
 }
 
+// Host writes are retried while sector erase is running, reads are still served
+bool board_flash_busy(void)
+{
+#if BOARD_QSPI_FLASH_EN
+  if (_qspi_sector_addr != QSPI_NO_SECTOR)
+  {
+    return nor_erase_busy(&_qspi_erase);
+  }
+#endif // BOARD_QSPI_FLASH_EN
+  return false;
+}
+
+//--------------------------------------------------------------------+
+// Data flash for second MSC LUN: external SPI W25Qx
+//--------------------------------------------------------------------+
+#if TINYUF2_MSC_DATA_LUN && BOARD_SPI_FLASH_EN
+
+uint32_t board_data_flash_size(void)
+{
+  // W25Qx_Init() leaves FLASH_Size at 0 for unknown parts without SFDP
+  if (W25Qx_Para.FLASH_Size && W25Qx_Para.FLASH_Size < BOARD_SPI_FLASH_SIZE)
+  {
+    return W25Qx_Para.FLASH_Size;
+  }
+  return BOARD_SPI_FLASH_SIZE;
+}
+
+void board_data_flash_read(uint32_t addr, void * data, uint32_t len)
+{
+  (void) W25Qx_Read((uint8_t *) data, addr, len);
+}
+
+bool board_data_flash_write(uint32_t addr, void const * data, uint32_t len)
+{
+  uint8_t const * buf = (uint8_t const *) data;
+
+  // data is aligned to 4K sector: erase and program without read-modify-write
+  for (uint32_t offset = 0; offset < len; offset += W25QXXXX_SUBSECTOR_SIZE)
+  {
+    if (W25Qx_Erase_Block(addr + offset) != W25Qx_OK) return false;
+    if (W25Qx_WriteNoCheck((uint8_t *) (uintptr_t) (buf + offset), addr + offset, W25QXXXX_SUBSECTOR_SIZE) != W25Qx_OK) return false;
+  }
+
+  return true;
+}
+
+#endif
+
+// Each memory region is exposed as its own readback file
+static board_flash_region_t const _flash_regions[] =
+{
+  // smaller regions first, files that do not fit into the volume are dropped from the end
+#if BOARD_AXISRAM_EN
+  { .name = "AXISRAM", .addr = BOARD_AXISRAM_APP_ADDR, .size = AXISRAM_SIZE - AXISRAM_OFFS },
+#endif
+  { .name = "PFLASH" , .addr = PFLASH_BASE_ADDR + PFLASH_SIZE/2, .size = PFLASH_SIZE/2 },
+#if BOARD_SPI_FLASH_EN && !TINYUF2_MSC_DATA_LUN
+  { .name = "SPI"    , .addr = SPI_BASE_ADDR , .size = BOARD_SPI_FLASH_SIZE },
+#endif
+#if BOARD_QSPI_FLASH_EN
+  { .name = "QSPI"   , .addr = QSPI_BASE_ADDR, .size = BOARD_QSPI_FLASH_SIZE },
+#endif
+};
+
+uint32_t board_flash_get_regions(board_flash_region_t const ** regions)
+{
+  *regions = _flash_regions;
+  return sizeof(_flash_regions) / sizeof(_flash_regions[0]);
+}
+
 void board_flash_erase_app(void)
 {
   board_flash_init();
@@ -214,10 +534,13 @@ void board_flash_erase_app(void)
 #if BOARD_QSPI_FLASH_EN
   TUF2_LOG1("Erasing QSPI Flash\r\n");
   // Erase QSPI Flash
+  qspi_indirect();
+  (void) nor_erase_wait(&_qspi_erase);
   (void) W25qxx_EraseChip();
 #endif
 
-#if BOARD_SPI_FLASH_EN
+#if BOARD_SPI_FLASH_EN && !TINYUF2_MSC_DATA_LUN
+  // SPI flash holds user data when exposed as data LUN, it is not part of the application
   TUF2_LOG1("Erasing SPI Flash\r\n");
   // Erase QSPI Flash
   (void) W25Qx_Erase_Chip();
@@ -102,6 +102,34 @@ void board_dfu_complete(void)
   NVIC_SystemReset();
 }
 
+board_reset_cause_t board_reset_cause(void)
+{
+  board_reset_cause_t cause = BOARD_RESET_UNKNOWN;
+
+  // NRST pin is also asserted by internal resets, check it last
+  if ( __HAL_RCC_GET_FLAG(RCC_FLAG_PORRST) || __HAL_RCC_GET_FLAG(RCC_FLAG_BORRST) )
+  {
+    cause = BOARD_RESET_POWER_ON;
+  }
+  else if ( __HAL_RCC_GET_FLAG(RCC_FLAG_IWDG1RST) || __HAL_RCC_GET_FLAG(RCC_FLAG_WWDG1RST) )
+  {
+    cause = BOARD_RESET_WATCHDOG;
+  }
+  else if ( __HAL_RCC_GET_FLAG(RCC_FLAG_SFTRST) )
+  {
+    cause = BOARD_RESET_SOFTWARE;
+  }
+  else if ( __HAL_RCC_GET_FLAG(RCC_FLAG_PINRST) )
+  {
+    cause = BOARD_RESET_PIN;
+  }
+
+  TINYUF2_RESET_FLAGS_REG = RCC->RSR;
+  __HAL_RCC_CLEAR_RESET_FLAGS();
+
+  return cause;
+}
+
 bool board_app_valid(void)
 {
   uint32_t app_addr = board_get_app_start_address();
@@ -192,6 +220,29 @@ void board_app_jump(void)
 
 }
 
+#if BOARD_AXISRAM_EN
+bool board_ram_run_range(uint32_t addr, uint32_t len)
+{
+  return IS_AXISRAM_ADDR(addr) && IS_AXISRAM_ADDR(addr + len - 1);
+}
+
+void board_ram_run(uint32_t addr)
+{
+  SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+
+  // No interrupt (e.g USB) must fire before the application sets up its own handlers
+  for (uint32_t i = 0; i < sizeof(NVIC->ICER) / sizeof(NVIC->ICER[0]); i++)
+  {
+    NVIC->ICER[i] = 0xFFFFFFFFU;
+    NVIC->ICPR[i] = 0xFFFFFFFFU;
+  }
+
+  // DCache is cleaned when disabled by board_app_jump()
+  SET_BOOT_ADDR(addr);
+  board_app_jump();
+}
+#endif // BOARD_AXISRAM_EN
+
 // USB Get_Serial response
 uint8_t board_usb_get_serial(uint8_t serial_id[16])
 {
@@ -79,6 +79,11 @@
 // Double Reset tap to enter DFU
 #define TINYUF2_DBL_TAP_DFU  1
 
+// Reset flags (RCC_RSR) saved by board_reset_cause() before they are cleared, application
+// finds them at _board_reset_flags reserved by linker script next to the double tap word
+extern volatile uint32_t _board_reset_flags[];
+#define TINYUF2_RESET_FLAGS_REG  _board_reset_flags[0]
+
 void board_flash_early_init(void);
 uint32_t board_get_app_start_address(void);
 void board_save_app_start_address(uint32_t addr);
@@ -10,6 +10,8 @@ CFLAGS += \
   -DBOARD_QSPI_FLASH_EN=1 \
   -DBOARD_SPI_FLASH_EN=1 \
   -DBOARD_AXISRAM_EN=1 \
+  -DTINYUF2_MSC_DATA_LUN=1 \
+  -DCFG_UF2_REGION_MAX=4 \
   -D$(SPI_FLASH) \
   -D$(QSPI_FLASH)\
   -DBOARD_FLASH_APP_START=0x90000000 \
@@ -120,6 +120,36 @@ void W25Qx_Read_ID(uint16_t *ID)
 
 }
 
+/**
+  * @brief  Reads the SFDP (JESD216) parameter tables.
+  * @param  ReadAddr: SFDP address
+  * @param  pData: Pointer to data to be read
+  * @param  Size: Size of data to read
+  * @retval SPI memory status
+  */
+uint8_t W25Qx_ReadSFDP(uint32_t ReadAddr, uint8_t* pData, uint32_t Size)
+{
+  uint8_t result = W25Qx_OK;
+  uint8_t cmd[5];
+
+  /* Configure the command, 8 dummy clocks follow the address */
+  cmd[0] = READ_SFDP_CMD;
+  cmd[1] = (uint8_t)(ReadAddr >> 16);
+  cmd[2] = (uint8_t)(ReadAddr >> 8);
+  cmd[3] = (uint8_t)(ReadAddr);
+  cmd[4] = 0x00;
+
+  SPI_FLASH_EN();
+  W25Qx_SPI_Transmit(cmd, 5, W25QXXXX_TIMEOUT_VALUE);
+  if (W25Qx_SPI_Receive(pData, Size, W25QXXXX_TIMEOUT_VALUE) != 0U)
+  {
+    result = W25Qx_ERROR;
+  }
+  SPI_FLASH_DIS();
+
+  return result;
+}
+
 #include <math.h>
 /**
   * @brief  Get W25QX Parameter.
@@ -42,6 +42,7 @@
 #define DUAL_READ_ID_CMD                     0x92
 #define QUAD_READ_ID_CMD                     0x94
 #define READ_JEDEC_ID_CMD                    0x9F
+#define READ_SFDP_CMD                        0x5A
 
 /* Read Operations */
 #define READ_CMD                             0x03
@@ -108,6 +109,7 @@ uint32_t  W25Qx_GetTick(void);
 uint8_t   W25Qx_Init(void);
 uint8_t   W25Qx_WriteEnable(void);
 void      W25Qx_Read_ID(uint16_t *ID);
+uint8_t   W25Qx_ReadSFDP(uint32_t ReadAddr, uint8_t* pData, uint32_t Size);
 uint8_t   W25Qx_Read(uint8_t* pData, uint32_t ReadAddr, uint32_t Size);
 uint8_t   W25Qx_WriteNoCheck(uint8_t* pData, uint32_t WriteAddr, uint32_t Size);
 uint8_t   W25Qx_Write(uint8_t* pData, uint32_t WriteAddr, uint32_t Size);
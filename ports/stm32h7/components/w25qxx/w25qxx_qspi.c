@@ -3,7 +3,7 @@
 
 extern QSPI_HandleTypeDef _qspi_flash;
 
-static uint32_t QSPI_EnableMemoryMappedMode(QSPI_HandleTypeDef *hqspi,uint8_t DTRMode);
+static uint32_t QSPI_EnableMemoryMappedMode(QSPI_HandleTypeDef *hqspi,uint8_t DTRMode,uint8_t Continuous);
 static uint32_t QSPI_ResetDevice(QSPI_HandleTypeDef *hqspi);
 static uint8_t QSPI_EnterQPI(QSPI_HandleTypeDef *hqspi);
 static uint32_t QSPI_AutoPollingMemReady(QSPI_HandleTypeDef *hqspi, uint32_t Timeout);
@@ -45,6 +45,25 @@ uint16_t w25qxx_GetID(void)
   return deviceID;
 }
 
+// Read the SFDP (JESD216) tables, only available in SPI mode
+uint8_t w25qxx_ReadSFDP(uint32_t addr, uint8_t *pData, uint32_t Size)
+{
+  if(w25qxx_Mode != w25qxx_SPIMode)
+    return w25qxx_ERROR;
+
+  if (QSPI_Send_CMD(&_qspi_flash,W25X_ReadSFDP,addr,QSPI_ADDRESS_24_BITS,8,QSPI_INSTRUCTION_1_LINE,QSPI_ADDRESS_1_LINE, QSPI_DATA_1_LINE, Size) != w25qxx_OK)
+  {
+    return w25qxx_ERROR;
+  }
+
+  if (HAL_QSPI_Receive(&_qspi_flash, pData, HAL_QPSI_TIMEOUT_DEFAULT_VALUE) != HAL_OK)
+  {
+    return w25qxx_ERROR;
+  }
+
+  return w25qxx_OK;
+}
+
 uint8_t w25qxx_ReadSR(uint8_t SR)
 {
   uint8_t byte=0;
@@ -116,7 +135,35 @@ uint8_t w25qxx_EnterQPI(void)
 uint8_t w25qxx_Startup(uint8_t DTRMode)
 {
   /* Enable MemoryMapped mode */
-  if( QSPI_EnableMemoryMappedMode(&_qspi_flash,DTRMode) != w25qxx_OK )
+  if( QSPI_EnableMemoryMappedMode(&_qspi_flash,DTRMode,1) != w25qxx_OK )
+  {
+    return w25qxx_ERROR;
+  }
+  return w25qxx_OK;
+}
+
+/**
+  * @brief  Enable memory-mapped reads that can be left again with w25qxx_ExitMemoryMapped().
+  *         Instruction is sent for every access, continuous read mode is not entered.
+  * @param  DTRMode: w25qxx_DTRMode DTR mode ,w25qxx_NormalMode Normal mode
+  * @retval QSPI memory status
+  */
+uint8_t w25qxx_MemoryMapped(uint8_t DTRMode)
+{
+  if( QSPI_EnableMemoryMappedMode(&_qspi_flash,DTRMode,0) != w25qxx_OK )
+  {
+    return w25qxx_ERROR;
+  }
+  return w25qxx_OK;
+}
+
+/**
+  * @brief  Abort memory-mapped mode, back to indirect mode for erase/program.
+  * @retval QSPI memory status
+  */
+uint8_t w25qxx_ExitMemoryMapped(void)
+{
+  if (HAL_QSPI_Abort(&_qspi_flash) != HAL_OK)
   {
     return w25qxx_ERROR;
   }
@@ -136,19 +183,74 @@ uint8_t W25qxx_EraseSector(uint32_t SectorAddress)
 {
   uint8_t result;
 
+  result = W25qxx_EraseSectorStart(SectorAddress);
+
+  /* 等待擦除完成 */
+  if(result == w25qxx_OK)
+    W25QXX_Wait_Busy();
+
+  return result;
+}
+
+/**
+  * @brief  Start erasing 4KB Sector without waiting, poll W25qxx_IsBusy() for completion.
+  * @param  SectorAddress: Sector address to erase
+  * @retval QSPI memory status
+  */
+uint8_t W25qxx_EraseSectorStart(uint32_t SectorAddress)
+{
+  return W25qxx_EraseStart(W25X_SectorErase, SectorAddress);
+}
+
+/**
+  * @brief  Start erase with given opcode (e.g from SFDP erase types) without waiting.
+  * @param  EraseCmd: erase instruction
+  * @param  Address: address within the sector/block to erase
+  * @retval QSPI memory status
+  */
+uint8_t W25qxx_EraseStart(uint8_t EraseCmd, uint32_t Address)
+{
   W25qxx_WriteEnable();
   W25QXX_Wait_Busy();
 
   if(w25qxx_Mode == w25qxx_SPIMode)
-    result = QSPI_Send_CMD(&_qspi_flash,W25X_SectorErase,SectorAddress,QSPI_ADDRESS_24_BITS,0,QSPI_INSTRUCTION_1_LINE,QSPI_ADDRESS_1_LINE,QSPI_DATA_NONE,0);
+    return QSPI_Send_CMD(&_qspi_flash,EraseCmd,Address,QSPI_ADDRESS_24_BITS,0,QSPI_INSTRUCTION_1_LINE,QSPI_ADDRESS_1_LINE,QSPI_DATA_NONE,0);
   else
-    result = QSPI_Send_CMD(&_qspi_flash,W25X_SectorErase,SectorAddress,QSPI_ADDRESS_24_BITS,0,QSPI_INSTRUCTION_4_LINES,QSPI_ADDRESS_4_LINES,QSPI_DATA_NONE,0);
+    return QSPI_Send_CMD(&_qspi_flash,EraseCmd,Address,QSPI_ADDRESS_24_BITS,0,QSPI_INSTRUCTION_4_LINES,QSPI_ADDRESS_4_LINES,QSPI_DATA_NONE,0);
+}
 
-  /* 等待擦除完成 */
-  if(result == w25qxx_OK)
-    W25QXX_Wait_Busy();
+/**
+  * @brief  Erase or program in progress, cleared once suspended.
+  * @retval 1 if busy
+  */
+uint8_t W25qxx_IsBusy(void)
+{
+  return (w25qxx_ReadSR(W25X_ReadStatusReg1) & 0x01) ? 1 : 0;
+}
 
-  return result;
+/**
+  * @brief  Suspend sector/block erase. Sectors other than the one being erased can be read
+  *         once W25qxx_IsBusy() returns 0, erase continues with W25qxx_EraseResume().
+  * @retval QSPI memory status
+  */
+uint8_t W25qxx_EraseSuspend(void)
+{
+  if(w25qxx_Mode == w25qxx_SPIMode)
+    return QSPI_Send_CMD(&_qspi_flash,W25X_EraseSuspend,0x00,QSPI_ADDRESS_8_BITS,0,QSPI_INSTRUCTION_1_LINE,QSPI_ADDRESS_NONE,QSPI_DATA_NONE,0);
+  else
+    return QSPI_Send_CMD(&_qspi_flash,W25X_EraseSuspend,0x00,QSPI_ADDRESS_8_BITS,0,QSPI_INSTRUCTION_4_LINES,QSPI_ADDRESS_NONE,QSPI_DATA_NONE,0);
+}
+
+/**
+  * @brief  Resume suspended erase, ignored by the flash if not suspended.
+  * @retval QSPI memory status
+  */
+uint8_t W25qxx_EraseResume(void)
+{
+  if(w25qxx_Mode == w25qxx_SPIMode)
+    return QSPI_Send_CMD(&_qspi_flash,W25X_EraseResume,0x00,QSPI_ADDRESS_8_BITS,0,QSPI_INSTRUCTION_1_LINE,QSPI_ADDRESS_NONE,QSPI_DATA_NONE,0);
+  else
+    return QSPI_Send_CMD(&_qspi_flash,W25X_EraseResume,0x00,QSPI_ADDRESS_8_BITS,0,QSPI_INSTRUCTION_4_LINES,QSPI_ADDRESS_NONE,QSPI_DATA_NONE,0);
 }
 
 /**
@@ -285,7 +387,7 @@ uint8_t W25qxx_Read(uint8_t *pData, uint32_t ReadAddr, uint32_t Size)
 //WriteAddr:开始写入的地址(最大32bit)
 //NumByteToWrite:要写入的字节数(最大65535)
 //CHECK OK
-void W25qxx_WriteNoCheck(uint8_t *pBuffer,uint32_t WriteAddr,uint32_t NumByteToWrite)
+uint8_t W25qxx_WriteNoCheck(uint8_t *pBuffer,uint32_t WriteAddr,uint32_t NumByteToWrite)
 {
   uint16_t pageremain;
   pageremain = 256 - WriteAddr % 256; //单页剩余的字节数
@@ -295,7 +397,10 @@ void W25qxx_WriteNoCheck(uint8_t *pBuffer,uint32_t WriteAddr,uint32_t NumByteToW
   }
   while(1)
   {
-    W25qxx_PageProgram(pBuffer, WriteAddr, pageremain);
+    if (W25qxx_PageProgram(pBuffer, WriteAddr, pageremain) != w25qxx_OK)
+    {
+      return w25qxx_ERROR;
+    }
     if (NumByteToWrite == pageremain)
     {
       break; //写入结束了
@@ -312,6 +417,7 @@ void W25qxx_WriteNoCheck(uint8_t *pBuffer,uint32_t WriteAddr,uint32_t NumByteToW
         pageremain = NumByteToWrite; //不够256个字节了
     }
   }
+  return w25qxx_OK;
 }
 
 //写SPI FLASH
@@ -344,18 +450,22 @@ uint8_t W25qxx_Write(uint8_t* pBuffer, uint32_t WriteAddr, uint16_t NumByteToWri
     }
     if (i < secremain) //需要擦除
     {
-      if (W25qxx_EraseSector(secpos) != w25qxx_OK) {
+      if (W25qxx_EraseSector(secpos * 4096) != w25qxx_OK) {
         return w25qxx_ERROR;
       } //擦除这个扇区
       for (i = 0; i < secremain; i++) //复制
       {
         W25QXX_BUF[i + secoff] = pBuffer[i];
       }
-      W25qxx_WriteNoCheck(W25QXX_BUF, secpos * 4096, 4096); //写入整个扇区
+      if (W25qxx_WriteNoCheck(W25QXX_BUF, secpos * 4096, 4096) != w25qxx_OK) {
+        return w25qxx_ERROR;
+      } //写入整个扇区
     }
     else
     {
-      W25qxx_WriteNoCheck(pBuffer, WriteAddr, secremain); //写已经擦除了的,直接写入扇区剩余区间.
+      if (W25qxx_WriteNoCheck(pBuffer, WriteAddr, secremain) != w25qxx_OK) {
+        return w25qxx_ERROR;
+      } //写已经擦除了的,直接写入扇区剩余区间.
     }
     if (NumByteToWrite == secremain)
     {
@@ -382,9 +492,10 @@ uint8_t W25qxx_Write(uint8_t* pBuffer, uint32_t WriteAddr, uint16_t NumByteToWri
   * @brief  Configure the QSPI in memory-mapped mode   QPI/SPI && DTR(DDR)/Normal Mode
   * @param  hqspi: QSPI handle
   * @param  DTRMode: w25qxx_DTRMode DTR mode ,w25qxx_NormalMode Normal mode
+  * @param  Continuous: enter continuous read mode, flash then only responds to reads until reset
   * @retval QSPI memory status
   */
-static uint32_t QSPI_EnableMemoryMappedMode(QSPI_HandleTypeDef *hqspi,uint8_t DTRMode)
+static uint32_t QSPI_EnableMemoryMappedMode(QSPI_HandleTypeDef *hqspi,uint8_t DTRMode,uint8_t Continuous)
 {
   QSPI_CommandTypeDef      s_command;
   QSPI_MemoryMappedTypeDef s_mem_mapped_cfg;
@@ -400,7 +511,7 @@ static uint32_t QSPI_EnableMemoryMappedMode(QSPI_HandleTypeDef *hqspi,uint8_t DT
   s_command.AddressSize       = QSPI_ADDRESS_24_BITS;
 
   s_command.AlternateByteMode = QSPI_ALTERNATE_BYTES_4_LINES;
-  s_command.AlternateBytes    = 0xEF;
+  s_command.AlternateBytes    = Continuous ? 0xEF : 0xFF; // M5-4 = 10b enables continuous read
   s_command.AlternateBytesSize = QSPI_ALTERNATE_BYTES_8_BITS;
 
   s_command.DataMode          = QSPI_DATA_4_LINES;
@@ -424,7 +535,7 @@ static uint32_t QSPI_EnableMemoryMappedMode(QSPI_HandleTypeDef *hqspi,uint8_t DT
   }
 
   s_command.DdrHoldHalfCycle  = QSPI_DDR_HHC_ANALOG_DELAY;
-  s_command.SIOOMode          = QSPI_SIOO_INST_ONLY_FIRST_CMD;
+  s_command.SIOOMode          = Continuous ? QSPI_SIOO_INST_ONLY_FIRST_CMD : QSPI_SIOO_INST_EVERY_CMD;
 
   /* Configure the memory mapped mode */
   s_mem_mapped_cfg.TimeOutActivation = QSPI_TIMEOUT_COUNTER_DISABLE;
@@ -38,11 +38,14 @@ typedef enum
 #define W25X_BlockErase          0xD8
 #define W25X_SectorErase         0x20
 #define W25X_ChipErase           0xC7
+#define W25X_EraseSuspend        0x75
+#define W25X_EraseResume         0x7A
 #define W25X_PowerDown           0xB9
 #define W25X_ReleasePowerDown    0xAB
 #define W25X_DeviceID            0xAB
 #define W25X_ManufactDeviceID    0x90
 #define W25X_JedecDeviceID       0x9F
+#define W25X_ReadSFDP            0x5A
 #define W25X_Enable4ByteAddr     0xB7
 #define W25X_Exit4ByteAddr       0xE9
 #define W25X_SetReadParam        0xC0
@@ -78,19 +81,27 @@ typedef enum
 
 void      w25qxx_Init(void);
 uint16_t  w25qxx_GetID(void);
+uint8_t   w25qxx_ReadSFDP(uint32_t addr, uint8_t *pData, uint32_t Size);
 uint8_t   w25qxx_ReadAllStatusReg(void);
 uint8_t   w25qxx_ReadSR(uint8_t SR);
 uint8_t   w25qxx_WriteSR(uint8_t SR,uint8_t data);
 uint8_t   w25qxx_SetReadParameters(uint8_t DummyClock,uint8_t WrapLenth);
 uint8_t   w25qxx_EnterQPI(void);
 uint8_t   w25qxx_Startup(uint8_t DTRMode);
+uint8_t   w25qxx_MemoryMapped(uint8_t DTRMode);
+uint8_t   w25qxx_ExitMemoryMapped(void);
 uint8_t   W25qxx_WriteEnable(void);
 uint8_t   W25qxx_EraseSector(uint32_t SectorAddress);
+uint8_t   W25qxx_EraseSectorStart(uint32_t SectorAddress);
+uint8_t   W25qxx_EraseStart(uint8_t EraseCmd, uint32_t Address);
+uint8_t   W25qxx_IsBusy(void);
+uint8_t   W25qxx_EraseSuspend(void);
+uint8_t   W25qxx_EraseResume(void);
 uint8_t   W25qxx_EraseBlock(uint32_t BlockAddress);
 uint8_t   W25qxx_EraseChip(void);
 uint8_t   W25qxx_PageProgram(uint8_t *pData, uint32_t WriteAddr, uint32_t Size);
 uint8_t   W25qxx_Read(uint8_t *pData, uint32_t ReadAddr, uint32_t Size);
-void      W25qxx_WriteNoCheck(uint8_t *pBuffer,uint32_t WriteAddr,uint32_t NumByteToWrite);
+uint8_t   W25qxx_WriteNoCheck(uint8_t *pBuffer,uint32_t WriteAddr,uint32_t NumByteToWrite);
 uint8_t     W25qxx_Write(uint8_t* pBuffer, uint32_t WriteAddr, uint16_t NumByteToWrite);
 
 #ifdef __cplusplus
@@ -26,6 +26,7 @@ LD_FILES ?= $(PORT_DIR)/linker/stm32l4.ld
 SRC_C += \
 	ports/stm32l4/boards.c \
 	ports/stm32l4/board_flash.c \
+	ports/stm32_common/stm32_flash.c \
 	$(ST_CMSIS)/Source/Templates/system_stm32l4xx.c \
 	$(ST_HAL_DRIVER)/Src/stm32l4xx_hal.c \
 	$(ST_HAL_DRIVER)/Src/stm32l4xx_hal_cortex.c \
@@ -44,6 +45,7 @@ endif
 
 # Port include
 INC += \
+	$(TOP)/ports/stm32_common \
 	$(TOP)/$(CMSIS_5)/CMSIS/Core/Include \
 	$(TOP)/$(ST_CMSIS)/Include \
 	$(TOP)/$(ST_HAL_DRIVER)/Inc
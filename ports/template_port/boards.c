@@ -115,7 +115,8 @@ void board_flash_read(uint32_t addr, void* buffer, uint32_t len) {
   (void) len;
 }
 
-void board_flash_flush(void) {
+bool board_flash_flush(void) {
+  return true;
 }
 
 bool board_flash_write(uint32_t addr, void const* data, uint32_t len) {
@@ -0,0 +1,3 @@
+# Test inputs are in board.h
+function(update_board TARGET)
+endfunction()
@@ -0,0 +1 @@
+# Test inputs are in board.h
@@ -0,0 +1,191 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "board.h"
+
+// Native self-test: compress test patterns with deflate_zlib() and check that zlib inflates them
+// back to the input. Output size must be the same for the size-only and the streaming pass.
+
+static uint8_t _src[DEFLATE_MAX_INPUT];
+static uint8_t _zbuf[2 * DEFLATE_MAX_INPUT + 64];
+static uint8_t _out[DEFLATE_MAX_INPUT];
+
+static struct {
+    uint32_t len;
+    uint32_t calls;
+    bool     overflow;
+} _stream;
+
+static void stream_output(void* ctx, uint8_t const* data, uint32_t len)
+{
+    (void) ctx;
+    _stream.calls++;
+    if (_stream.len + len > sizeof(_zbuf)) {
+        _stream.overflow = true;
+        return;
+    }
+    memcpy(_zbuf + _stream.len, data, len);
+    _stream.len += len;
+}
+
+//--------------------------------------------------------------------+
+// Test patterns
+//--------------------------------------------------------------------+
+
+static uint32_t _seed;
+
+static uint8_t lcg_byte(void)
+{
+    _seed = _seed * 1103515245u + 12345u;
+    return (uint8_t) (_seed >> 16);
+}
+
+static void fill_zero(uint32_t len)
+{
+    memset(_src, 0, len);
+}
+
+static void fill_erased(uint32_t len)
+{
+    memset(_src, 0xFF, len);
+}
+
+// incompressible, worst case for fixed Huffman codes
+static void fill_random(uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) _src[i] = lcg_byte();
+}
+
+static void fill_text(uint32_t len)
+{
+    static char const text[] = "tinyuf2 esp32programmer deflate round-trip test, ";
+    for (uint32_t i = 0; i < len; i++) {
+        // vary some words so that matches have different lengths and distances
+        _src[i] = (i % 97 == 0) ? (uint8_t) ('A' + (i / 97) % 26) : (uint8_t) text[i % (sizeof(text) - 1)];
+    }
+}
+
+// firmware-like: instruction-ish random words, repeated tables, padding runs longer than a match
+static void fill_firmware(uint32_t len)
+{
+    uint32_t i = 0;
+    while (i < len) {
+        uint32_t const kind = lcg_byte() % 4;
+        uint32_t n = 16 + lcg_byte() * 4;
+        if (n > len - i) n = len - i;
+
+        if (kind == 0 && i > 0) {
+            // copy of earlier data, up to the full window behind
+            uint32_t const dist = 1 + ((uint32_t) lcg_byte() << 8 | lcg_byte()) % i;
+            for (uint32_t k = 0; k < n; k++, i++) _src[i] = _src[i - dist];
+        } else if (kind == 1) {
+            memset(_src + i, 0xFF, n);
+            i += n;
+        } else {
+            for (uint32_t k = 0; k < n; k++, i++) _src[i] = lcg_byte() & 0xF7;
+        }
+    }
+}
+
+static const struct {
+    char const* name;
+    void (*fill)(uint32_t len);
+} _patterns[] = {
+    { "zero",     fill_zero     },
+    { "erased",   fill_erased   },
+    { "random",   fill_random   },
+    { "text",     fill_text     },
+    { "firmware", fill_firmware },
+};
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+static int RoundTrip(char const* name, uint32_t len)
+{
+    uint32_t const zlen = deflate_zlib(_src, len, NULL, NULL);
+    if (zlen == 0) {
+        printf("  %s %lu: compression failed\n", name, (unsigned long) len);
+        return 1;
+    }
+
+    memset(&_stream, 0, sizeof(_stream));
+    uint32_t const zlen2 = deflate_zlib(_src, len, stream_output, NULL);
+    if (_stream.overflow || zlen2 != zlen || _stream.len != zlen) {
+        printf("  %s %lu: size pass %lu, streaming pass returned %lu and output %lu bytes\n", name, (unsigned long) len,
+               (unsigned long) zlen, (unsigned long) zlen2, (unsigned long) _stream.len);
+        return 1;
+    }
+
+    uLongf out_len = sizeof(_out);
+    int const rc = uncompress(_out, &out_len, _zbuf, zlen);
+    if (rc != Z_OK || out_len != len || memcmp(_out, _src, len)) {
+        printf("  %s %lu: inflate failed (%d), got %lu bytes\n", name, (unsigned long) len, rc, (unsigned long) out_len);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int CheckTooLong(void)
+{
+    if (deflate_zlib(_src, DEFLATE_MAX_INPUT + 1, NULL, NULL) != 0) {
+        printf("  input longer than DEFLATE_MAX_INPUT accepted\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const uint32_t sizes[] = TEST_STREAM_SIZES;
+    int errors = 0;
+
+    for (size_t p = 0; p < sizeof(_patterns) / sizeof(_patterns[0]); p++) {
+        printf("round-trip %s\n", _patterns[p].name); fflush(stdout);
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            _seed = (uint32_t) (p * 1000 + s);
+            _patterns[p].fill(sizes[s]);
+            errors += RoundTrip(_patterns[p].name, sizes[s]);
+        }
+    }
+
+    printf("checking input limit\n"); fflush(stdout);
+    errors += CheckTooLong();
+
+    if (errors) {
+        printf("FAIL: %d stream(s) failed\n", errors);
+        return 1;
+    }
+
+    printf("PASS: deflate round-trip validation completed successfully.\n");
+    return 0;
+}
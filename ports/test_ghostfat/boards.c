@@ -26,8 +26,31 @@
 //------------- Flash -------------//
 uint32_t board_flash_size(void) { return CFG_UF2_FLASH_SIZE; }
 
+#if TINYUF2_APP_CHECK
+// descriptor sector is the only writable flash, see CheckAppCheck(). Like stm32 ports it is erased
+// by its first write only, later writes fail unless they program erased bytes
+static uint8_t _app_check_desc[64];
+static bool _app_check_erased;
+
+bool board_flash_erase_sector(uint32_t addr) {
+  if (addr != BOARD_FLASH_APP_CHECK_ADDR) return false;
+  memset(_app_check_desc, 0xff, sizeof(_app_check_desc));
+  _app_check_erased = true;
+  return true;
+}
+#endif
+
 // not supported
 bool board_flash_write(uint32_t addr, void const* data, uint32_t len) {
+#if TINYUF2_APP_CHECK
+  if (addr == BOARD_FLASH_APP_CHECK_ADDR && len <= sizeof(_app_check_desc)) {
+    if (!_app_check_erased) board_flash_erase_sector(addr);
+    for (uint32_t i = 0; i < len; i++) {
+      if (_app_check_desc[i] != 0xff) return false;
+    }
+    memcpy(_app_check_desc, data, len);
+  }
+#endif
   (void) addr;
   (void) data;
   (void) len;
@@ -41,7 +64,17 @@ void board_self_update(const uint8_t* bootloader_bin, uint32_t bootloader_len) {
 }
 
 // not supported
-void board_flash_flush(void) {}
+bool board_flash_flush(void) { return true; }
+
+//------------- RAM run -------------//
+bool board_ram_run_range(uint32_t addr, uint32_t len) {
+  return (addr >= TEST_RAM_RUN_ADDR) && (addr + len <= TEST_RAM_RUN_ADDR + TEST_RAM_RUN_SIZE);
+}
+
+// not supported
+void board_ram_run(uint32_t addr) {
+  (void) addr;
+}
 
 // not supported
 bool board_flash_protect_bootloader(bool protect) {
@@ -57,6 +90,13 @@ void board_flash_read(uint32_t addr, void* buffer, uint32_t len) {
     addr += 8 - (addr & 7);
   }
 
+#if TINYUF2_APP_CHECK
+  if (addr == BOARD_FLASH_APP_CHECK_ADDR && len <= sizeof(_app_check_desc)) {
+    memcpy(buffer, _app_check_desc, len);
+    return;
+  }
+#endif
+
   // EMBED address in each 32 bits of the FLASH
   uint32_t* dest = buffer;
   size_t incBytes = sizeof(*dest);
@@ -70,3 +110,22 @@ void board_flash_read(uint32_t addr, void* buffer, uint32_t len) {
     currentAddress += incBytes;
   }
 }
+
+#if CFG_UF2_REGION_MAX
+// enough regions to spill the root directory into a second sector
+static board_flash_region_t const _regions[] = {
+  { .name = "REGION0" , .addr = 0x10000000, .size = 64*1024 },
+  { .name = "REGION1" , .addr = 0x10010000, .size = 64*1024 },
+  { .name = "REGION2" , .addr = 0x10020000, .size = 64*1024 },
+  { .name = "REGION3" , .addr = 0x10030000, .size = 64*1024 },
+  { .name = "REGION4" , .addr = 0x20000000, .size = 16*1024 },
+  { .name = "REGION5" , .addr = 0x20004000, .size = 16*1024 },
+  { .name = "REGION6" , .addr = 0x30000000, .size = 1024    },
+  { .name = "LONGNAME9", .addr = 0x40000000, .size = 256*1024 },
+};
+
+uint32_t board_flash_get_regions(board_flash_region_t const** regions) {
+  *regions = _regions;
+  return sizeof(_regions) / sizeof(_regions[0]);
+}
+#endif
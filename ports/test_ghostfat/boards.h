@@ -17,6 +17,10 @@
 // From board_api.h
 #define BOARD_FLASH_APP_START  0
 
+// RAM window accepted for RAM run sessions
+#define TEST_RAM_RUN_ADDR  0x38000000
+#define TEST_RAM_RUN_SIZE  (64*1024)
+
 #ifdef __cplusplus
  }
 #endif
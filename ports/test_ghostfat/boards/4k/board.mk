@@ -1,4 +1,5 @@
 CFLAGS += \
   -DCFG_UF2_SECTORS_PER_CLUSTER=8 \
+  -DCFG_UF2_OVERLAY_SECTORS=4 \
   -DCOMPILE_DATE=\"Mar\ 11\ 2020\" \
   -DCOMPILE_TIME=\"17:35:07\"
@@ -0,0 +1,7 @@
+CFLAGS += \
+  -DCFG_UF2_SECTORS_PER_CLUSTER=8 \
+  -DCFG_UF2_OVERLAY_SECTORS=4 \
+  -DTINYUF2_APP_CHECK=1 \
+  -DBOARD_FLASH_APP_CHECK_ADDR=0x3FF000 \
+  -DCOMPILE_DATE=\"Mar\ 11\ 2020\" \
+  -DCOMPILE_TIME=\"17:35:07\"
@@ -0,0 +1,5 @@
+CFLAGS += \
+  -DCFG_UF2_SECTORS_PER_CLUSTER=8 \
+  -DCFG_UF2_REGION_MAX=8 \
+  -DCOMPILE_DATE=\"Mar\ 11\ 2020\" \
+  -DCOMPILE_TIME=\"17:35:07\"
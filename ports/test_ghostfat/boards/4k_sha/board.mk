@@ -0,0 +1,6 @@
+CFLAGS += \
+  -DCFG_UF2_SECTORS_PER_CLUSTER=8 \
+  -DCFG_UF2_SHA_FILE=1 \
+  -DCFG_UF2_SHA_SECTOR_SIZE=0x10000 \
+  -DCOMPILE_DATE=\"Mar\ 11\ 2020\" \
+  -DCOMPILE_TIME=\"17:35:07\"
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""
+Regenerate CURRENT.SHA in a test_ghostfat known good image, independent of ghostfat.c.
+
+The flash of test_ghostfat board holds its own address in each 32-bit little endian word,
+hashes are computed here with zlib/hashlib and the file is located with a minimal FAT16 parser.
+
+usage: gen_sha_golden.py <board dir> [--check]
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import struct
+import sys
+import zlib
+
+
+def board_config(board_dir):
+    cfg = {'CFG_UF2_FLASH_SIZE': 4 * 1024 * 1024, 'BOARD_FLASH_APP_START': 0, 'CFG_UF2_SHA_SECTOR_SIZE': 0}
+    with open(os.path.join(board_dir, 'board.mk')) as f:
+        for name, value in re.findall(r'-D(\w+)=(\w+)', f.read()):
+            if name in cfg:
+                cfg[name] = int(value, 0)
+    return cfg
+
+
+def flash_contents(start, size):
+    return b''.join(struct.pack('<I', addr) for addr in range(start, start + size, 4))
+
+
+def sha_file(cfg, sector_size):
+    start = cfg['BOARD_FLASH_APP_START']
+    region = flash_contents(start, cfg['CFG_UF2_FLASH_SIZE'] - start)
+    image = region.rstrip(b'\xff')
+
+    txt = 'Size: %08X\r\n' % len(image)
+    txt += 'CRC32: %08X\r\n' % zlib.crc32(image)
+    txt += 'SHA256: %s\r\n' % hashlib.sha256(image).hexdigest().upper()
+
+    sha_sector = cfg['CFG_UF2_SHA_SECTOR_SIZE']
+    if not sha_sector:
+        return txt.encode()
+
+    txt += 'Sector-Size: %08X\r\n' % sha_sector
+    txt = txt.ljust(sector_size - 2) + '\r\n'
+    for off in range(0, len(region), sha_sector):
+        line = '%08X %08X' % (start + off, zlib.crc32(region[off:off + sha_sector]))
+        txt += line.ljust(30) + '\r\n'
+    return txt.encode()
+
+
+def find_file(img, name):
+    """Return list of byte offsets of the clusters of a root directory file and its size"""
+    bytes_per_sector, sectors_per_cluster, reserved, num_fats, root_entries = struct.unpack_from('<HBHBH', img, 11)
+    sectors_per_fat = struct.unpack_from('<H', img, 22)[0]
+
+    fat = reserved * bytes_per_sector
+    root = (reserved + num_fats * sectors_per_fat) * bytes_per_sector
+    data = root + root_entries * 32
+    cluster_size = sectors_per_cluster * bytes_per_sector
+
+    for i in range(root_entries):
+        entry = img[root + i * 32: root + (i + 1) * 32]
+        if entry[0] == 0:
+            break
+        if entry[11] == 0x0f or entry[0:11] != name:
+            continue
+
+        cluster = struct.unpack_from('<H', entry, 26)[0]
+        size = struct.unpack_from('<I', entry, 28)[0]
+        clusters = []
+        while 2 <= cluster < 0xfff8:
+            clusters.append(data + (cluster - 2) * cluster_size)
+            cluster = struct.unpack_from('<H', img, fat + cluster * 2)[0]
+        return clusters, cluster_size, size, bytes_per_sector
+
+    sys.exit('%s not found in root directory' % name.decode())
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    board_dir = sys.argv[1]
+    check = '--check' in sys.argv[2:]
+    golden = os.path.join(board_dir, 'knowngood.img.gz.gz')
+
+    with open(golden, 'rb') as f:
+        img = bytearray(gzip.decompress(gzip.decompress(f.read())))
+
+    clusters, cluster_size, size, sector_size = find_file(img, b'CURRENT SHA')
+    content = sha_file(board_config(board_dir), sector_size)
+    if size != len(content):
+        sys.exit('CURRENT.SHA size mismatch: directory %u, expected %u' % (size, len(content)))
+
+    # file contents followed by zero padding up to end of last cluster
+    content = content.ljust(len(clusters) * cluster_size, b'\0')
+    patched = bytearray(img)
+    for i, off in enumerate(clusters):
+        patched[off:off + cluster_size] = content[i * cluster_size:(i + 1) * cluster_size]
+
+    if check:
+        if patched != img:
+            sys.exit('CURRENT.SHA in %s does not match' % golden)
+        print('CURRENT.SHA in %s matches' % golden)
+        return
+
+    with open(golden, 'wb') as f:
+        f.write(gzip.compress(gzip.compress(bytes(patched), mtime=0), mtime=0))
+    print('updated %s' % golden)
+
+
+if __name__ == '__main__':
+    main()
@@ -1,5 +1,10 @@
 #include "boards.h"
 #include <inttypes.h>
+#include "checksum.h"
+
+#if TINYUF2_APP_CHECK
+#include "app_check.h"
+#endif
 
 #ifndef COMPILE_DATE
   #error "Reproducible build requirement - COMPILE_DATE"
@@ -29,6 +34,9 @@ typedef enum {
     ERR_CANNOT_SEEK_TO_FILE_START = -11,
     ERR_NOT_YET_IMPLEMENTED = -12,
     ERR_INTERNAL_ERROR = -13,
+    ERR_OVERLAY_MISMATCH = -14,
+    ERR_RAM_RUN_MISMATCH = -15,
+    ERR_APP_CHECK_MISMATCH = -16,
 } ErrorType;
 
 const char * GetErrorString(ErrorType e)
@@ -47,6 +55,9 @@ const char * GetErrorString(ErrorType e)
     if (e == ERR_CANNOT_SEEK_TO_FILE_START) { return "CANNOT_SEEK_TO_FILE_START"; }
     if (e == ERR_NOT_YET_IMPLEMENTED) { return "NOT_YET_IMPLEMENTED"; }
     if (e == ERR_INTERNAL_ERROR) { return "INTERNAL_ERROR"; }
+    if (e == ERR_OVERLAY_MISMATCH) { return "OVERLAY_MISMATCH"; }
+    if (e == ERR_RAM_RUN_MISMATCH) { return "RAM_RUN_MISMATCH"; }
+    if (e == ERR_APP_CHECK_MISMATCH) { return "APP_CHECK_MISMATCH"; }
     return "Unknown error ... code update required";
 }
 
@@ -336,7 +347,10 @@ int DumpDiskImage(void) {
 
     for (uint32_t i = 0; i < countOfSectors_UF2; i++) {
         memset(singleSectorBuffer, 0xAA, GHOSTFAT_SECTOR_SIZE); // TODO: make this be random data...
-        uf2_read_block(i, singleSectorBuffer);
+        // generated contents (e.g CURRENT.SHA) may need background work before it can be read
+        while (!uf2_read_block(i, singleSectorBuffer)) {
+            uf2_task();
+        }
         size_t written = fwrite (singleSectorBuffer, 1, GHOSTFAT_SECTOR_SIZE, file );
         if (written != GHOSTFAT_SECTOR_SIZE) {
             return ERR_FAILED_WRITE_FILE;
@@ -349,6 +363,130 @@ int DumpDiskImage(void) {
     return ERR_NONE;
 }
 
+// Non-UF2 sectors written by host (e.g. FAT, directory entries) must read back
+// identically until reset, while UF2 blocks are still handled as firmware.
+int CheckWriteOverlay(void) {
+#if CFG_UF2_OVERLAY_SECTORS
+    static WriteState state;
+
+    // sector 1 is the first FAT sector
+    for (uint32_t i = 0; i < GHOSTFAT_SECTOR_SIZE; i++) {
+        anotherSectorBuffer[i] = (uint8_t) (i * 7);
+    }
+    memcpy(singleSectorBuffer, anotherSectorBuffer, GHOSTFAT_SECTOR_SIZE);
+    if (uf2_write_block(1, singleSectorBuffer, &state) != -1) {
+        return ERR_OVERLAY_MISMATCH;
+    }
+
+    memset(singleSectorBuffer, 0xAA, GHOSTFAT_SECTOR_SIZE);
+    uf2_read_block(1, singleSectorBuffer);
+    if (memcmp(singleSectorBuffer, anotherSectorBuffer, GHOSTFAT_SECTOR_SIZE)) {
+        printf("FAIL: overlay sector does not read back as written\n");
+        DumpBuffer(GHOSTFAT_SECTOR_SIZE, singleSectorBuffer, GHOSTFAT_SECTOR_SIZE);
+        return ERR_OVERLAY_MISMATCH;
+    }
+
+    // other sectors are not affected
+    uf2_read_block(0, singleSectorBuffer);
+    if (singleSectorBuffer[510] != 0x55 || singleSectorBuffer[511] != 0xAA) {
+        return ERR_OVERLAY_MISMATCH;
+    }
+
+    // fill remaining slots with data region sectors, then the next one must be rejected
+    uint32_t const data_sector = 1000;
+    for (uint32_t i = 0; i < CFG_UF2_OVERLAY_SECTORS; i++) {
+        int const expected = (i < CFG_UF2_OVERLAY_SECTORS - 1) ? -1 : -2;
+        memset(singleSectorBuffer, (int) i, GHOSTFAT_SECTOR_SIZE);
+        if (uf2_write_block(data_sector + i, singleSectorBuffer, &state) != expected) {
+            printf("FAIL: overlay sector %u not handled as expected when full\n", (unsigned) (data_sector + i));
+            return ERR_OVERLAY_MISMATCH;
+        }
+    }
+
+    // file system metadata still replaces a data region sector
+    memset(singleSectorBuffer, 0x5A, GHOSTFAT_SECTOR_SIZE);
+    if (uf2_write_block(2, singleSectorBuffer, &state) != -1) {
+        return ERR_OVERLAY_MISMATCH;
+    }
+#endif
+    return ERR_NONE;
+}
+
+static void WriteTestBlock(WriteState * state, uint32_t blockNo, uint32_t numBlocks, uint32_t targetAddr) {
+    UF2_Block * bl = (UF2_Block *) singleSectorBuffer;
+    memset(singleSectorBuffer, 0, GHOSTFAT_SECTOR_SIZE);
+    bl->magicStart0 = UF2_MAGIC_START0;
+    bl->magicStart1 = UF2_MAGIC_START1;
+    bl->magicEnd    = UF2_MAGIC_END;
+    bl->flags       = UF2_FLAG_FAMILYID;
+    bl->familyID    = BOARD_UF2_FAMILY_ID;
+    bl->targetAddr  = targetAddr;
+    bl->payloadSize = 256;
+    bl->blockNo     = blockNo;
+    bl->numBlocks   = numBlocks;
+    uf2_write_block(100 + blockNo, singleSectorBuffer, state);
+}
+
+// A UF2 file is a RAM run session only if all its blocks target RAM
+int CheckRamRun(void) {
+    static WriteState ramState;
+    static WriteState mixedState;
+
+    // out of order, start address is the lowest one
+    WriteTestBlock(&ramState, 1, 2, TEST_RAM_RUN_ADDR + 256);
+    WriteTestBlock(&ramState, 0, 2, TEST_RAM_RUN_ADDR);
+    if (!ramState.ramRun || ramState.flashWritten || ramState.ramRunAddr != TEST_RAM_RUN_ADDR ||
+        ramState.numWritten != 2) {
+        return ERR_RAM_RUN_MISMATCH;
+    }
+
+    WriteTestBlock(&mixedState, 0, 2, TEST_RAM_RUN_ADDR);
+    WriteTestBlock(&mixedState, 1, 2, 0x00001000);
+    if (!mixedState.flashWritten) {
+        return ERR_RAM_RUN_MISMATCH;
+    }
+
+    return ERR_NONE;
+}
+
+// Descriptor of previous image is cleared by the first block of a new one, and the new image is
+// recorded by uf2_task() after its last block rather than in the write callback
+int CheckAppCheck(void) {
+#if TINYUF2_APP_CHECK
+    static WriteState state;
+    app_check_desc_t desc;
+
+    uf2_task(); // image completed by earlier checks
+    app_check_record(0x10000, 4096);
+
+    WriteTestBlock(&state, 0, 2, BOARD_FLASH_APP_START);
+    board_flash_read(BOARD_FLASH_APP_CHECK_ADDR, &desc, sizeof(desc));
+    if (desc.magic == APP_CHECK_MAGIC) {
+        printf("FAIL: descriptor of previous image kept while writing\n");
+        return ERR_APP_CHECK_MISMATCH;
+    }
+
+    WriteTestBlock(&state, 1, 2, BOARD_FLASH_APP_START + 256);
+    board_flash_read(BOARD_FLASH_APP_CHECK_ADDR, &desc, sizeof(desc));
+    if (desc.magic == APP_CHECK_MAGIC) {
+        printf("FAIL: descriptor recorded in write callback\n");
+        return ERR_APP_CHECK_MISMATCH;
+    }
+
+    uf2_task();
+    board_flash_read(BOARD_FLASH_APP_CHECK_ADDR, &desc, sizeof(desc));
+
+    uint8_t image[512];
+    board_flash_read(BOARD_FLASH_APP_START, image, sizeof(image));
+    if (desc.magic != APP_CHECK_MAGIC || desc.addr != BOARD_FLASH_APP_START || desc.len != sizeof(image) ||
+        desc.crc32 != tuf2_crc32(0, image, sizeof(image)) || !app_check_valid()) {
+        printf("FAIL: descriptor not recorded for complete image\n");
+        return ERR_APP_CHECK_MISMATCH;
+    }
+#endif
+    return ERR_NONE;
+}
+
 int main(void)
 {
     int r;
@@ -364,6 +502,18 @@ int main(void)
     r = CompareDiskImages();
     if (r) { goto errorExit; }
 
+    printf("checking write overlay\n"); fflush(stdout);
+    r = CheckWriteOverlay();
+    if (r) { goto errorExit; }
+
+    printf("checking RAM run session\n"); fflush(stdout);
+    r = CheckRamRun();
+    if (r) { goto errorExit; }
+
+    printf("checking application image check\n"); fflush(stdout);
+    r = CheckAppCheck();
+    if (r) { goto errorExit; }
+
     printf("PASS: Ghostfat generation validation completed successfully.\n");
     return ERR_NONE;
 
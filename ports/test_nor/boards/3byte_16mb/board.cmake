@@ -0,0 +1,3 @@
+# SFDP table and expected parameters are in board.h
+function(update_board TARGET)
+endfunction()
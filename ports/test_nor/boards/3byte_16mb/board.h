@@ -0,0 +1,80 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BOARD_H_
+#define BOARD_H_
+
+#include "sfdp.h"
+
+// Synthetic table, not a dump of a specific part.
+// 16 MB, 3-byte address only, JESD216B table with 32KB/64KB erase types and timings
+static const uint8_t sfdp_table[] = {
+  0x53, 0x46, 0x44, 0x50, 0x06, 0x01, 0x00, 0xFF, 0x00, 0x06, 0x01, 0x10, 0x80, 0x00, 0x00, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xE5, 0x20, 0xF9, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x44, 0xEB, 0x08, 0x6B, 0x08, 0x3B, 0x42, 0xBB,
+  0xEE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0xFF, 0xFF, 0xFF, 0x00, 0xFF, 0x0C, 0x20, 0x0F, 0x52,
+  0x10, 0xD8, 0x00, 0xFF, 0x22, 0x3A, 0xA5, 0x00, 0x81, 0x26, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x7A, 0x75, 0x7A, 0x75, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x50, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+
+static const sfdp_flash_t sfdp_expected = {
+  .size            = 16UL * 1024 * 1024,
+  .page_size       = 256,
+  .page_program_us = 448,
+  .program_opcode  = 0x02,
+  .program_lines   = 1,
+  .addr_bytes      = 3,
+  .enter_4b_mode   = false,
+  .quad_enable     = 5,
+  .suspend_opcode  = 0x75,
+  .resume_opcode   = 0x7A,
+  .erase_count     = 3,
+  .erase = {
+    { .size =  4096, .typ_ms =  48, .opcode = 0x20 },
+    { .size = 32768, .typ_ms = 128, .opcode = 0x52 },
+    { .size = 65536, .typ_ms = 160, .opcode = 0xD8 },
+  },
+  .read_count      = 5,
+  .read = {
+    { .opcode = 0xEB, .inst_lines = 1, .addr_lines = 4, .data_lines = 4, .mode_clocks = 2, .dummy_clocks = 6 },
+    { .opcode = 0x6B, .inst_lines = 1, .addr_lines = 1, .data_lines = 4, .mode_clocks = 0, .dummy_clocks = 8 },
+    { .opcode = 0xBB, .inst_lines = 1, .addr_lines = 2, .data_lines = 2, .mode_clocks = 2, .dummy_clocks = 4 },
+    { .opcode = 0x3B, .inst_lines = 1, .addr_lines = 1, .data_lines = 2, .mode_clocks = 0, .dummy_clocks = 8 },
+    { .opcode = 0x0B, .inst_lines = 1, .addr_lines = 1, .data_lines = 1, .mode_clocks = 0, .dummy_clocks = 8 },
+  },
+};
+
+// fastest read opcode for 1, 2 and 4 lines
+#define SFDP_EXPECTED_READ_1   0x0B
+#define SFDP_EXPECTED_READ_2   0xBB
+#define SFDP_EXPECTED_READ_4   0xEB
+
+#endif
@@ -0,0 +1 @@
+# SFDP table and expected parameters are in board.h
@@ -0,0 +1,73 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BOARD_H_
+#define BOARD_H_
+
+#include "sfdp.h"
+
+// Synthetic table, not a dump of a specific part.
+// 8 MB, original JESD216 table (9 DWORDs) with 4-4-4 read, 4KB erase only reported in DWORD 1
+static const uint8_t sfdp_table[] = {
+  0x53, 0x46, 0x44, 0x50, 0x00, 0x01, 0x00, 0xFF, 0x00, 0x00, 0x01, 0x09, 0x30, 0x00, 0x00, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xE5, 0x20, 0x71, 0xFF, 0xFF, 0xFF, 0xFF, 0x03, 0x44, 0xEB, 0x08, 0x6B, 0x08, 0x3B, 0x04, 0xBB,
+  0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0xFF, 0xFF, 0xFF, 0x44, 0xEB, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00,
+};
+
+
+static const sfdp_flash_t sfdp_expected = {
+  .size            = 8UL * 1024 * 1024,
+  .page_size       = 256,
+  .page_program_us = 0,
+  .program_opcode  = 0x02,
+  .program_lines   = 1,
+  .addr_bytes      = 3,
+  .enter_4b_mode   = false,
+  .quad_enable     = 0,
+  .suspend_opcode  = 0,
+  .resume_opcode   = 0,
+  .erase_count     = 1,
+  .erase = {
+    { .size =  4096, .typ_ms =   0, .opcode = 0x20 },
+  },
+  .read_count      = 6,
+  .read = {
+    { .opcode = 0xEB, .inst_lines = 4, .addr_lines = 4, .data_lines = 4, .mode_clocks = 2, .dummy_clocks = 6 },
+    { .opcode = 0xEB, .inst_lines = 1, .addr_lines = 4, .data_lines = 4, .mode_clocks = 2, .dummy_clocks = 6 },
+    { .opcode = 0x6B, .inst_lines = 1, .addr_lines = 1, .data_lines = 4, .mode_clocks = 0, .dummy_clocks = 8 },
+    { .opcode = 0xBB, .inst_lines = 1, .addr_lines = 2, .data_lines = 2, .mode_clocks = 0, .dummy_clocks = 4 },
+    { .opcode = 0x3B, .inst_lines = 1, .addr_lines = 1, .data_lines = 2, .mode_clocks = 0, .dummy_clocks = 8 },
+    { .opcode = 0x0B, .inst_lines = 1, .addr_lines = 1, .data_lines = 1, .mode_clocks = 0, .dummy_clocks = 8 },
+  },
+};
+
+// fastest read opcode for 1, 2 and 4 lines
+#define SFDP_EXPECTED_READ_1   0x0B
+#define SFDP_EXPECTED_READ_2   0xBB
+#define SFDP_EXPECTED_READ_4   0xEB
+
+#endif
@@ -0,0 +1,459 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "nor_erase.h"
+#include "board.h"
+
+// Native self-test for external NOR flash support: parse the SFDP table from board.h and compare
+// against expected parameters, then drive the erase suspend/resume state machine against a simulated
+// flash that supports suspend if the table reports it.
+
+static uint8_t const* _table = sfdp_table;
+static uint32_t _table_len = sizeof(sfdp_table);
+
+//--------------------------------------------------------------------+
+// SFDP
+//--------------------------------------------------------------------+
+
+static bool table_read(uint32_t addr, void* buffer, uint32_t len)
+{
+    if (addr > _table_len || len > _table_len - addr) return false;
+    memcpy(buffer, _table + addr, len);
+    return true;
+}
+
+#define CHECK_EQUAL(_field)                                                                   \
+    do {                                                                                      \
+        if ((actual->_field) != (expected->_field)) {                                         \
+            printf("  %s: expected 0x%lX, got 0x%lX\n", #_field,                              \
+                   (unsigned long) (expected->_field), (unsigned long) (actual->_field));     \
+            errors++;                                                                         \
+        }                                                                                     \
+    } while (0)
+
+static int CompareFlash(sfdp_flash_t const* actual, sfdp_flash_t const* expected)
+{
+    int errors = 0;
+
+    CHECK_EQUAL(size);
+    CHECK_EQUAL(page_size);
+    CHECK_EQUAL(page_program_us);
+    CHECK_EQUAL(program_opcode);
+    CHECK_EQUAL(program_lines);
+    CHECK_EQUAL(addr_bytes);
+    CHECK_EQUAL(enter_4b_mode);
+    CHECK_EQUAL(quad_enable);
+    CHECK_EQUAL(suspend_opcode);
+    CHECK_EQUAL(resume_opcode);
+
+    CHECK_EQUAL(erase_count);
+    for (uint8_t i = 0; i < expected->erase_count && i < actual->erase_count; i++) {
+        CHECK_EQUAL(erase[i].size);
+        CHECK_EQUAL(erase[i].typ_ms);
+        CHECK_EQUAL(erase[i].opcode);
+    }
+
+    CHECK_EQUAL(read_count);
+    for (uint8_t i = 0; i < expected->read_count && i < actual->read_count; i++) {
+        CHECK_EQUAL(read[i].opcode);
+        CHECK_EQUAL(read[i].inst_lines);
+        CHECK_EQUAL(read[i].addr_lines);
+        CHECK_EQUAL(read[i].data_lines);
+        CHECK_EQUAL(read[i].mode_clocks);
+        CHECK_EQUAL(read[i].dummy_clocks);
+    }
+
+    return errors;
+}
+
+static int CheckFastestRead(sfdp_flash_t const* flash, uint8_t max_lines, uint8_t expected_opcode)
+{
+    sfdp_read_mode_t const* mode = sfdp_fastest_read(flash, max_lines);
+    if (mode == NULL || mode->opcode != expected_opcode) {
+        printf("  fastest read with %u lines: expected 0x%02X, got 0x%02X\n", max_lines, expected_opcode,
+               mode ? mode->opcode : 0);
+        return 1;
+    }
+    return 0;
+}
+
+// Corrupted or truncated tables must be rejected
+static int CheckInvalidTables(void)
+{
+    static uint8_t corrupted[sizeof(sfdp_table)];
+    sfdp_flash_t flash;
+    int errors = 0;
+
+    memcpy(corrupted, sfdp_table, sizeof(corrupted));
+    corrupted[0] ^= 0xFF;
+    _table = corrupted;
+    if (sfdp_parse(table_read, &flash)) {
+        printf("  bad signature accepted\n");
+        errors++;
+    }
+
+    _table = sfdp_table;
+    _table_len = 0x40;
+    if (sfdp_parse(table_read, &flash)) {
+        printf("  truncated table accepted\n");
+        errors++;
+    }
+
+    _table_len = sizeof(sfdp_table);
+    return errors;
+}
+
+//--------------------------------------------------------------------+
+// NOR erase suspend/resume
+//--------------------------------------------------------------------+
+
+#define SIM_SIZE          (64 * 1024)
+#define SIM_SECTOR_SIZE   4096
+
+// Erase duration and suspend latency, in number of status polls
+#define SIM_ERASE_POLLS   64
+#define SIM_SUSPEND_POLLS 3
+
+static uint8_t _flash[SIM_SIZE];
+
+static struct {
+    bool     erasing;       // erase started and not completed, may be suspended
+    bool     suspended;
+    uint32_t addr;
+    uint32_t size;
+    uint32_t remaining;     // polls until erase completes
+    uint32_t suspend_wait;  // polls until suspend takes effect
+} _sim;
+
+// Commands the real flash would ignore or reject
+static int _violations;
+
+#define VIOLATION(...)             \
+    do {                           \
+        printf("  flash: ");       \
+        printf(__VA_ARGS__);       \
+        printf("\n");              \
+        _violations++;             \
+    } while (0)
+
+static void sim_fill_pattern(void)
+{
+    for (uint32_t i = 0; i < SIM_SIZE; i++) {
+        _flash[i] = (uint8_t) (i * 7 + (i >> 8));
+    }
+}
+
+static bool sim_erase(uint32_t addr, uint32_t size)
+{
+    if (_sim.erasing) VIOLATION("erase while busy");
+    if ((addr % SIM_SECTOR_SIZE) || (size % SIM_SECTOR_SIZE) || addr + size > SIM_SIZE) VIOLATION("bad erase range");
+
+    _sim.erasing = true;
+    _sim.suspended = false;
+    _sim.addr = addr;
+    _sim.size = size;
+    _sim.remaining = SIM_ERASE_POLLS;
+
+    // contents are undefined until erase completes
+    memset(&_flash[addr], 0xA5, size);
+    return true;
+}
+
+static bool sim_busy(void)
+{
+    if (!_sim.erasing) return false;
+
+    if (_sim.suspended) {
+        if (_sim.suspend_wait == 0) return false;
+        _sim.suspend_wait--;
+    }
+
+    // erase still makes progress until suspend takes effect
+    if (_sim.remaining) _sim.remaining--;
+    if (_sim.remaining == 0) {
+        memset(&_flash[_sim.addr], 0xFF, _sim.size);
+        _sim.erasing = false;
+        _sim.suspended = false;
+        return false;
+    }
+
+    return true;
+}
+
+static bool sim_suspend(void)
+{
+    if (_sim.erasing && !_sim.suspended) {
+        _sim.suspended = true;
+        _sim.suspend_wait = SIM_SUSPEND_POLLS;
+    }
+    return true;
+}
+
+static bool sim_resume(void)
+{
+    if (_sim.suspended) {
+        if (_sim.suspend_wait) VIOLATION("resume before suspend completed");
+        _sim.suspended = false;
+    }
+    return true;
+}
+
+static bool sim_read(uint32_t addr, void* buffer, uint32_t len)
+{
+    if (_sim.erasing) {
+        if (!_sim.suspended || _sim.suspend_wait) {
+            VIOLATION("read while erasing at 0x%05lX", (unsigned long) addr);
+        } else if (addr < _sim.addr + _sim.size && addr + len > _sim.addr) {
+            VIOLATION("read from suspended erase range at 0x%05lX", (unsigned long) addr);
+        }
+    }
+    memcpy(buffer, &_flash[addr], len);
+    return true;
+}
+
+// suspend is cleared if SFDP reports the flash does not support it, as ports do
+static nor_erase_ops_t _ops = {
+    .erase   = sim_erase,
+    .busy    = sim_busy,
+    .suspend = sim_suspend,
+    .resume  = sim_resume,
+    .read    = sim_read,
+};
+
+static nor_erase_t _nor;
+
+#define CHECK(_cond)                                                     \
+    do {                                                                 \
+        if (!(_cond)) {                                                  \
+            printf("  %s:%d: check failed: %s\n", __func__, __LINE__, #_cond); \
+            errors++;                                                    \
+        }                                                                \
+    } while (0)
+
+static bool is_erased(uint32_t addr, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        if (_flash[addr + i] != 0xFF) return false;
+    }
+    return true;
+}
+
+// expected simulated contents outside of erased areas
+static bool is_pattern(uint8_t const* data, uint32_t addr, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        uint32_t const a = addr + i;
+        if (data[i] != (uint8_t) (a * 7 + (a >> 8))) return false;
+    }
+    return true;
+}
+
+static void reset(void)
+{
+    memset(&_sim, 0, sizeof(_sim));
+    sim_fill_pattern();
+    nor_erase_init(&_nor, &_ops);
+}
+
+static int TestEraseCompletes(void)
+{
+    int errors = 0;
+    reset();
+
+    CHECK(nor_erase_start(&_nor, 1 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+
+    uint32_t polls = 0;
+    while (nor_erase_busy(&_nor) && polls < 10 * SIM_ERASE_POLLS) polls++;
+
+    CHECK(_nor.state == NOR_ERASE_IDLE);
+    CHECK(polls < SIM_ERASE_POLLS);
+    CHECK(is_erased(1 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    CHECK(is_pattern(&_flash[0], 0, SIM_SECTOR_SIZE));
+    CHECK(is_pattern(&_flash[2 * SIM_SECTOR_SIZE], 2 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    return errors;
+}
+
+// Read from another sector is served without waiting for the erase
+static int TestReadOutside(void)
+{
+    int errors = 0;
+    uint8_t buf[512];
+    reset();
+
+    CHECK(nor_erase_start(&_nor, 1 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    CHECK(nor_erase_read(&_nor, 3 * SIM_SECTOR_SIZE + 100, buf, sizeof(buf)));
+    CHECK(is_pattern(buf, 3 * SIM_SECTOR_SIZE + 100, sizeof(buf)));
+
+    if (_ops.suspend) {
+        // suspended once, then resumed and still erasing
+        CHECK(_nor.suspend_count == 1);
+        CHECK(_nor.state == NOR_ERASE_RUNNING);
+        CHECK(_sim.erasing && !_sim.suspended);
+    } else {
+        // no suspend: read waited for erase to finish
+        CHECK(_nor.suspend_count == 0);
+        CHECK(_nor.state == NOR_ERASE_IDLE);
+    }
+
+    CHECK(nor_erase_wait(&_nor));
+    CHECK(is_erased(1 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    return errors;
+}
+
+// Part of the read overlapping the erase range reads as erased
+static int TestReadOverlap(void)
+{
+    int errors = 0;
+    uint8_t buf[256];
+    uint32_t const addr = 2 * SIM_SECTOR_SIZE - 128;
+    reset();
+
+    CHECK(nor_erase_start(&_nor, 2 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    CHECK(nor_erase_read(&_nor, addr, buf, sizeof(buf)));
+    CHECK(is_pattern(buf, addr, 128));
+
+    bool erased = true;
+    for (uint32_t i = 128; i < sizeof(buf); i++) {
+        if (buf[i] != 0xFF) erased = false;
+    }
+    CHECK(erased);
+
+    CHECK(nor_erase_wait(&_nor));
+    return errors;
+}
+
+// Read entirely within erase range does not interrupt the erase
+static int TestReadInside(void)
+{
+    int errors = 0;
+    uint8_t buf[256];
+    reset();
+
+    CHECK(nor_erase_start(&_nor, 1 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    memset(buf, 0, sizeof(buf));
+    CHECK(nor_erase_read(&_nor, 1 * SIM_SECTOR_SIZE + 512, buf, sizeof(buf)));
+    CHECK(buf[0] == 0xFF && buf[sizeof(buf) - 1] == 0xFF);
+    CHECK(_nor.suspend_count == 0);
+    CHECK(_nor.state == NOR_ERASE_RUNNING);
+
+    CHECK(nor_erase_wait(&_nor));
+    return errors;
+}
+
+// Erase keeps making progress with reads interleaved between status polls
+static int TestInterleavedReads(void)
+{
+    int errors = 0;
+    uint8_t buf[64];
+    uint32_t reads = 0;
+    reset();
+
+    CHECK(nor_erase_start(&_nor, 0, 2 * SIM_SECTOR_SIZE));
+    while (nor_erase_busy(&_nor) && reads < 10 * SIM_ERASE_POLLS) {
+        uint32_t const addr = 4 * SIM_SECTOR_SIZE + 64 * reads;
+        CHECK(nor_erase_read(&_nor, addr, buf, sizeof(buf)));
+        CHECK(is_pattern(buf, addr, sizeof(buf)));
+        reads++;
+    }
+
+    CHECK(_nor.state == NOR_ERASE_IDLE);
+    CHECK(reads < SIM_ERASE_POLLS);
+    CHECK(is_erased(0, 2 * SIM_SECTOR_SIZE));
+    return errors;
+}
+
+// Starting an erase while another is running completes the first one
+static int TestBackToBack(void)
+{
+    int errors = 0;
+    reset();
+
+    CHECK(nor_erase_start(&_nor, 1 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    CHECK(nor_erase_start(&_nor, 2 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    CHECK(is_erased(1 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    CHECK(nor_erase_wait(&_nor));
+    CHECK(is_erased(2 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    return errors;
+}
+
+// Erase completes while suspend is pending: resume is ignored and erase is reported done
+static int TestSuspendRace(void)
+{
+    int errors = 0;
+    uint8_t buf[64];
+    reset();
+
+    CHECK(nor_erase_start(&_nor, 1 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    while (_sim.remaining > 1) sim_busy();
+
+    CHECK(nor_erase_read(&_nor, 0, buf, sizeof(buf)));
+    CHECK(is_pattern(buf, 0, sizeof(buf)));
+    CHECK(!nor_erase_busy(&_nor));
+    CHECK(is_erased(1 * SIM_SECTOR_SIZE, SIM_SECTOR_SIZE));
+    return errors;
+}
+
+int main(void)
+{
+    sfdp_flash_t flash;
+    int errors = 0;
+
+    printf("parsing SFDP table\n"); fflush(stdout);
+    if (!sfdp_parse(table_read, &flash)) {
+        printf("FAIL: SFDP table not recognized\n");
+        return 1;
+    }
+
+    printf("comparing against expected parameters\n"); fflush(stdout);
+    errors += CompareFlash(&flash, &sfdp_expected);
+
+    printf("checking fastest read selection\n"); fflush(stdout);
+    errors += CheckFastestRead(&flash, 1, SFDP_EXPECTED_READ_1);
+    errors += CheckFastestRead(&flash, 2, SFDP_EXPECTED_READ_2);
+    errors += CheckFastestRead(&flash, 4, SFDP_EXPECTED_READ_4);
+
+    printf("checking invalid tables\n"); fflush(stdout);
+    errors += CheckInvalidTables();
+
+    if (flash.suspend_opcode == 0) _ops.suspend = NULL;
+    printf("checking erase, suspend %s\n", _ops.suspend ? "supported" : "not supported"); fflush(stdout);
+
+    errors += TestEraseCompletes();
+    errors += TestReadOutside();
+    errors += TestReadOverlap();
+    errors += TestReadInside();
+    errors += TestInterleavedReads();
+    errors += TestBackToBack();
+    errors += TestSuspendRace();
+
+    if (errors || _violations) {
+        printf("FAIL: %d check(s) failed, %d flash protocol violation(s)\n", errors, _violations);
+        return 1;
+    }
+
+    printf("PASS: NOR flash validation completed successfully.\n");
+    return 0;
+}
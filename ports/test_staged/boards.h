@@ -0,0 +1,22 @@
+#ifndef STAGED_TEST_CONFIG_H
+#define STAGED_TEST_CONFIG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "board.h"
+
+// Simulated flash starts at address 0
+#define TEST_FLASH_SIZE             (256*1024)
+
+// From board_api.h
+#define BOARD_FLASH_APP_START       0x4000
+
+#define BOARD_FLASH_STAGING_ADDR    0x3F000
+#define BOARD_FLASH_ERASE_SIZE      4096
+#define BOARD_FLASH_APP_CHECK_ADDR  0x3E000
+
+// Staged images are written here by the test
+#define TEST_STAGED_IMAGE_ADDR      0x20000
+
+#endif  // STAGED_TEST_CONFIG_H
@@ -0,0 +1,2 @@
+function(update_board TARGET)
+endfunction()
@@ -0,0 +1 @@
+# Staged update copy only, application is validated by board_app_valid()
@@ -0,0 +1,5 @@
+function(update_board TARGET)
+  target_compile_definitions(${TARGET} PUBLIC
+    TINYUF2_APP_CHECK=1
+    )
+endfunction()
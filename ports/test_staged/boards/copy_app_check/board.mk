@@ -0,0 +1,2 @@
+# Application is also validated against the CRC descriptor
+CFLAGS += -DTINYUF2_APP_CHECK=1
@@ -0,0 +1,396 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "board_api.h"
+#include "uf2.h"
+#include "checksum.h"
+#include "staged_update.h"
+
+#if TINYUF2_APP_CHECK
+#include "app_check.h"
+#endif
+
+// Native self-test for application-staged update: stage an image in simulated flash, then check that
+// staged_update_apply() installs it, rejects bad descriptors or images, and that a power loss or write
+// failure at any point of the copy never leaves an application that would be started half-copied.
+
+static uint8_t _flash[TEST_FLASH_SIZE];
+static uint8_t _expected[TEST_FLASH_SIZE];
+
+// Like stm32 ports, a sector is erased by its first write since boot, later writes can only program
+// erased bytes unless it is erased again
+#define SECTOR_COUNT  (TEST_FLASH_SIZE / BOARD_FLASH_ERASE_SIZE)
+static bool _sector_erased[SECTOR_COUNT];
+
+static uint32_t _writes;
+static uint32_t _cut_at;   // power is lost on this write, 0 for never
+static uint32_t _fail_at;  // this write fails, 0 for never
+static jmp_buf _power_loss;
+
+//--------------------------------------------------------------------+
+// Board API
+//--------------------------------------------------------------------+
+
+uint32_t board_flash_size(void)
+{
+    return TEST_FLASH_SIZE;
+}
+
+void board_flash_read(uint32_t addr, void* buffer, uint32_t len)
+{
+    memcpy(buffer, _flash + addr, len);
+}
+
+bool board_flash_erase_sector(uint32_t addr)
+{
+    if (addr >= TEST_FLASH_SIZE) return false;
+
+    uint32_t const sector = addr / BOARD_FLASH_ERASE_SIZE;
+    memset(_flash + sector * BOARD_FLASH_ERASE_SIZE, 0xff, BOARD_FLASH_ERASE_SIZE);
+    _sector_erased[sector] = true;
+    return true;
+}
+
+bool board_flash_write(uint32_t addr, void const* data, uint32_t len)
+{
+    _writes++;
+    if (_writes == _cut_at) longjmp(_power_loss, 1);
+    if (_writes == _fail_at) return false;
+
+    if (addr + len > TEST_FLASH_SIZE) return false;
+
+    uint8_t const* src = data;
+    for (uint32_t i = 0; i < len; i++) {
+        if (!_sector_erased[(addr + i) / BOARD_FLASH_ERASE_SIZE]) board_flash_erase_sector(addr + i);
+        if (_flash[addr + i] != 0xff) return false;
+        _flash[addr + i] = src[i];
+    }
+    return true;
+}
+
+bool board_flash_flush(void)
+{
+    return true;
+}
+
+bool uf2_flash_write(uint32_t addr, void const* data, uint32_t len)
+{
+    return board_flash_write(addr, data, len);
+}
+
+// bootloader checks stack pointer of vector table, blank flash is never valid
+bool board_app_valid(void)
+{
+    uint32_t sp;
+    board_flash_read(BOARD_FLASH_APP_START, &sp, sizeof(sp));
+    return sp != 0xFFFFFFFF;
+}
+
+void indicator_set(uint32_t state)
+{
+    (void) state;
+}
+
+//--------------------------------------------------------------------+
+// Helpers
+//--------------------------------------------------------------------+
+
+#define OLD_APP_LEN   (20*1024)
+
+// Bootloader starts over, nothing erased yet
+static void reboot(void)
+{
+    memset(_sector_erased, 0, sizeof(_sector_erased));
+    _writes = 0;
+}
+
+static void fill(uint8_t* buf, uint32_t addr, uint32_t len, uint8_t seed)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        buf[addr + i] = (uint8_t) (seed ^ ((addr + i) * 7) ^ ((addr + i) >> 8));
+    }
+}
+
+// Current application, image staged by application and its descriptor
+static void setup(uint32_t dst_addr, uint32_t len)
+{
+    memset(_flash, 0xff, sizeof(_flash));
+    fill(_flash, BOARD_FLASH_APP_START, OLD_APP_LEN, 0x11);
+    memcpy(_expected, _flash, sizeof(_expected));
+
+    for (uint32_t i = 0; i < len; i++) {
+        _flash[TEST_STAGED_IMAGE_ADDR + i] = (uint8_t) (0x5A ^ (i * 13) ^ (i >> 9));
+    }
+    memcpy(_expected + dst_addr, _flash + TEST_STAGED_IMAGE_ADDR, len);
+
+    // rest of last sector of a full image is erased along
+    uint32_t const end = dst_addr + len;
+    if (dst_addr == BOARD_FLASH_APP_START && (end % BOARD_FLASH_ERASE_SIZE)) {
+        memset(_expected + end, 0xff, BOARD_FLASH_ERASE_SIZE - (end % BOARD_FLASH_ERASE_SIZE));
+    }
+
+    staged_update_t desc = {
+        .magic    = STAGED_UPDATE_MAGIC,
+        .src_addr = TEST_STAGED_IMAGE_ADDR,
+        .dst_addr = dst_addr,
+        .len      = len,
+    };
+    tuf2_sha256_t ctx;
+    tuf2_sha256_init(&ctx);
+    tuf2_sha256_update(&ctx, _flash + TEST_STAGED_IMAGE_ADDR, len);
+    tuf2_sha256_final(&ctx, desc.sha256);
+    desc.crc32 = tuf2_crc32(0, &desc, offsetof(staged_update_t, crc32));
+    memcpy(_flash + BOARD_FLASH_STAGING_ADDR, &desc, sizeof(desc));
+
+    _cut_at = 0;
+    _fail_at = 0;
+
+#if TINYUF2_APP_CHECK
+    reboot();
+    app_check_record(BOARD_FLASH_APP_START, OLD_APP_LEN);
+    memcpy(_expected + BOARD_FLASH_APP_CHECK_ADDR, _flash + BOARD_FLASH_APP_CHECK_ADDR, sizeof(app_check_desc_t));
+#endif
+    reboot();
+}
+
+// What main() decides: start application or stay in DFU
+static bool app_starts(void)
+{
+    if (!board_app_valid()) return false;
+#if TINYUF2_APP_CHECK
+    if (!app_check_valid()) return false;
+#endif
+    return true;
+}
+
+static bool app_matches(uint8_t const* image)
+{
+    return 0 == memcmp(_flash + BOARD_FLASH_APP_START, image + BOARD_FLASH_APP_START,
+                       TEST_STAGED_IMAGE_ADDR - BOARD_FLASH_APP_START);
+}
+
+//--------------------------------------------------------------------+
+// Tests
+//--------------------------------------------------------------------+
+
+static int TestCopy(uint32_t dst_addr, uint32_t len)
+{
+    setup(dst_addr, len);
+
+    if (!staged_update_apply()) {
+        printf("  %lu bytes -> 0x%05lX: apply failed\n", (unsigned long) len, (unsigned long) dst_addr);
+        return 1;
+    }
+    if (!app_matches(_expected) || !app_starts()) {
+        printf("  %lu bytes -> 0x%05lX: application not installed\n", (unsigned long) len, (unsigned long) dst_addr);
+        return 1;
+    }
+
+    // bootloader is asked again e.g reset before register was cleared: nothing to copy
+    reboot();
+    if (!staged_update_apply() || !app_matches(_expected) || !app_starts()) {
+        printf("  %lu bytes -> 0x%05lX: second apply failed\n", (unsigned long) len, (unsigned long) dst_addr);
+        return 1;
+    }
+    if (_writes != 0 && dst_addr == BOARD_FLASH_APP_START) {
+        printf("  %lu bytes -> 0x%05lX: installed image written again\n", (unsigned long) len, (unsigned long) dst_addr);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int TestRejected(void)
+{
+    int errors = 0;
+    uint8_t old[TEST_FLASH_SIZE];
+
+    // descriptor CRC
+    setup(BOARD_FLASH_APP_START, 10000);
+    _flash[BOARD_FLASH_STAGING_ADDR + offsetof(staged_update_t, len)] ^= 1;
+    memcpy(old, _flash, sizeof(old));
+    if (staged_update_apply() || _writes || memcmp(old, _flash, sizeof(old))) {
+        printf("  corrupted descriptor not rejected\n");
+        errors++;
+    }
+
+    // staged image
+    setup(BOARD_FLASH_APP_START, 10000);
+    _flash[TEST_STAGED_IMAGE_ADDR + 5000] ^= 0x80;
+    memcpy(old, _flash, sizeof(old));
+    if (staged_update_apply() || _writes || memcmp(old, _flash, sizeof(old))) {
+        printf("  corrupted image not rejected\n");
+        errors++;
+    }
+
+    // partial update overwriting head of application
+    setup(BOARD_FLASH_APP_START + 16, 10000);
+    memcpy(old, _flash, sizeof(old));
+    if (staged_update_apply() || _writes || memcmp(old, _flash, sizeof(old))) {
+        printf("  partial update of application head not rejected\n");
+        errors++;
+    }
+
+    // partial update ending inside a sector would erase the rest of it
+    setup(BOARD_FLASH_APP_START + 2*BOARD_FLASH_ERASE_SIZE, 5000);
+    memcpy(old, _flash, sizeof(old));
+    if (staged_update_apply() || _writes || memcmp(old, _flash, sizeof(old))) {
+        printf("  partial update of part of a sector not rejected\n");
+        errors++;
+    }
+
+    // last sector of image is erased with staged image right behind it
+    setup(TEST_STAGED_IMAGE_ADDR - 3*BOARD_FLASH_ERASE_SIZE, 3*BOARD_FLASH_ERASE_SIZE);
+    staged_update_t desc;
+    memcpy(&desc, _flash + BOARD_FLASH_STAGING_ADDR, sizeof(desc));
+    desc.dst_addr = BOARD_FLASH_APP_START;
+    desc.len = TEST_STAGED_IMAGE_ADDR - BOARD_FLASH_APP_START + 100;
+    desc.src_addr = TEST_STAGED_IMAGE_ADDR + 200;
+    desc.crc32 = tuf2_crc32(0, &desc, offsetof(staged_update_t, crc32));
+    memcpy(_flash + BOARD_FLASH_STAGING_ADDR, &desc, sizeof(desc));
+    memcpy(old, _flash, sizeof(old));
+    if (staged_update_apply() || _writes || memcmp(old, _flash, sizeof(old))) {
+        printf("  staged image sharing a sector with destination not rejected\n");
+        errors++;
+    }
+
+    return errors;
+}
+
+static void apply_power_loss(uint32_t n)
+{
+    _cut_at = n;
+    if (setjmp(_power_loss) == 0) {
+        staged_update_apply();
+    }
+    _cut_at = 0;
+}
+
+// Current application was flashed without descriptor e.g by debugger
+static void forget_app_check(void)
+{
+#if TINYUF2_APP_CHECK
+    memset(_flash + BOARD_FLASH_APP_CHECK_ADDR, 0xff, sizeof(app_check_desc_t));
+#endif
+}
+
+// Cut power on every write of the copy in turn: application must then be either the old one, the
+// new one, or not started at all
+static int TestPowerLoss(uint32_t dst_addr, uint32_t len, bool recorded)
+{
+    int errors = 0;
+    uint8_t old[TEST_FLASH_SIZE];
+
+    setup(dst_addr, len);
+    if (!recorded) forget_app_check();
+    staged_update_apply();
+    uint32_t const total = _writes;
+
+    for (uint32_t n = 1; n <= total; n++) {
+        setup(dst_addr, len);
+        if (!recorded) forget_app_check();
+        memcpy(old, _flash, sizeof(old));
+        apply_power_loss(n);
+
+        if (app_starts() && !app_matches(_expected) && !app_matches(old)) {
+            printf("  power loss on write %lu/%lu: partial application would start\n",
+                   (unsigned long) n, (unsigned long) total);
+            errors++;
+        }
+    }
+
+    return errors;
+}
+
+// A failed write anywhere must not report success nor leave a changed application startable
+static int TestWriteFailure(uint32_t dst_addr, uint32_t len)
+{
+    int errors = 0;
+    uint8_t old[TEST_FLASH_SIZE];
+
+    setup(dst_addr, len);
+    staged_update_apply();
+    uint32_t const total = _writes;
+
+    for (uint32_t n = 1; n <= total; n++) {
+        setup(dst_addr, len);
+        memcpy(old, _flash, sizeof(old));
+        _fail_at = n;
+
+        bool const ok = staged_update_apply();
+        bool const installed = app_matches(_expected);
+        bool const unchanged = app_matches(old);
+
+        if ((ok && !installed) || (!ok && !unchanged && board_app_valid()) || (app_starts() && !installed && !unchanged)) {
+            printf("  write %lu/%lu failed: apply %s, application %s\n", (unsigned long) n, (unsigned long) total,
+                   ok ? "ok" : "failed", board_app_valid() ? "valid" : "invalid");
+            errors++;
+        }
+    }
+
+    return errors;
+}
+
+int main(void)
+{
+    int errors = 0;
+
+    // whole application, images that do not end on a copy chunk, and partial update which leaves the
+    // head sector and the code between it and the update untouched
+    uint32_t const partial_addr = BOARD_FLASH_APP_START + 2*BOARD_FLASH_ERASE_SIZE;
+    uint32_t const partial_len = 2*BOARD_FLASH_ERASE_SIZE;
+
+    printf("checking copy\n"); fflush(stdout);
+    errors += TestCopy(BOARD_FLASH_APP_START, 16*1024);
+    errors += TestCopy(BOARD_FLASH_APP_START, 12345);
+    errors += TestCopy(BOARD_FLASH_APP_START, 300);
+    errors += TestCopy(partial_addr, partial_len);
+
+    printf("checking rejected updates\n"); fflush(stdout);
+    errors += TestRejected();
+
+    printf("checking power loss during copy\n"); fflush(stdout);
+    errors += TestPowerLoss(BOARD_FLASH_APP_START, 12345, true);
+#if TINYUF2_APP_CHECK
+    // without it a partial update keeps a valid head and is not protected
+    errors += TestPowerLoss(partial_addr, partial_len, true);
+    errors += TestPowerLoss(partial_addr, partial_len, false);
+#endif
+
+    printf("checking write failures\n"); fflush(stdout);
+    errors += TestWriteFailure(BOARD_FLASH_APP_START, 12345);
+    errors += TestWriteFailure(partial_addr, partial_len);
+
+    if (errors) {
+        printf("FAIL: %d check(s) failed\n", errors);
+        return 1;
+    }
+
+    printf("PASS: staged update validation completed successfully.\n");
+    return 0;
+}
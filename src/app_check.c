@@ -0,0 +1,159 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "board_api.h"
+#include "uf2.h"
+#include "checksum.h"
+#include "app_check.h"
+
+#if TINYUF2_APP_CHECK
+
+#ifndef BOARD_FLASH_APP_CHECK_ADDR
+  #error "TINYUF2_APP_CHECK requires BOARD_FLASH_APP_CHECK_ADDR"
+#endif
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+#define CRC_CHUNK   1024
+
+static uint8_t _buf[CRC_CHUNK] __attribute__((aligned(4)));
+static bool _cleared;
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+static uint32_t desc_crc(app_check_desc_t const* desc) {
+  return tuf2_crc32(0, desc, offsetof(app_check_desc_t, desc_crc));
+}
+
+static bool desc_valid(app_check_desc_t const* desc) {
+  uint32_t const size = BOARD_FLASH_ADDR_ZERO + board_flash_size() - BOARD_FLASH_APP_START;
+  uint32_t const offset = desc->addr - BOARD_FLASH_APP_START; // wraps for address below application
+
+  if (desc->desc_crc != desc_crc(desc)) return false;
+  return desc->len && (offset <= size) && (desc->len <= size - offset);
+}
+
+// Software CRC for all ports. STM32F3/L4/H7 CRC units could compute this reflected CRC-32 with
+// REV_IN/REV_OUT, but the F4 unit has fixed bit order and other ports have none, so it would be a
+// per-port hook; warm boots already skip the CRC with TINYUF2_APP_CHECK_REG
+static uint32_t image_crc(uint32_t addr, uint32_t len) {
+  uint32_t crc = 0;
+
+  for (uint32_t offset = 0; offset < len; offset += CRC_CHUNK) {
+    uint32_t const count = (len - offset < CRC_CHUNK) ? (len - offset) : CRC_CHUNK;
+    board_flash_read(addr + offset, _buf, count);
+    crc = tuf2_crc32(crc, _buf, count);
+  }
+
+  return crc;
+}
+
+// Descriptor is cleared then recorded again while writing an image, ports that erase a sector only
+// on its first write since board_flash_init() have to erase it explicitly every time
+static bool desc_write(void const* data, uint32_t len) {
+  while (board_flash_busy && board_flash_busy()) {}
+  if (board_flash_erase_sector && !board_flash_erase_sector(BOARD_FLASH_APP_CHECK_ADDR)) return false;
+  if (!uf2_flash_write(BOARD_FLASH_APP_CHECK_ADDR, data, len)) return false;
+  if (!board_flash_flush()) return false;
+
+  uint8_t cur[sizeof(app_check_desc_t)];
+  board_flash_read(BOARD_FLASH_APP_CHECK_ADDR, cur, len);
+  return 0 == memcmp(cur, data, len);
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+bool app_check_record(uint32_t addr, uint32_t len) {
+  app_check_desc_t desc = {
+    .magic = APP_CHECK_MAGIC,
+    .addr  = addr,
+    .len   = len,
+  };
+
+  // make sure CRC is computed over what is actually in flash
+  board_flash_flush();
+  desc.crc32 = image_crc(addr, len);
+  desc.desc_crc = desc_crc(&desc);
+
+  // skip rewriting identical descriptor e.g same image written again
+  app_check_desc_t cur;
+  board_flash_read(BOARD_FLASH_APP_CHECK_ADDR, &cur, sizeof(cur));
+  if (0 != memcmp(&cur, &desc, sizeof(desc)) && !desc_write(&desc, sizeof(desc))) {
+    TUF2_LOG1("App check: failed to write descriptor\r\n");
+    return false;
+  }
+
+  _cleared = false;
+  TUF2_LOG1("App check: %lu bytes, crc = %08lX\r\n", desc.len, desc.crc32);
+  return true;
+}
+
+bool app_check_clear(void) {
+  if (_cleared) return true;
+
+  uint32_t const zero = 0;
+  if (!desc_write(&zero, sizeof(zero))) {
+    TUF2_LOG1("App check: failed to clear descriptor\r\n");
+    return false;
+  }
+
+  _cleared = true;
+  return true;
+}
+
+bool app_check_valid(void) {
+  app_check_desc_t desc;
+  board_flash_read(BOARD_FLASH_APP_CHECK_ADDR, &desc, sizeof(desc));
+
+  // not recorded by us: nothing to check against
+  if (desc.magic != APP_CHECK_MAGIC) return true;
+
+  // interrupted while recording
+  if (!desc_valid(&desc)) return false;
+
+#ifdef TINYUF2_APP_CHECK_REG
+  // verified since last cold boot
+  if (TINYUF2_APP_CHECK_REG == desc.desc_crc) return true;
+#endif
+
+  bool const valid = (image_crc(desc.addr, desc.len) == desc.crc32);
+  TUF2_LOG1("App check: crc %s\r\n", valid ? "ok" : "mismatch");
+
+#ifdef TINYUF2_APP_CHECK_REG
+  TINYUF2_APP_CHECK_REG = valid ? desc.desc_crc : 0;
+#endif
+
+  return valid;
+}
+
+#endif
@@ -0,0 +1,68 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef APP_CHECK_H_
+#define APP_CHECK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//--------------------------------------------------------------------+
+// Application image check (TINYUF2_APP_CHECK)
+//
+// Once an image is completely written (UF2, SD card or staged update) its
+// length and CRC32 are recorded in a descriptor at BOARD_FLASH_APP_CHECK_ADDR,
+// which must be in a flash sector that application images never use. The
+// sector is rewritten per image, see board_flash_erase_sector().
+// The first UF2 block clears previous descriptor, the new one is recorded by
+// uf2_task() since the CRC of a whole image is too long for USB callbacks.
+// At boot the image is verified against the descriptor, so an interrupted
+// write is not started. Since verification time grows with image size, a good
+// verdict is cached in TINYUF2_APP_CHECK_REG (if board defines a register
+// retained across warm reset) keyed by the descriptor: warm boots skip the
+// CRC, a cold boot or a new image verifies again.
+// Without descriptor (e.g flashed by debugger) only board_app_valid() applies.
+//--------------------------------------------------------------------+
+
+#define APP_CHECK_MAGIC   0x4B484355UL // "UCHK"
+
+typedef struct {
+  uint32_t magic;     // APP_CHECK_MAGIC
+  uint32_t addr;      // start of image, BOARD_FLASH_APP_START or of a staged partial update
+  uint32_t len;       // image size in bytes
+  uint32_t crc32;     // tuf2_crc32() of image
+  uint32_t desc_crc;  // tuf2_crc32(0, descriptor, offsetof(app_check_desc_t, desc_crc))
+} app_check_desc_t;
+
+// Compute CRC of image just written and record its descriptor, return false if it could not be written
+bool app_check_record(uint32_t addr, uint32_t len);
+
+// Forget descriptor before image is modified without being recorded afterwards e.g raw flash write.
+// Return false if it could not be written
+bool app_check_clear(void);
+
+// Return false if descriptor is present but image does not match it
+bool app_check_valid(void);
+
+#endif
@@ -94,11 +94,59 @@
 #define TINYUF2_PROTECT_BOOTLOADER  0
 #endif
 
+// Vendor specific SCSI commands to read/write/checksum flash directly via MSC interface.
+// Commands are not authenticated, board opts in by defining it to 1 in board.h
+#ifndef TINYUF2_SCSI_VENDOR
+#define TINYUF2_SCSI_VENDOR 0
+#endif
+
+// Expose external/data flash as second MSC LUN (raw block device), requires board_data_flash_*() API
+#ifndef TINYUF2_MSC_DATA_LUN
+#define TINYUF2_MSC_DATA_LUN 0
+#endif
+
+// Write-back cache of data LUN, must be power of 2 and multiple of data flash erase size
+#ifndef TINYUF2_MSC_DATA_CACHE_SIZE
+#define TINYUF2_MSC_DATA_CACHE_SIZE 4096
+#endif
+
+// Update application from firmware.uf2/.bin on SD card at boot, requires board_sd_*() API.
+// Set by build system (TINYUF2_SD_UPDATE=1 in board.mk/board.cmake) since it also adds lib/fatfs.
+// Board must define BOARD_FLASH_SD_UPDATE_ADDR, a sector outside the application where the applied file is recorded
+#ifndef TINYUF2_SD_UPDATE
+#define TINYUF2_SD_UPDATE 0
+#endif
+
+// Size of each of the two SD read buffers, multiple of 512. Larger buffers mean longer multi-block reads
+#ifndef TINYUF2_SD_UPDATE_BUFSIZE
+#define TINYUF2_SD_UPDATE_BUFSIZE 4096
+#endif
+
+// Copy update staged by application when it resets with DBL_TAP_MAGIC_STAGED_UPDATE, see staged_update.h.
+// Board must define BOARD_FLASH_STAGING_ADDR where the application writes the update descriptor, and
+// BOARD_FLASH_ERASE_SIZE the largest erase sector of application flash (every sector boundary is a multiple of it)
+#ifndef TINYUF2_STAGED_UPDATE
+#define TINYUF2_STAGED_UPDATE 0
+#endif
+
+// Verify application against CRC descriptor recorded when it was written, see app_check.h.
+// Board must define BOARD_FLASH_APP_CHECK_ADDR, and optionally TINYUF2_APP_CHECK_REG (retained
+// across warm reset like TINYUF2_DBL_TAP_REG) to skip verification on warm boots
+#ifndef TINYUF2_APP_CHECK
+#define TINYUF2_APP_CHECK 0
+#endif
+
 // Bootloader often has limited ROM than RAM and prefer to use RAM for data
 #ifndef TINYUF2_CONST
 #define TINYUF2_CONST
 #endif
 
+// Place function in RAM so that it keeps running while internal flash is busy erasing/programming.
+// Port linker script must collect .ramfunc sections into initialized RAM e.g .data
+#ifndef TINYUF2_RAMFUNC
+#define TINYUF2_RAMFUNC
+#endif
+
 // Use favicon.ico + autorun.inf (only works with windows)
 // define TINYUF2_FAVICON_HEADER to enable this feature
 
@@ -126,6 +174,7 @@ extern DBL_TAP_TYPE _board_dfu_dbl_tap[];
 #define DBL_TAP_MAGIC            (0xf01669ef >> (32 - TINYUF2_DBL_TAP_REG_SIZE)) // Enter DFU magic
 #define DBL_TAP_MAGIC_QUICK_BOOT (0xf02669ef >> (32 - TINYUF2_DBL_TAP_REG_SIZE)) // Skip double tap delay detection
 #define DBL_TAP_MAGIC_ERASE_APP  (0xf5e80ab4 >> (32 - TINYUF2_DBL_TAP_REG_SIZE)) // Erase entire application !!
+#define DBL_TAP_MAGIC_STAGED_UPDATE (0xf5a9e11c >> (32 - TINYUF2_DBL_TAP_REG_SIZE)) // Copy image staged by application, see staged_update.h
 
 //--------------------------------------------------------------------+
 // Basic API
@@ -194,8 +243,18 @@ void board_dfu_complete(void);
 // Fill Serial Number and return its length (limit to 16 bytes)
 uint8_t board_usb_get_serial(uint8_t serial_id[16]);
 
-// Check if NRST pin is used to reset the board
-// bool board_reseted_by_nrst(void);
+typedef enum {
+  BOARD_RESET_UNKNOWN = 0,
+  BOARD_RESET_POWER_ON,   // power-on or brown-out
+  BOARD_RESET_PIN,        // external reset pin (NRST) only
+  BOARD_RESET_WATCHDOG,
+  BOARD_RESET_SOFTWARE,   // e.g NVIC_SystemReset() from application or bootloader
+} board_reset_cause_t;
+
+// Get cause of last reset and clear hardware reset flags so that they don't pile up (optional).
+// Raw flags are saved to TINYUF2_RESET_FLAGS_REG before clearing, application reads them there.
+// Double tap delay is only waited for BOARD_RESET_PIN and BOARD_RESET_UNKNOWN
+board_reset_cause_t board_reset_cause(void) __attribute__ ((weak));
 
 //--------------------------------------------------------------------+
 // Flash API
@@ -213,15 +272,78 @@ void board_flash_read (uint32_t addr, void* buffer, uint32_t len);
 // Write to flash, len is uf2's payload size (often 256 bytes)
 bool board_flash_write(uint32_t addr, void const* data, uint32_t len);
 
-// Flush/Sync flash contents
-void board_flash_flush(void);
+// Flush/Sync flash contents, return false if any write since last flush failed
+bool board_flash_flush(void);
+
+// Check if flash is still busy with an operation running in background (optional).
+// UF2 blocks are not written (host will retry them) while busy, so that USB keeps going meanwhile
+bool board_flash_busy(void) __attribute__ ((weak));
 
 // Erase application
 void board_flash_erase_app(void);
 
+// Erase the whole sector containing addr (optional), so that it can be written again before next
+// board_flash_init(). Needed by ports whose board_flash_write() erases a sector only the first time
+bool board_flash_erase_sector(uint32_t addr) __attribute__ ((weak));
+
 // Protect bootloader in flash
 bool board_flash_protect_bootloader(bool protect);
 
+// Memory region/partition exposed as its own <name>.UF2 and <name>.BIN readback files
+typedef struct {
+  char const* name; // up to 8 upper case characters (FAT 8.3)
+  uint32_t addr;    // start address as used by board_flash_read()
+  uint32_t size;    // multiple of 256 (UF2 payload size)
+} board_flash_region_t;
+
+// Get table of flash regions for readback files (optional), return number of regions
+uint32_t board_flash_get_regions(board_flash_region_t const** regions) __attribute__ ((weak));
+
+//--------------------------------------------------------------------+
+// RAM run (optional)
+// A UF2 file whose blocks all target RAM is loaded with board_flash_write() without
+// erasing or programming flash, and started right after its last block without reset
+//--------------------------------------------------------------------+
+
+// Check if range is RAM that an application can be loaded to and run from
+bool board_ram_run_range(uint32_t addr, uint32_t len) __attribute__ ((weak));
+
+// Start application loaded to RAM, addr is its lowest address (vector table). Should not return
+void board_ram_run(uint32_t addr) __attribute__ ((weak));
+
+//--------------------------------------------------------------------+
+// Data Flash API (second MSC LUN)
+//--------------------------------------------------------------------+
+
+#if TINYUF2_MSC_DATA_LUN
+// Get size of data flash in bytes, 0 if not available
+uint32_t board_data_flash_size(void);
+
+// Read from data flash, addr is relative to start of data flash
+void board_data_flash_read(uint32_t addr, void* buffer, uint32_t len);
+
+// Erase and program data flash. addr and len are aligned to TINYUF2_MSC_DATA_CACHE_SIZE
+bool board_data_flash_write(uint32_t addr, void const* data, uint32_t len);
+#endif
+
+//--------------------------------------------------------------------+
+// SD Card API (offline update)
+//--------------------------------------------------------------------+
+
+#if TINYUF2_SD_UPDATE
+// Detect and initialize SD card, return false if no card is inserted or it fails to init
+bool board_sd_init(void);
+
+// Release SD card and its pins/peripheral, called before jumping to application
+void board_sd_deinit(void);
+
+// Get number of 512-byte blocks of the card
+uint32_t board_sd_block_count(void);
+
+// Read count consecutive 512-byte blocks (multi-block read)
+bool board_sd_read(uint32_t block, void* buffer, uint32_t count);
+#endif
+
 //--------------------------------------------------------------------+
 // Display API
 //--------------------------------------------------------------------+
@@ -0,0 +1,234 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <string.h>
+#include "checksum.h"
+
+//--------------------------------------------------------------------+
+// CRC32
+//--------------------------------------------------------------------+
+
+// Bitwise implementation to save flash, table-less
+uint32_t tuf2_crc32(uint32_t crc, void const* buf, uint32_t len) {
+  uint8_t const* p = (uint8_t const*) buf;
+
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+//--------------------------------------------------------------------+
+// SHA-256 (FIPS 180-4)
+//--------------------------------------------------------------------+
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR32(_x, _n)   (((_x) >> (_n)) | ((_x) << (32 - (_n))))
+
+static void sha256_transform(tuf2_sha256_t* ctx, uint8_t const block[64]) {
+  uint32_t w[64];
+
+  for (uint32_t i = 0; i < 16; i++) {
+    w[i] = ((uint32_t) block[4*i] << 24) | ((uint32_t) block[4*i+1] << 16) |
+           ((uint32_t) block[4*i+2] << 8) | block[4*i+3];
+  }
+
+  for (uint32_t i = 16; i < 64; i++) {
+    uint32_t const s0 = ROR32(w[i-15], 7) ^ ROR32(w[i-15], 18) ^ (w[i-15] >> 3);
+    uint32_t const s1 = ROR32(w[i-2], 17) ^ ROR32(w[i-2], 19) ^ (w[i-2] >> 10);
+    w[i] = w[i-16] + s0 + w[i-7] + s1;
+  }
+
+  uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+  uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+
+  for (uint32_t i = 0; i < 64; i++) {
+    uint32_t const t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+    uint32_t const t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+
+  ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d;
+  ctx->state[4] += e; ctx->state[5] += f; ctx->state[6] += g; ctx->state[7] += h;
+}
+
+void tuf2_sha256_init(tuf2_sha256_t* ctx) {
+  static const uint32_t init_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(ctx->state, init_state, sizeof(init_state));
+  ctx->count = 0;
+}
+
+void tuf2_sha256_update(tuf2_sha256_t* ctx, void const* data, uint32_t len) {
+  uint8_t const* p = (uint8_t const*) data;
+
+  while (len) {
+    uint32_t const idx = (uint32_t) (ctx->count & 63);
+    uint32_t const n = (64 - idx < len) ? (64 - idx) : len;
+
+    memcpy(ctx->buf + idx, p, n);
+    ctx->count += n;
+    p += n;
+    len -= n;
+
+    if ((ctx->count & 63) == 0) sha256_transform(ctx, ctx->buf);
+  }
+}
+
+void tuf2_sha256_final(tuf2_sha256_t* ctx, uint8_t digest[32]) {
+  uint64_t const bit_count = ctx->count * 8;
+  uint8_t pad[72] = { 0x80 };
+
+  // pad to 56 mod 64, then append length in bits (big endian)
+  uint32_t const idx = (uint32_t) (ctx->count & 63);
+  uint32_t const pad_len = (idx < 56) ? (56 - idx) : (120 - idx);
+  for (uint32_t i = 0; i < 8; i++) {
+    pad[pad_len + i] = (uint8_t) (bit_count >> (56 - 8*i));
+  }
+  tuf2_sha256_update(ctx, pad, pad_len + 8);
+
+  for (uint32_t i = 0; i < 8; i++) {
+    digest[4*i  ] = (uint8_t) (ctx->state[i] >> 24);
+    digest[4*i+1] = (uint8_t) (ctx->state[i] >> 16);
+    digest[4*i+2] = (uint8_t) (ctx->state[i] >> 8);
+    digest[4*i+3] = (uint8_t) (ctx->state[i]);
+  }
+}
+
+//--------------------------------------------------------------------+
+// MD5 (RFC 1321)
+//--------------------------------------------------------------------+
+
+static const uint32_t md5_k[64] = {
+  0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+  0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+  0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+  0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+  0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+  0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+  0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+  0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+// shift amount of each round, 4 per round
+static const uint8_t md5_r[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+
+#define ROL32(_x, _n)   (((_x) << (_n)) | ((_x) >> (32 - (_n))))
+
+static void md5_transform(tuf2_md5_t* ctx, uint8_t const block[64]) {
+  uint32_t m[16];
+
+  for (uint32_t i = 0; i < 16; i++) {
+    m[i] = block[4*i] | ((uint32_t) block[4*i+1] << 8) |
+           ((uint32_t) block[4*i+2] << 16) | ((uint32_t) block[4*i+3] << 24);
+  }
+
+  uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+
+  for (uint32_t i = 0; i < 64; i++) {
+    uint32_t f, g;
+    if (i < 16) {
+      f = (b & c) | (~b & d);
+      g = i;
+    } else if (i < 32) {
+      f = (d & b) | (~d & c);
+      g = (5*i + 1) & 15;
+    } else if (i < 48) {
+      f = b ^ c ^ d;
+      g = (3*i + 5) & 15;
+    } else {
+      f = c ^ (b | ~d);
+      g = (7*i) & 15;
+    }
+
+    uint32_t const tmp = d;
+    d = c;
+    c = b;
+    b = b + ROL32(a + f + md5_k[i] + m[g], md5_r[(i / 16) * 4 + (i & 3)]);
+    a = tmp;
+  }
+
+  ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d;
+}
+
+void tuf2_md5_init(tuf2_md5_t* ctx) {
+  ctx->state[0] = 0x67452301;
+  ctx->state[1] = 0xefcdab89;
+  ctx->state[2] = 0x98badcfe;
+  ctx->state[3] = 0x10325476;
+  ctx->count = 0;
+}
+
+void tuf2_md5_update(tuf2_md5_t* ctx, void const* data, uint32_t len) {
+  uint8_t const* p = (uint8_t const*) data;
+
+  while (len) {
+    uint32_t const idx = (uint32_t) (ctx->count & 63);
+    uint32_t const n = (64 - idx < len) ? (64 - idx) : len;
+
+    memcpy(ctx->buf + idx, p, n);
+    ctx->count += n;
+    p += n;
+    len -= n;
+
+    if ((ctx->count & 63) == 0) md5_transform(ctx, ctx->buf);
+  }
+}
+
+void tuf2_md5_final(tuf2_md5_t* ctx, uint8_t digest[16]) {
+  uint64_t const bit_count = ctx->count * 8;
+  uint8_t pad[72] = { 0x80 };
+
+  // same padding as SHA-256 but length in bits is little endian
+  uint32_t const idx = (uint32_t) (ctx->count & 63);
+  uint32_t const pad_len = (idx < 56) ? (56 - idx) : (120 - idx);
+  for (uint32_t i = 0; i < 8; i++) {
+    pad[pad_len + i] = (uint8_t) (bit_count >> (8*i));
+  }
+  tuf2_md5_update(ctx, pad, pad_len + 8);
+
+  for (uint32_t i = 0; i < 4; i++) {
+    digest[4*i  ] = (uint8_t) (ctx->state[i]);
+    digest[4*i+1] = (uint8_t) (ctx->state[i] >> 8);
+    digest[4*i+2] = (uint8_t) (ctx->state[i] >> 16);
+    digest[4*i+3] = (uint8_t) (ctx->state[i] >> 24);
+  }
+}
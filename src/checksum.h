@@ -0,0 +1,66 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef CHECKSUM_H_
+#define CHECKSUM_H_
+
+#include <stdint.h>
+
+//--------------------------------------------------------------------+
+// CRC32 (IEEE 802.3, same as zlib)
+//--------------------------------------------------------------------+
+
+// Update crc with buffer, start with crc = 0
+uint32_t tuf2_crc32(uint32_t crc, void const* buf, uint32_t len);
+
+//--------------------------------------------------------------------+
+// SHA-256
+//--------------------------------------------------------------------+
+
+typedef struct {
+  uint32_t state[8];
+  uint64_t count;      // total bytes
+  uint8_t buf[64];
+} tuf2_sha256_t;
+
+void tuf2_sha256_init(tuf2_sha256_t* ctx);
+void tuf2_sha256_update(tuf2_sha256_t* ctx, void const* data, uint32_t len);
+void tuf2_sha256_final(tuf2_sha256_t* ctx, uint8_t digest[32]);
+
+//--------------------------------------------------------------------+
+// MD5, only for protocols that require it e.g ESP32 ROM loader
+//--------------------------------------------------------------------+
+
+typedef struct {
+  uint32_t state[4];
+  uint64_t count;      // total bytes
+  uint8_t buf[64];
+} tuf2_md5_t;
+
+void tuf2_md5_init(tuf2_md5_t* ctx);
+void tuf2_md5_update(tuf2_md5_t* ctx, void const* data, uint32_t len);
+void tuf2_md5_final(tuf2_md5_t* ctx, uint8_t digest[16]);
+
+#endif
@@ -31,6 +31,11 @@
 #include "compile_date.h"
 #include "board_api.h"
 #include "uf2.h"
+#include "checksum.h"
+
+#if TINYUF2_APP_CHECK
+#include "app_check.h"
+#endif
 
 //--------------------------------------------------------------------+
 //
@@ -39,6 +44,11 @@
 // ota0 partition size
 static uint32_t _flash_size;
 
+#if TINYUF2_APP_CHECK
+// length of image just completed, descriptor is recorded by uf2_task() out of the write callback
+static uint32_t _app_check_len;
+#endif
+
 #define STATIC_ASSERT(_exp) _Static_assert(_exp, "static assert failed")
 
 #define STR0(x) #x
@@ -88,15 +98,27 @@ typedef struct {
 STATIC_ASSERT(sizeof(DirEntry) == 32);
 
 typedef struct FileContent {
-  char const name[11];
+  char name[11];
   void const * content;
   uint32_t size;       // OK to use uint32_T b/c FAT32 limits filesize to (4GiB - 2)
 
+  // generated files (content is NULL): flash range and format
+  uint32_t flash_addr;
+  uint32_t flash_end;
+  uint8_t type;
+
   // computing fields based on index and size
   uint16_t cluster_start;
   uint16_t cluster_end;
 } FileContent_t;
 
+// format of generated files
+enum {
+  FILE_TYPE_UF2 = 0,
+  FILE_TYPE_BIN,
+  FILE_TYPE_SHA,
+};
+
 //--------------------------------------------------------------------+
 //
 //--------------------------------------------------------------------+
@@ -155,16 +177,29 @@ TINYUF2_CONST char indexFile[] =
 const char autorunFile[] = "[Autorun]\r\nIcon=FAVICON.ICO\r\n";
 #endif
 
+#ifdef TINYUF2_FAVICON_HEADER
+  #define NUM_FAVICON_FILES 2
+#else
+  #define NUM_FAVICON_FILES 0
+#endif
+
+#define NUM_STATIC_FILES    (3 + NUM_FAVICON_FILES + (CFG_UF2_SHA_FILE ? 1 : 0))
+
 // size of CURRENT.UF2:
-static FileContent_t info[] = {
+static FileContent_t info[NUM_STATIC_FILES + 2*CFG_UF2_REGION_MAX] = {
     {.name = "INFO_UF2TXT", .content = infoUf2File , .size = sizeof(infoUf2File) - 1},
     {.name = "INDEX   HTM", .content = indexFile   , .size = sizeof(indexFile  ) - 1},
 #ifdef TINYUF2_FAVICON_HEADER
     {.name = "AUTORUN INF", .content = autorunFile , .size = sizeof(autorunFile) - 1},
     {.name = "FAVICON ICO", .content = favicon_data, .size = favicon_len            },
 #endif
-    // current.uf2 must be the last element and its content must be NULL
+#if CFG_UF2_SHA_FILE
+    {.name = "CURRENT SHA", .content = NULL       , .size = 0, .type = FILE_TYPE_SHA},
+#endif
+    // current.uf2 must be the last static element and its content must be NULL
     {.name = "CURRENT UF2", .content = NULL       , .size = 0                       },
+
+    // followed by <REGION>.UF2 and <REGION>.BIN for each board flash region, filled by uf2_init()
 };
 
 enum {
@@ -175,11 +210,13 @@ enum {
 enum {
   FID_INFO = 0,
   FID_INDEX = 1,
-  FID_UF2 = NUM_FILES - 1,
+  FID_UF2 = NUM_STATIC_FILES - 1,
 };
 
 STATIC_ASSERT(NUM_DIRENTRIES < BPB_ROOT_DIR_ENTRIES);  // FAT requirement -- Ensures BPB reserves sufficient entries for all files
-STATIC_ASSERT(NUM_DIRENTRIES < DIRENTRIES_PER_SECTOR); // GhostFAT bug workaround -- else, code overflows buffer
+
+// number of files actually in use, region files may not all be present
+static uint32_t _num_files = FID_UF2 + 1;
 
 #define NUM_SECTORS_IN_DATA_REGION (BPB_TOTAL_SECTORS - BPB_RESERVED_SECTORS - (BPB_NUMBER_OF_FATS * BPB_SECTORS_PER_FAT) - ROOT_DIR_SECTOR_COUNT)
 #define CLUSTER_COUNT              (NUM_SECTORS_IN_DATA_REGION / BPB_SECTORS_PER_CLUSTER)
@@ -225,6 +262,55 @@ static FAT_BootBlock TINYUF2_CONST BootBlock = {
 //
 //--------------------------------------------------------------------+
 
+//--------------------------------------------------------------------+
+// RAM overlay for non-UF2 sectors written by host
+//--------------------------------------------------------------------+
+#if CFG_UF2_OVERLAY_SECTORS
+
+typedef struct {
+  uint32_t block_no;
+  uint8_t data[BPB_SECTOR_SIZE];
+} OverlaySector_t;
+
+static OverlaySector_t _overlay[CFG_UF2_OVERLAY_SECTORS];
+static uint32_t _overlay_count = 0;
+
+static OverlaySector_t* overlay_find(uint32_t block_no) {
+  for (uint32_t i = 0; i < _overlay_count; i++) {
+    if (_overlay[i].block_no == block_no) return &_overlay[i];
+  }
+  return NULL;
+}
+
+// Keep a copy of a sector written by host. Once all slots are used, file system metadata
+// (boot, FAT, root directory) can still replace a sector from the data region.
+// Return false if there is no slot left for this sector
+static bool overlay_write(uint32_t block_no, uint8_t const *data) {
+  OverlaySector_t* ov = overlay_find(block_no);
+
+  if (!ov) {
+    if (_overlay_count < CFG_UF2_OVERLAY_SECTORS) {
+      ov = &_overlay[_overlay_count++];
+    } else if (block_no < FS_START_CLUSTERS_SECTOR) {
+      for (uint32_t i = 0; i < _overlay_count; i++) {
+        if (_overlay[i].block_no >= FS_START_CLUSTERS_SECTOR) {
+          ov = &_overlay[i];
+          break;
+        }
+      }
+    }
+  }
+
+  if (!ov) return false;
+
+  ov->block_no = block_no;
+  memcpy(ov->data, data, BPB_SECTOR_SIZE);
+
+  return true;
+}
+
+#endif
+
 static inline bool is_uf2_block (UF2_Block const *bl) {
   return (bl->magicStart0 == UF2_MAGIC_START0) &&
          (bl->magicStart1 == UF2_MAGIC_START1) &&
@@ -239,7 +325,7 @@ static void init_starting_clusters(void) {
   // +2 because FAT decided first data sector would be in cluster number 2, rather than zero
   uint16_t start_cluster = 2;
 
-  for (uint16_t i = 0; i < NUM_FILES; i++) {
+  for (uint16_t i = 0; i < _num_files; i++) {
     info[i].cluster_start = start_cluster;
     info[i].cluster_end = start_cluster + UF2_DIV_CEIL(info[i].size, BPB_SECTOR_SIZE*BPB_SECTORS_PER_CLUSTER) - 1;
 
@@ -248,7 +334,7 @@ static void init_starting_clusters(void) {
 }
 
 // get file index for file that uses the cluster
-// if cluster is past last file, returns ( NUM_FILES-1 ).
+// if cluster is past last file, returns FID_UF2.
 //
 // Caller must still check if a particular *sector*
 // contains data from the file's contents, as there
@@ -258,7 +344,7 @@ static uint32_t info_index_of(uint32_t cluster) {
   // default results for invalid requests is the index of the last file (CURRENT.UF2)
   if (cluster >= 0xFFF0) return FID_UF2;
 
-  for (uint32_t i = 0; i < NUM_FILES; i++) {
+  for (uint32_t i = 0; i < _num_files; i++) {
     if ( (info[i].cluster_start <= cluster) && (cluster <= info[i].cluster_end) ) {
       return i;
     }
@@ -277,12 +363,238 @@ static void u32_to_hexstr(uint32_t value, char* buffer) {
   buffer[i] = '\0';
 }
 
+#if CFG_UF2_SHA_FILE
+//--------------------------------------------------------------------+
+// CURRENT.SHA: size, CRC32 and SHA-256 of application image (excluding trailing erased bytes)
+// computed in background by uf2_task() once the file is read, and cached until flash is written.
+// Optionally followed by CRC32 of each CFG_UF2_SHA_SECTOR_SIZE sector of application region.
+//--------------------------------------------------------------------+
+
+#define SHA_HEADER_SIZE   (sizeof(sha_header_fmt) - 1)
+#define SHA_LINE_SIZE     32
+#if CFG_UF2_SHA_SECTOR_SIZE
+  #define SHA_SECTOR_MAX    UF2_DIV_CEIL(CFG_UF2_FLASH_SIZE, CFG_UF2_SHA_SECTOR_SIZE)
+  #define SHA_SECTOR_COUNT  UF2_DIV_CEIL(_app_hash.region_size, CFG_UF2_SHA_SECTOR_SIZE)
+  STATIC_ASSERT(CFG_UF2_SHA_SECTOR_SIZE % BPB_SECTOR_SIZE == 0);
+#else
+  #define SHA_SECTOR_COUNT  0
+#endif
+
+// flash read by uf2_task() each call, keeps USB serviced between chunks
+#define SHA_TASK_CHUNK    (8*BPB_SECTOR_SIZE)
+
+STATIC_ASSERT(BPB_SECTOR_SIZE % SHA_LINE_SIZE == 0);
+
+// fixed width, '-' are filled with hex values
+static char const sha_header_fmt[] =
+    "Size: --------\r\n"
+    "CRC32: --------\r\n"
+    "SHA256: ----------------------------------------------------------------\r\n"
+#if CFG_UF2_SHA_SECTOR_SIZE
+    "Sector-Size: --------\r\n"
+#endif
+    ;
+
+enum {
+  SHA_STATE_STALE = 0, // flash changed, computed on next read
+  SHA_STATE_FIND_END,  // scanning backward for end of image
+  SHA_STATE_HASH,      // hashing forward
+  SHA_STATE_VALID,
+};
+
+static struct {
+  uint8_t state;
+  uint32_t region_size; // application region
+  uint32_t offset;      // progress of current state
+
+  uint32_t size;
+  uint32_t crc32;
+  uint8_t sha256[32];
+  tuf2_sha256_t sha;
+
+#if CFG_UF2_SHA_SECTOR_SIZE
+  uint32_t sector_crc[SHA_SECTOR_MAX];
+#endif
+} _app_hash;
+
+static uint8_t _sha_buf[BPB_SECTOR_SIZE] __attribute__((aligned(4)));
+
+static void sha_file_init(FileContent_t* inf) {
+  inf->flash_addr = BOARD_FLASH_APP_START;
+  inf->flash_end = BOARD_FLASH_ADDR_ZERO + _flash_size;
+
+  _app_hash.state = SHA_STATE_STALE;
+  _app_hash.region_size = inf->flash_end - inf->flash_addr;
+#if CFG_UF2_SHA_SECTOR_SIZE
+  // per-sector lines are limited to CFG_UF2_FLASH_SIZE
+  if (_app_hash.region_size > CFG_UF2_FLASH_SIZE) _app_hash.region_size = CFG_UF2_FLASH_SIZE;
+#endif
+
+  // header is padded to one sector if followed by per-sector lines
+  inf->size = SHA_SECTOR_COUNT ? (BPB_SECTOR_SIZE + SHA_SECTOR_COUNT * SHA_LINE_SIZE) : SHA_HEADER_SIZE;
+}
+
+static void hex_write(char* dst, uint8_t const* src, uint32_t count) {
+  const char hexDigits[] = "0123456789ABCDEF";
+  for (uint32_t i = 0; i < count; i++) {
+    *dst++ = hexDigits[src[i] >> 4];
+    *dst++ = hexDigits[src[i] & 0xF];
+  }
+}
+
+static void u32_write(char* dst, uint32_t value) {
+  uint8_t const be[4] = { (uint8_t) (value >> 24), (uint8_t) (value >> 16), (uint8_t) (value >> 8), (uint8_t) value };
+  hex_write(dst, be, 4);
+}
+
+// Process up to SHA_TASK_CHUNK bytes of pending hash work
+static void sha_task(void) {
+  uint32_t const start = BOARD_FLASH_APP_START;
+
+  for (uint32_t done = 0; done < SHA_TASK_CHUNK; done += BPB_SECTOR_SIZE) {
+    if (_app_hash.state == SHA_STATE_FIND_END) {
+      // offset counts down from end of region, image ends at the last non-erased byte
+      if (_app_hash.offset == 0) {
+        _app_hash.size = 0;
+      } else {
+        uint32_t const len = (_app_hash.offset < BPB_SECTOR_SIZE) ? _app_hash.offset : BPB_SECTOR_SIZE;
+        _app_hash.offset -= len;
+        board_flash_read(start + _app_hash.offset, _sha_buf, len);
+
+        uint32_t i = len;
+        while (i > 0 && _sha_buf[i-1] == 0xff) i--;
+        if (i == 0) continue;
+
+        _app_hash.size = _app_hash.offset + i;
+      }
+
+      _app_hash.state = SHA_STATE_HASH;
+      _app_hash.offset = 0;
+      _app_hash.crc32 = 0;
+      tuf2_sha256_init(&_app_hash.sha);
+#if CFG_UF2_SHA_SECTOR_SIZE
+      memset(_app_hash.sector_crc, 0, sizeof(_app_hash.sector_crc));
+#endif
+    } else if (_app_hash.state == SHA_STATE_HASH) {
+      // per-sector CRCs cover the whole region, image hashes stop at image size
+      uint32_t const hash_end = CFG_UF2_SHA_SECTOR_SIZE ? _app_hash.region_size : _app_hash.size;
+      uint32_t const offset = _app_hash.offset;
+
+      if (offset >= hash_end) {
+        tuf2_sha256_final(&_app_hash.sha, _app_hash.sha256);
+        _app_hash.state = SHA_STATE_VALID;
+        return;
+      }
+
+      uint32_t const len = (hash_end - offset < BPB_SECTOR_SIZE) ? (hash_end - offset) : BPB_SECTOR_SIZE;
+      board_flash_read(start + offset, _sha_buf, len);
+
+      if (offset < _app_hash.size) {
+        uint32_t const img_len = (_app_hash.size - offset < len) ? (_app_hash.size - offset) : len;
+        _app_hash.crc32 = tuf2_crc32(_app_hash.crc32, _sha_buf, img_len);
+        tuf2_sha256_update(&_app_hash.sha, _sha_buf, img_len);
+      }
+
+#if CFG_UF2_SHA_SECTOR_SIZE
+      // BPB_SECTOR_SIZE chunks never straddle CFG_UF2_SHA_SECTOR_SIZE sectors
+      uint32_t const idx = offset / CFG_UF2_SHA_SECTOR_SIZE;
+      _app_hash.sector_crc[idx] = tuf2_crc32(_app_hash.sector_crc[idx], _sha_buf, len);
+#endif
+
+      _app_hash.offset += len;
+    } else {
+      return;
+    }
+  }
+}
+
+// Return false if hashes are not computed yet, computation is started if needed
+static bool sha_file_read(uint32_t file_sector, uint8_t* data) {
+  if (_app_hash.state == SHA_STATE_STALE) {
+    _app_hash.state = SHA_STATE_FIND_END;
+    _app_hash.offset = _app_hash.region_size;
+  }
+  if (_app_hash.state != SHA_STATE_VALID) return false;
+
+  if (file_sector == 0) {
+    char* txt = (char*) data;
+    memset(txt, ' ', BPB_SECTOR_SIZE);
+    memcpy(txt, sha_header_fmt, SHA_HEADER_SIZE);
+
+    u32_write(txt + 6, _app_hash.size);
+    u32_write(txt + 16 + 7, _app_hash.crc32);
+    hex_write(txt + 16 + 17 + 8, _app_hash.sha256, 32);
+#if CFG_UF2_SHA_SECTOR_SIZE
+    u32_write(txt + 16 + 17 + 74 + 13, CFG_UF2_SHA_SECTOR_SIZE);
+    txt[BPB_SECTOR_SIZE-2] = '\r';
+    txt[BPB_SECTOR_SIZE-1] = '\n';
+#else
+    memset(txt + SHA_HEADER_SIZE, 0, BPB_SECTOR_SIZE - SHA_HEADER_SIZE);
+#endif
+  }
+#if CFG_UF2_SHA_SECTOR_SIZE
+  else {
+    // per-sector lines: "<address> <crc32>"
+    uint32_t const first = (file_sector - 1) * (BPB_SECTOR_SIZE / SHA_LINE_SIZE);
+
+    for (uint32_t i = 0; i < BPB_SECTOR_SIZE / SHA_LINE_SIZE && first + i < SHA_SECTOR_COUNT; i++) {
+      char* line = (char*) data + i * SHA_LINE_SIZE;
+      memset(line, ' ', SHA_LINE_SIZE);
+      u32_write(line, BOARD_FLASH_APP_START + (first + i) * CFG_UF2_SHA_SECTOR_SIZE);
+      u32_write(line + 9, _app_hash.sector_crc[first + i]);
+      line[SHA_LINE_SIZE-2] = '\r';
+      line[SHA_LINE_SIZE-1] = '\n';
+    }
+  }
+#endif
+
+  return true;
+}
+#endif
+
+#if CFG_UF2_REGION_MAX
+// Add <NAME>.UF2 and <NAME>.BIN readback files for each board flash region
+static void init_region_files(void) {
+  board_flash_region_t const* regions = NULL;
+  uint32_t count = board_flash_get_regions ? board_flash_get_regions(&regions) : 0;
+  if (count > CFG_UF2_REGION_MAX) count = CFG_UF2_REGION_MAX;
+
+  for (uint32_t r = 0; r < count; r++) {
+    board_flash_region_t const* region = &regions[r];
+
+    for (uint32_t k = 0; k < 2; k++) {
+      FileContent_t* inf = &info[_num_files++];
+
+      memset(inf->name, ' ', 8);
+      memcpy(inf->name, region->name, strnlen(region->name, 8));
+      memcpy(inf->name + 8, k ? "BIN" : "UF2", 3);
+
+      inf->content    = NULL;
+      inf->type       = k ? FILE_TYPE_BIN : FILE_TYPE_UF2;
+      inf->flash_addr = region->addr;
+      inf->flash_end  = region->addr + region->size;
+      inf->size       = k ? region->size : (region->size / UF2_FIRMWARE_BYTES_PER_SECTOR) * BPB_SECTOR_SIZE;
+    }
+  }
+}
+#endif
+
 void uf2_init(void) {
   // TODO maybe limit to application size only if possible board_flash_app_size()
   _flash_size = board_flash_size();
 
   // update CURRENT.UF2 file size
   info[FID_UF2].size = UF2_BYTE_COUNT;
+  info[FID_UF2].flash_addr = BOARD_FLASH_APP_START;
+  info[FID_UF2].flash_end = BOARD_FLASH_ADDR_ZERO + _flash_size;
+
+  _num_files = FID_UF2 + 1;
+#if CFG_UF2_SHA_FILE
+  sha_file_init(&info[FID_UF2 - 1]);
+#endif
+#if CFG_UF2_REGION_MAX
+  init_region_files();
+#endif
 
   // update INFO_UF2.TXT with flash size if having enough space (8 bytes)
   size_t txt_len = strlen(infoUf2File);
@@ -299,6 +611,34 @@ void uf2_init(void) {
   info[FID_INFO].size = txt_len;
 
   init_starting_clusters();
+
+  // drop region files that do not fit into the volume
+  while ( (_num_files > FID_UF2 + 1) && (info[_num_files-1].cluster_end >= CLUSTER_COUNT + 2) ) {
+    _num_files--;
+  }
+}
+
+// Background work that is too long for USB callbacks, called from main loop
+void uf2_task(void) {
+#if TINYUF2_APP_CHECK
+  if (_app_check_len) {
+    uint32_t const len = _app_check_len;
+    _app_check_len = 0;
+    (void) app_check_record(BOARD_FLASH_APP_START, len);
+  }
+#endif
+
+#if CFG_UF2_SHA_FILE
+  sha_task();
+#endif
+}
+
+// All flash writes of application contents go through here to keep generated files up to date
+bool uf2_flash_write(uint32_t addr, void const* data, uint32_t len) {
+#if CFG_UF2_SHA_FILE
+  _app_hash.state = SHA_STATE_STALE;
+#endif
+  return board_flash_write(addr, data, len);
 }
 
 /*------------------------------------------------------------------*/
@@ -315,7 +655,7 @@ void padded_memcpy (char *dst, char const *src, int len) {
   }
 }
 
-void uf2_read_block (uint32_t block_no, uint8_t *data) {
+bool uf2_read_block (uint32_t block_no, uint8_t *data) {
   memset(data, 0, BPB_SECTOR_SIZE);
   uint32_t sectionRelativeSector = block_no;
 
@@ -336,7 +676,7 @@ void uf2_read_block (uint32_t block_no, uint8_t *data) {
 
     uint16_t* data16 = (uint16_t*) (void*) data;
     uint32_t sectorFirstCluster = sectionRelativeSector * FAT_ENTRIES_PER_SECTOR;
-    uint32_t firstUnusedCluster = info[FID_UF2].cluster_end + 1;
+    uint32_t firstUnusedCluster = info[_num_files-1].cluster_end + 1;
 
     // OPTIMIZATION:
     // Because all files are contiguous, the FAT CHAIN entries
@@ -368,7 +708,7 @@ void uf2_read_block (uint32_t block_no, uint8_t *data) {
     }
 
     // Exception #2: the final cluster of each file must be set to END_OF_CHAIN
-    for (uint32_t i = 0; i < NUM_FILES; i++) {
+    for (uint32_t i = 0; i < _num_files; i++) {
       uint32_t lastClusterOfFile = info[i].cluster_end;
       if (lastClusterOfFile >= sectorFirstCluster) {
         uint32_t idx = lastClusterOfFile - sectorFirstCluster;
@@ -402,8 +742,8 @@ void uf2_read_block (uint32_t block_no, uint8_t *data) {
     }
 
     for ( uint32_t fileIndex = startingFileIndex;
-          remainingEntries > 0 && fileIndex < NUM_FILES; // while space remains in buffer and more files to add...
-          fileIndex++, d++ ) {
+          remainingEntries > 0 && fileIndex < _num_files; // while space remains in buffer and more files to add...
+          fileIndex++, d++, remainingEntries-- ) {
       // WARNING -- code presumes all files take exactly one directory entry (no long file names!)
       uint32_t const startCluster = info[fileIndex].cluster_start;
 
@@ -417,7 +757,7 @@ void uf2_read_block (uint32_t block_no, uint8_t *data) {
       d->updateTime       = COMPILE_DOS_TIME;
       d->updateDate       = COMPILE_DOS_DATE;
       d->startCluster     = startCluster & 0xFFFF;
-      d->size             = (inf->content ? inf->size : UF2_BYTE_COUNT);
+      d->size             = inf->size;
     }
   }
   else if ( block_no < BPB_TOTAL_SECTORS ) {
@@ -430,8 +770,8 @@ void uf2_read_block (uint32_t block_no, uint8_t *data) {
 
     uint32_t fileRelativeSector = sectionRelativeSector - (info[fid].cluster_start-2) * BPB_SECTORS_PER_CLUSTER;
 
-    if ( fid != FID_UF2 ) {
-      // Handle all files other than CURRENT.UF2
+    if ( inf->content ) {
+      // Handle all files with static contents
       size_t fileContentStartOffset = fileRelativeSector * BPB_SECTOR_SIZE;
       size_t fileContentLength = inf->size;
 
@@ -448,25 +788,47 @@ void uf2_read_block (uint32_t block_no, uint8_t *data) {
         memcpy(data, dataStart, bytesToCopy);
       }
     }
+#if CFG_UF2_SHA_FILE
+    else if ( inf->type == FILE_TYPE_SHA ) {
+      // CURRENT.SHA: hashes of application image
+      if ( !sha_file_read(fileRelativeSector, data) ) return false;
+    }
+#endif
+    else if ( inf->type == FILE_TYPE_BIN ) {
+      // <REGION>.BIN: read flash directly
+      uint32_t const offset = fileRelativeSector * BPB_SECTOR_SIZE;
+      if ( offset < inf->size ) {
+        uint32_t const len = (inf->size - offset < BPB_SECTOR_SIZE) ? (inf->size - offset) : BPB_SECTOR_SIZE;
+        board_flash_read(inf->flash_addr + offset, data, len);
+      }
+    }
     else {
-      // CURRENT.UF2: generate data on-the-fly
-      uint32_t addr = BOARD_FLASH_APP_START + (fileRelativeSector * UF2_FIRMWARE_BYTES_PER_SECTOR);
-      if ( addr < (BOARD_FLASH_ADDR_ZERO + _flash_size) ) {
+      // CURRENT.UF2 and <REGION>.UF2: generate data on-the-fly
+      uint32_t addr = inf->flash_addr + (fileRelativeSector * UF2_FIRMWARE_BYTES_PER_SECTOR);
+      if ( addr < inf->flash_end ) {
         UF2_Block *bl = (void*) data;
         bl->magicStart0 = UF2_MAGIC_START0;
         bl->magicStart1 = UF2_MAGIC_START1;
         bl->magicEnd = UF2_MAGIC_END;
         bl->blockNo = fileRelativeSector;
-        bl->numBlocks = UF2_SECTOR_COUNT;
+        bl->numBlocks = inf->size / BPB_SECTOR_SIZE;
         bl->targetAddr = addr;
         bl->payloadSize = UF2_FIRMWARE_BYTES_PER_SECTOR;
         bl->flags = UF2_FLAG_FAMILYID;
-        bl->familyID = BOARD_UF2_FAMILY_ID;
+        bl->familyID = CFG_UF2_FAMILY_ID;
 
         board_flash_read(addr, bl->data, bl->payloadSize);
       }
     }
   }
+
+#if CFG_UF2_OVERLAY_SECTORS
+  // sector previously written by host takes precedence over generated contents
+  OverlaySector_t const* ov = overlay_find(block_no);
+  if (ov) memcpy(data, ov->data, BPB_SECTOR_SIZE);
+#endif
+
+  return true;
 }
 
 /*------------------------------------------------------------------*/
@@ -477,18 +839,66 @@ void uf2_read_block (uint32_t block_no, uint8_t *data) {
  * Write an uf2 block wrapped by 512 sector.
  * @return number of bytes processed, only 3 following values
  *  -1 : if not an uf2 block
+ *  -2 : write failed: flash could not be written (update is aborted),
+ *       or not an uf2 block and it could not be kept in overlay (all slots are used)
  * 512 : write is successful (BPB_SECTOR_SIZE == 512)
  *   0 : is busy with flashing, tinyusb stack will call write_block again with the same parameters later on
  */
 int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
-  (void) block_no;
   UF2_Block *bl = (void*) data;
 
-  if ( !is_uf2_block(bl) ) return -1;
+  if ( !is_uf2_block(bl) ) {
+#if CFG_UF2_OVERLAY_SECTORS
+    if ( !overlay_write(block_no, data) ) return -2;
+#endif
+    return -1;
+  }
+
+  // flash write failed earlier, stop the update and stay in DFU
+  if ( state->aborted ) return -2;
+
+  // previous block is still being flashed in background, tinyusb will call us again
+  if ( board_flash_busy && board_flash_busy() ) return 0;
+
+#if CFG_UF2_OVERLAY_SECTORS
+  // keep overlay consistent if host re-uses an overlaid sector for uf2 file
+  if ( overlay_find(block_no) ) overlay_write(block_no, data);
+#else
+  (void) block_no;
+#endif
+
+  if (bl->familyID == CFG_UF2_FAMILY_ID) {
+    // RAM run session as long as all blocks target RAM
+    if ( board_ram_run_range && board_ram_run_range(bl->targetAddr, bl->payloadSize) ) {
+      if ( !state->ramRun || bl->targetAddr < state->ramRunAddr ) state->ramRunAddr = bl->targetAddr;
+      state->ramRun = true;
+    } else {
+#if TINYUF2_APP_CHECK
+      // descriptor of previous image no longer applies once a new one is being written
+      if ( !state->flashWritten ) {
+        _app_check_len = 0;
+        if ( !app_check_clear() ) {
+          state->aborted = true;
+          return -2;
+        }
+      }
+#endif
+      state->flashWritten = true;
+
+#if TINYUF2_APP_CHECK
+      // extent of application image in flash, other regions (e.g external flash) are not included
+      uint32_t const flash_end = BOARD_FLASH_ADDR_ZERO + board_flash_size();
+      uint32_t const end = bl->targetAddr + bl->payloadSize;
+      bool const in_app = (bl->targetAddr - BOARD_FLASH_APP_START < flash_end - BOARD_FLASH_APP_START) && (end <= flash_end);
+      if ( in_app && end > state->appEnd ) state->appEnd = end;
+#endif
+    }
 
-  if (bl->familyID == BOARD_UF2_FAMILY_ID) {
     // generic family ID
-    board_flash_write(bl->targetAddr, bl->data, bl->payloadSize);
+    if ( !uf2_flash_write(bl->targetAddr, bl->data, bl->payloadSize) ) {
+      state->aborted = true;
+      return -2;
+    }
   }else {
     // TODO family matches VID/PID
     return -1;
@@ -519,7 +929,18 @@ int uf2_write_block (uint32_t block_no, uint8_t *data, WriteState *state) {
       // flush last blocks
       // TODO numWritten can be smaller than numBlocks if return early
       if ( state->numWritten >= state->numBlocks ) {
-        board_flash_flush();
+        if ( !board_flash_flush() ) {
+          state->aborted = true;
+          return -2;
+        }
+
+#if TINYUF2_APP_CHECK
+        // image is complete, record it once: CRC of whole image is too long for the write callback
+        if ( state->appEnd ) {
+          _app_check_len = state->appEnd - BOARD_FLASH_APP_START;
+          state->appEnd = 0;
+        }
+#endif
       }
     }
   }
@@ -32,6 +32,18 @@
 #include "uf2.h"
 #include "tusb.h"
 
+#if TINYUF2_SD_UPDATE
+#include "sd_update.h"
+#endif
+
+#if TINYUF2_STAGED_UPDATE
+#include "staged_update.h"
+#endif
+
+#if TINYUF2_APP_CHECK
+#include "app_check.h"
+#endif
+
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF PROTOTYPES
 //--------------------------------------------------------------------+
@@ -60,6 +72,11 @@ int main(void) {
   board_flash_protect_bootloader(true);
 #endif
 
+#if TINYUF2_STAGED_UPDATE || TINYUF2_SD_UPDATE
+  // updates applied at boot need flash before application is validated
+  board_flash_init();
+#endif
+
   // if not DFU mode, jump to App
   if (!check_dfu_mode()) {
     TU_LOG1("Jump to application\r\n");
@@ -72,7 +89,9 @@ int main(void) {
 
   TUF2_LOG1("Start DFU mode\r\n");
   board_dfu_init();
+#if !(TINYUF2_STAGED_UPDATE || TINYUF2_SD_UPDATE)
   board_flash_init();
+#endif
   uf2_init();
 
   tud_init(BOARD_TUD_RHPORT);
@@ -87,12 +106,31 @@ int main(void) {
 #if CFG_TUSB_OS == OPT_OS_NONE || CFG_TUSB_OS == OPT_OS_PICO
   while(1) {
     tud_task();
+    uf2_task();
   }
 #endif
 }
 
 // return true if start DFU mode, else App mode
 static bool check_dfu_mode(void) {
+#if TINYUF2_DBL_TAP_DFU
+  // read on every boot, flags are cleared by reading
+  board_reset_cause_t const reset_cause = board_reset_cause ? board_reset_cause() : BOARD_RESET_UNKNOWN;
+#endif
+
+#if TINYUF2_STAGED_UPDATE
+  // application staged an update then reset: copy it and boot it without double tap delay
+  if (TINYUF2_DBL_TAP_REG == DBL_TAP_MAGIC_STAGED_UPDATE) {
+    bool const updated = staged_update_apply();
+    TINYUF2_DBL_TAP_REG = (TINYUF2_DBL_TAP_DFU && updated) ? DBL_TAP_MAGIC_QUICK_BOOT : 0;
+  }
+#endif
+
+#if TINYUF2_SD_UPDATE
+  // flash firmware from SD card if present, app is validated below as usual
+  sd_update();
+#endif
+
   // Check if app is valid
   if (!board_app_valid()) {
     TUF2_LOG1("App invalid\r\n");
@@ -102,6 +140,13 @@ static bool check_dfu_mode(void) {
     TUF2_LOG1("App invalid\r\n");
     return true;
   }
+#if TINYUF2_APP_CHECK
+  // e.g image write was interrupted
+  if (!app_check_valid()) {
+    TUF2_LOG1("App invalid\r\n");
+    return true;
+  }
+#endif
 
 #if TINYUF2_DBL_TAP_DFU
    TUF2_LOG1_HEX(TINYUF2_DBL_TAP_REG);
@@ -131,6 +176,13 @@ static bool check_dfu_mode(void) {
       break;
   }
 
+  // Double tap is done with reset pin, no need to wait after power-on, watchdog or software reset
+  if (reset_cause != BOARD_RESET_PIN && reset_cause != BOARD_RESET_UNKNOWN) {
+    TUF2_LOG1("Skip double tap detection, reset cause = %u\r\n", (unsigned) reset_cause);
+    TINYUF2_DBL_TAP_REG = 0;
+    return false;
+  }
+
   // Register our first reset for double reset detection
   TINYUF2_DBL_TAP_REG = DBL_TAP_MAGIC;
 
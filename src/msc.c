@@ -24,6 +24,11 @@
 
 #include "tusb.h"
 #include "uf2.h"
+#include "checksum.h"
+
+#if TINYUF2_APP_CHECK
+#include "app_check.h"
+#endif
 
 //--------------------------------------------------------------------+
 // MACRO TYPEDEF CONSTANT ENUM
@@ -37,6 +42,207 @@ static uint32_t _write_ms;
 
 static WriteState _wr_state = {0};
 
+#if TINYUF2_MSC_DATA_LUN
+enum {
+  LUN_UF2  = 0,
+  LUN_DATA = 1,
+};
+
+// Write-back cache for data LUN: sectors written within the same cache-aligned region are
+// collected in RAM, missing sectors are read back and the whole region is erased/programmed once.
+#define DATA_CACHE_SECTORS        (TINYUF2_MSC_DATA_CACHE_SIZE / 512)
+#define DATA_CACHE_INVALID_ADDR   0xffffffffUL
+
+TU_VERIFY_STATIC((TINYUF2_MSC_DATA_CACHE_SIZE & (TINYUF2_MSC_DATA_CACHE_SIZE - 1)) == 0, "cache size must be power of 2");
+TU_VERIFY_STATIC(TINYUF2_MSC_DATA_CACHE_SIZE >= 512, "cache size must be at least 1 sector");
+
+static uint32_t _data_cache_addr = DATA_CACHE_INVALID_ADDR;
+static uint8_t _data_cache_mask[(DATA_CACHE_SECTORS + 7) / 8];
+static uint8_t _data_cache[TINYUF2_MSC_DATA_CACHE_SIZE] __attribute__((aligned(4)));
+
+// Return false if data flash write failed, cached data is dropped either way
+static bool data_cache_flush(void) {
+  if (_data_cache_addr == DATA_CACHE_INVALID_ADDR) return true;
+
+  // fill sectors that are not written by host with current flash contents
+  for (uint32_t i = 0; i < DATA_CACHE_SECTORS; i++) {
+    if (!(_data_cache_mask[i / 8] & (1u << (i % 8)))) {
+      board_data_flash_read(_data_cache_addr + i * 512, _data_cache + i * 512, 512);
+    }
+  }
+
+  bool const ret = board_data_flash_write(_data_cache_addr, _data_cache, TINYUF2_MSC_DATA_CACHE_SIZE);
+  if (!ret) {
+    TUF2_LOG1("Data flash write failed at 0x%08lX\r\n", _data_cache_addr);
+  }
+
+  _data_cache_addr = DATA_CACHE_INVALID_ADDR;
+  return ret;
+}
+
+// Region is only written to flash when host moves on to another region, synchronizes cache or ejects
+static bool data_cache_write(uint32_t addr, uint8_t const* data) {
+  uint32_t const cache_addr = addr & ~(TINYUF2_MSC_DATA_CACHE_SIZE - 1UL);
+
+  if (cache_addr != _data_cache_addr) {
+    if (!data_cache_flush()) return false;
+    _data_cache_addr = cache_addr;
+    memset(_data_cache_mask, 0, sizeof(_data_cache_mask));
+  }
+
+  uint32_t const idx = (addr - cache_addr) / 512;
+  memcpy(_data_cache + idx * 512, data, 512);
+  _data_cache_mask[idx / 8] |= (uint8_t) (1u << (idx % 8));
+
+  return true;
+}
+
+// Read sectors, those still in cache are served from it
+static void data_cache_read(uint32_t addr, uint8_t* buffer, uint32_t len) {
+  board_data_flash_read(addr, buffer, len);
+
+  if (_data_cache_addr == DATA_CACHE_INVALID_ADDR) return;
+
+  for (uint32_t count = 0; count < len; count += 512) {
+    uint32_t const sector_addr = addr + count;
+    if ((sector_addr & ~(TINYUF2_MSC_DATA_CACHE_SIZE - 1UL)) != _data_cache_addr) continue;
+
+    uint32_t const idx = (sector_addr - _data_cache_addr) / 512;
+    if (_data_cache_mask[idx / 8] & (1u << (idx % 8))) {
+      memcpy(buffer + count, _data_cache + idx * 512, 512);
+    }
+  }
+}
+
+static void data_cache_set_error(uint8_t lun) {
+  tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00); // write error
+}
+#endif
+
+#if TINYUF2_SCSI_VENDOR
+// Vendor specific SCSI commands (opcode range 0xC0 - 0xFF) for programming flash directly
+// without FAT and UF2 wrapping e.g with sg_raw or IOCTL_SCSI_PASS_THROUGH.
+// CDB layout (12 bytes): [0] opcode, [1] reserved, [2..5] address (big endian), [6..9] length (big endian)
+// - WRITE_FLASH: data out, length must be multiple of 256 and not larger than CFG_TUD_MSC_EP_BUFSIZE
+// - READ_FLASH : data in, length must not larger than CFG_TUD_MSC_EP_BUFSIZE
+// - CHECKSUM   : data in, 4 bytes CRC32 (big endian) of flash range
+// - REBOOT     : no data, flush flash then reset after command status is sent
+enum {
+  SCSI_CMD_VENDOR_WRITE_FLASH = 0xC0,
+  SCSI_CMD_VENDOR_READ_FLASH  = 0xC1,
+  SCSI_CMD_VENDOR_CHECKSUM    = 0xC2,
+  SCSI_CMD_VENDOR_REBOOT      = 0xC3,
+};
+
+// REBOOT succeeded (flash flushed), reset once its status is sent
+static bool _vendor_reboot = false;
+
+static uint32_t scsi_vendor_u32(uint8_t const* p) {
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+// Check if flash range is within application region
+static bool scsi_vendor_range_valid(uint32_t addr, uint32_t len) {
+  uint32_t const end = BOARD_FLASH_ADDR_ZERO + board_flash_size();
+  return (addr >= BOARD_FLASH_APP_START) && (addr <= end) && (len <= end - addr);
+}
+
+// return response length, or -1 if command is not valid
+static int32_t scsi_vendor_cmd(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, uint16_t bufsize) {
+  uint32_t const addr = scsi_vendor_u32(scsi_cmd + 2);
+  uint32_t const len = scsi_vendor_u32(scsi_cmd + 6);
+
+  // only the uf2 lun maps to internal flash
+  if (lun != 0) {
+    tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00); // invalid command operation
+    return -1;
+  }
+
+  if (scsi_cmd[0] != SCSI_CMD_VENDOR_REBOOT && !scsi_vendor_range_valid(addr, len)) {
+    tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x21, 0x00); // LBA out of range
+    return -1;
+  }
+
+  switch (scsi_cmd[0]) {
+    case SCSI_CMD_VENDOR_WRITE_FLASH: {
+      if ((len % 256) || (len > bufsize)) break;
+
+#if TINYUF2_APP_CHECK
+      // host tool writes image in pieces, recorded descriptor no longer applies
+      if (!app_check_clear()) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00); // write error
+        return -1;
+      }
+#endif
+
+      uint8_t const* data = buffer;
+      for (uint32_t i = 0; i < len; i += 256) {
+        if (!uf2_flash_write(addr + i, data + i, 256)) {
+          tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00); // write error
+          return -1;
+        }
+      }
+      return (int32_t) len;
+    }
+
+    case SCSI_CMD_VENDOR_READ_FLASH:
+      if (len > bufsize) break;
+
+      if (!board_flash_flush()) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00); // write error
+        return -1;
+      }
+      board_flash_read(addr, buffer, len);
+      return (int32_t) len;
+
+    case SCSI_CMD_VENDOR_CHECKSUM: {
+      if (bufsize < 4) break;
+
+      if (!board_flash_flush()) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00); // write error
+        return -1;
+      }
+
+      uint32_t crc = 0;
+      for (uint32_t offset = 0; offset < len; offset += bufsize) {
+        uint32_t const count = tu_min32(len - offset, bufsize);
+        board_flash_read(addr + offset, buffer, count);
+        crc = tuf2_crc32(crc, buffer, count);
+      }
+
+      uint8_t* resp = buffer;
+      resp[0] = (uint8_t) (crc >> 24);
+      resp[1] = (uint8_t) (crc >> 16);
+      resp[2] = (uint8_t) (crc >> 8);
+      resp[3] = (uint8_t) crc;
+      return 4;
+    }
+
+    case SCSI_CMD_VENDOR_REBOOT:
+      // reset is deferred to tud_msc_scsi_complete_cb() so that host can receive the status
+      if (!board_flash_flush()) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00); // write error
+        return -1;
+      }
+      _vendor_reboot = true;
+      return 0;
+
+    default: break;
+  }
+
+  tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0x00); // invalid field in CDB
+  return -1;
+}
+
+// Invoked when command in tud_msc_scsi_cb is complete
+void tud_msc_scsi_complete_cb(uint8_t lun, uint8_t const scsi_cmd[16]) {
+  if (lun == 0 && scsi_cmd[0] == SCSI_CMD_VENDOR_REBOOT && _vendor_reboot) {
+    indicator_set(STATE_WRITING_FINISHED);
+    board_dfu_complete();
+  }
+}
+#endif
+
 //--------------------------------------------------------------------+
 // tinyusb callbacks
 //--------------------------------------------------------------------+
@@ -47,9 +253,13 @@ void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16
   (void) lun;
 
   const char vid[] = "Adafruit";
-  const char pid[] = "UF2 Bootloader";
+  const char* pid = "UF2 Bootloader";
   const char rev[] = "1.0";
 
+#if TINYUF2_MSC_DATA_LUN
+  if (lun == LUN_DATA) pid = "Data Flash";
+#endif
+
   memcpy(vendor_id, vid, strlen(vid));
   memcpy(product_id, pid, strlen(pid));
   memcpy(product_rev, rev, strlen(rev));
@@ -59,9 +269,21 @@ void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8], uint8_t product_id[16
 // return true allowing host to read/write this LUN e.g SD card inserted
 bool tud_msc_test_unit_ready_cb(uint8_t lun) {
   (void) lun;
+
+#if TINYUF2_MSC_DATA_LUN
+  if (lun == LUN_DATA) return board_data_flash_size() > 0;
+#endif
+
   return true;
 }
 
+#if TINYUF2_MSC_DATA_LUN
+// Invoked to determine max LUN
+uint8_t tud_msc_get_maxlun_cb(void) {
+  return 2;
+}
+#endif
+
 // Callback invoked when received an SCSI command not in built-in list below
 // - READ_CAPACITY10, READ_FORMAT_CAPACITY, INQUIRY, MODE_SENSE6, REQUEST_SENSE
 // - READ10 and WRITE10 has their own callbacks
@@ -78,6 +300,25 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, u
       resplen = 0;
       break;
 
+#if TINYUF2_MSC_DATA_LUN
+    case SCSI_CMD_SYNCHRONIZE_CACHE_10:
+      if (lun == LUN_DATA && !data_cache_flush()) {
+        data_cache_set_error(lun);
+        return -1;
+      }
+      resplen = 0;
+      break;
+#endif
+
+#if TINYUF2_SCSI_VENDOR
+    case SCSI_CMD_VENDOR_WRITE_FLASH:
+    case SCSI_CMD_VENDOR_READ_FLASH:
+    case SCSI_CMD_VENDOR_CHECKSUM:
+    case SCSI_CMD_VENDOR_REBOOT:
+      // response (if any) is already placed in buffer
+      return scsi_vendor_cmd(lun, scsi_cmd, buffer, bufsize);
+#endif
+
     default:
       // Set Sense = Invalid Command Operation
       tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
@@ -105,6 +346,14 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16], void* buffer, u
 // Copy disk's data to buffer (up to bufsize) and return number of copied bytes.
 int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buffer, uint32_t bufsize) {
   (void) lun;
+
+#if TINYUF2_MSC_DATA_LUN
+  if (lun == LUN_DATA) {
+    data_cache_read(lba * 512 + offset, buffer, bufsize);
+    return (int32_t) bufsize;
+  }
+#endif
+
   memset(buffer, 0, bufsize);
 
   // since we return block size each, offset should always be zero
@@ -113,7 +362,8 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buff
   uint32_t count = 0;
 
   while (count < bufsize) {
-    uf2_read_block(lba, buffer);
+    // generated contents is not ready yet (computed in uf2_task), tinyusb will call us again
+    if ( !uf2_read_block(lba, buffer) ) break;
 
     lba++;
     buffer += 512;
@@ -129,11 +379,31 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t*
   (void) lun;
   (void) offset;
 
+#if TINYUF2_MSC_DATA_LUN
+  if (lun == LUN_DATA) {
+    for (uint32_t count = 0; count < bufsize; count += 512) {
+      if (!data_cache_write(lba * 512 + offset + count, buffer + count)) {
+        data_cache_set_error(lun);
+        return -1;
+      }
+    }
+    return (int32_t) bufsize;
+  }
+#endif
+
   uint32_t count = 0;
   while (count < bufsize) {
     // Consider non-uf2 block write as successful
     // only break if write_block is busy with flashing (return 0)
-    if (0 == uf2_write_block(lba, buffer, &_wr_state)) break;
+    int const wr = uf2_write_block(lba, buffer, &_wr_state);
+    if (0 == wr) break;
+
+    // flash write failed or non-uf2 sector is not kept, report error once previous sectors are acknowledged
+    if (-2 == wr) {
+      if (count) break;
+      tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x03, 0x00); // write fault
+      return -1;
+    }
 
     lba++;
     buffer += 512;
@@ -148,9 +418,14 @@ void tud_msc_write10_complete_cb(uint8_t lun) {
   (void) lun;
   static bool first_write = true;
 
-  // abort the DFU, uf2 block failed integrity check
+#if TINYUF2_MSC_DATA_LUN
+  // data is kept in cache until region changes, cache is synchronized or disk is ejected
+  if (lun == LUN_DATA) return;
+#endif
+
+  // abort the DFU, flash write failed
   if (_wr_state.aborted) {
-    // aborted and reset
+    // aborted, stay in DFU mode
     indicator_set(STATE_WRITING_FINISHED);
   } else if (_wr_state.numBlocks) {
     // Start LED writing pattern with first write
@@ -174,6 +449,24 @@ void tud_msc_write10_complete_cb(uint8_t lun) {
 
       TUF2_LOG1("Writing finished\r\n");
       indicator_set(STATE_WRITING_FINISHED);
+
+#if TINYUF2_MSC_DATA_LUN
+      // don't lose data LUN writes that host has not synchronized yet
+      (void) data_cache_flush();
+#endif
+
+#if TINYUF2_APP_CHECK
+      // record image descriptor now, main loop will not get to it before reset
+      uf2_task();
+#endif
+
+      // image is complete in RAM, start it right away
+      if (_wr_state.ramRun && !_wr_state.flashWritten && board_ram_run) {
+        TUF2_LOG1("RAM run at 0x%08lX\r\n", _wr_state.ramRunAddr);
+        tud_disconnect();
+        board_ram_run(_wr_state.ramRunAddr);
+      }
+
       board_dfu_complete();
 
       // board_dfu_complete() should not return
@@ -188,6 +481,14 @@ void tud_msc_write10_complete_cb(uint8_t lun) {
 void tud_msc_capacity_cb(uint8_t lun, uint32_t* block_count, uint16_t* block_size) {
   (void) lun;
 
+#if TINYUF2_MSC_DATA_LUN
+  if (lun == LUN_DATA) {
+    *block_count = board_data_flash_size() / 512;
+    *block_size = 512;
+    return;
+  }
+#endif
+
   *block_count = CFG_UF2_NUM_BLOCKS;
   *block_size = 512;
 }
@@ -199,6 +500,14 @@ bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, boo
   (void) lun;
   (void) power_condition;
 
+#if TINYUF2_MSC_DATA_LUN
+  // stop or eject: write back cached data
+  if (lun == LUN_DATA && !start && !data_cache_flush()) {
+    data_cache_set_error(lun);
+    return false;
+  }
+#endif
+
   if (load_eject) {
     if (start) {
       // load disk storage
@@ -0,0 +1,132 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <string.h>
+#include "nor_erase.h"
+
+//--------------------------------------------------------------------+
+// Internal Helper
+//--------------------------------------------------------------------+
+
+// Update state from flash status, true if erase is done
+static bool erase_done(nor_erase_t* nor) {
+  if (nor->state == NOR_ERASE_RUNNING && !nor->ops->busy()) {
+    nor->state = NOR_ERASE_IDLE;
+  }
+  return nor->state == NOR_ERASE_IDLE;
+}
+
+// Stop erase and wait until flash accepts reads
+static bool erase_suspend(nor_erase_t* nor) {
+  if (!nor->ops->suspend()) return false;
+
+  // suspend latency (tSUS) is tens of us, WIP is cleared once suspended or if erase completed meanwhile
+  while (nor->ops->busy()) {}
+
+  nor->state = NOR_ERASE_SUSPENDED;
+  nor->suspend_count++;
+  return true;
+}
+
+static bool erase_resume(nor_erase_t* nor) {
+  // if erase completed before suspend took effect, flash ignores resume and reports not busy
+  if (!nor->ops->resume()) return false;
+  nor->state = NOR_ERASE_RUNNING;
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+void nor_erase_init(nor_erase_t* nor, nor_erase_ops_t const* ops) {
+  memset(nor, 0, sizeof(nor_erase_t));
+  nor->ops = ops;
+}
+
+bool nor_erase_start(nor_erase_t* nor, uint32_t addr, uint32_t size) {
+  if (!nor_erase_wait(nor)) return false;
+  if (!nor->ops->erase(addr, size)) return false;
+
+  nor->addr = addr;
+  nor->size = size;
+  nor->state = NOR_ERASE_RUNNING;
+  return true;
+}
+
+bool nor_erase_busy(nor_erase_t* nor) {
+  if (nor->state == NOR_ERASE_SUSPENDED) {
+    (void) erase_resume(nor);
+  }
+  return !erase_done(nor);
+}
+
+bool nor_erase_wait(nor_erase_t* nor) {
+  if (nor->state == NOR_ERASE_SUSPENDED && !erase_resume(nor)) return false;
+  while (!erase_done(nor)) {}
+  return true;
+}
+
+bool nor_erase_read(nor_erase_t* nor, uint32_t addr, void* buffer, uint32_t len) {
+  uint8_t* buf = (uint8_t*) buffer;
+
+  if (erase_done(nor)) return nor->ops->read(addr, buffer, len);
+
+  uint32_t const erase_end = nor->addr + nor->size;
+  uint32_t const overlap_start = (addr > nor->addr) ? addr : nor->addr;
+  uint32_t const overlap_end = (addr + len < erase_end) ? addr + len : erase_end;
+
+  // entirely within erase range: no need to interrupt the erase
+  if (overlap_start == addr && overlap_end == addr + len) {
+    memset(buf, 0xFF, len);
+    return true;
+  }
+
+  if (nor->state == NOR_ERASE_RUNNING) {
+    if (nor->ops->suspend == NULL) {
+      if (!nor_erase_wait(nor)) return false;
+      return nor->ops->read(addr, buffer, len);
+    }
+    if (!erase_suspend(nor)) return false;
+  }
+
+  bool ret = true;
+
+  // sector being erased must not be read while suspended, only the parts around it
+  if (overlap_start < overlap_end) {
+    if (overlap_start > addr) {
+      ret = nor->ops->read(addr, buf, overlap_start - addr);
+    }
+    if (ret && overlap_end < addr + len) {
+      ret = nor->ops->read(overlap_end, buf + (overlap_end - addr), addr + len - overlap_end);
+    }
+    memset(buf + (overlap_start - addr), 0xFF, overlap_end - overlap_start);
+  } else {
+    ret = nor->ops->read(addr, buffer, len);
+  }
+
+  // let erase continue right away, next read suspends again if needed
+  return erase_resume(nor) && ret;
+}
@@ -0,0 +1,76 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef NOR_ERASE_H_
+#define NOR_ERASE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//--------------------------------------------------------------------+
+// Background erase of external serial NOR flash
+//
+// Erase is started without waiting for completion. Reads that arrive while it
+// is running suspend the erase (e.g 75h/7Ah or B0h/30h, see sfdp_flash_t),
+// read and resume, instead of blocking until the erase is done.
+// Contents of the range being erased always read back as 0xFF.
+//--------------------------------------------------------------------+
+
+typedef struct {
+  bool (*erase)(uint32_t addr, uint32_t size);              // write enable + erase, must not wait for completion
+  bool (*busy)(void);                                       // write in progress (WIP), false once suspended
+  bool (*suspend)(void);                                    // erase suspend, NULL if not supported
+  bool (*resume)(void);                                     // erase resume, ignored by flash if not suspended
+  bool (*read)(uint32_t addr, void* buffer, uint32_t len);  // only called when flash is idle or suspended
+} nor_erase_ops_t;
+
+typedef enum {
+  NOR_ERASE_IDLE = 0,
+  NOR_ERASE_RUNNING,
+  NOR_ERASE_SUSPENDED,
+} nor_erase_state_t;
+
+typedef struct {
+  nor_erase_ops_t const* ops;
+  nor_erase_state_t state;
+  uint32_t addr;
+  uint32_t size;
+  uint32_t suspend_count; // number of suspends, for diagnostics
+} nor_erase_t;
+
+void nor_erase_init(nor_erase_t* nor, nor_erase_ops_t const* ops);
+
+// Start erasing, an erase that is still running is completed first
+bool nor_erase_start(nor_erase_t* nor, uint32_t addr, uint32_t size);
+
+// Poll erase progress, resume if suspended. Return true while erase is not finished
+bool nor_erase_busy(nor_erase_t* nor);
+
+// Block until erase is finished
+bool nor_erase_wait(nor_erase_t* nor);
+
+// Read while erase may be running
+bool nor_erase_read(nor_erase_t* nor, uint32_t addr, void* buffer, uint32_t len);
+
+#endif
@@ -0,0 +1,443 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "board_api.h"
+#include "uf2.h"
+#include "checksum.h"
+#include "sd_update.h"
+
+#if TINYUF2_APP_CHECK
+#include "app_check.h"
+#endif
+
+#if TINYUF2_SD_UPDATE
+
+#include "ff.h"
+#include "diskio.h"
+
+#ifndef BOARD_FLASH_SD_UPDATE_ADDR
+  #error "TINYUF2_SD_UPDATE requires BOARD_FLASH_SD_UPDATE_ADDR"
+#endif
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+#define SD_BLOCK_SIZE     512
+#define VERSION_COUNT     4
+
+#if TINYUF2_SD_UPDATE_BUFSIZE % SD_BLOCK_SIZE
+  #error "TINYUF2_SD_UPDATE_BUFSIZE must be multiple of 512"
+#endif
+
+typedef struct {
+  uint16_t version[VERSION_COUNT];
+  bool is_uf2;
+  uint32_t size;
+  uint32_t datetime;  // fdate << 16 | ftime
+  char name[FF_LFN_BUF + 1];
+} fw_file_t;
+
+#define SD_RECORD_MAGIC   0x50554453UL // "SDUP"
+
+// Firmware file last applied (or found already installed), kept at BOARD_FLASH_SD_UPDATE_ADDR.
+// Keyed on directory entry only so that an unchanged card costs no file read at boot
+typedef struct {
+  uint32_t magic;     // SD_RECORD_MAGIC
+  uint32_t size;      // file size
+  uint32_t datetime;  // modification time, fdate << 16 | ftime
+  uint32_t name_crc;  // tuf2_crc32() of file name
+  uint32_t rec_crc;   // tuf2_crc32(0, record, offsetof(sd_record_t, rec_crc))
+} sd_record_t;
+
+// Handle one 512-byte (or shorter, last) chunk of file at offset.
+// Return 0 if flash is busy and must be called again, -1 on mismatch, 1 when done
+typedef int (*block_handler_t)(uint32_t offset, uint8_t* data, uint32_t len);
+
+static FATFS _fs;
+static FIL _file;
+static fw_file_t _fw;
+static WriteState _wr_state;
+
+// Double buffer: on ports that program in background (board_flash_busy), next chunk is read from
+// card while flash is still busy with the current one, otherwise reads and writes alternate.
+// Full sectors are read straight into these buffers with a single multi-block read
+static uint8_t _buf[2][TINYUF2_SD_UPDATE_BUFSIZE] __attribute__((aligned(4)));
+static uint8_t _flash_buf[SD_BLOCK_SIZE] __attribute__((aligned(4)));
+
+//--------------------------------------------------------------------+
+// FatFs disk I/O
+//--------------------------------------------------------------------+
+
+DSTATUS disk_status(BYTE pdrv) {
+  (void) pdrv;
+  return 0; // initialized by board_sd_init() before mounting
+}
+
+DSTATUS disk_initialize(BYTE pdrv) {
+  (void) pdrv;
+  return 0;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) {
+  (void) pdrv;
+  return board_sd_read(sector, buff, count) ? RES_OK : RES_ERROR;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* buff) {
+  (void) pdrv;
+
+  switch (cmd) {
+    case CTRL_SYNC:
+      return RES_OK;
+
+    case GET_SECTOR_COUNT:
+      *((LBA_t*) buff) = board_sd_block_count();
+      return RES_OK;
+
+    case GET_SECTOR_SIZE:
+      *((WORD*) buff) = SD_BLOCK_SIZE;
+      return RES_OK;
+
+    default:
+      return RES_PARERR;
+  }
+}
+
+//--------------------------------------------------------------------+
+// Firmware file lookup
+//--------------------------------------------------------------------+
+
+static bool str_ieq(char const* a, char const* b, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (tolower((unsigned char) a[i]) != tolower((unsigned char) b[i])) return false;
+  }
+  return true;
+}
+
+// Parse "firmware[-_ ]x.y.z.uf2" or ".bin" (case-insensitive), version is optional
+static bool parse_name(char const* name, uint16_t version[VERSION_COUNT], bool* is_uf2) {
+  static char const prefix[] = "firmware";
+  size_t const prefix_len = sizeof(prefix) - 1;
+  size_t const len = strlen(name);
+
+  if (len < prefix_len + 4 || !str_ieq(name, prefix, prefix_len)) return false;
+
+  char const* ext = name + len - 4;
+  if (str_ieq(ext, ".uf2", 4)) {
+    *is_uf2 = true;
+  } else if (str_ieq(ext, ".bin", 4)) {
+    *is_uf2 = false;
+  } else {
+    return false;
+  }
+
+  memset(version, 0, VERSION_COUNT * sizeof(uint16_t));
+
+  char const* p = name + prefix_len;
+  if (p < ext && (*p == '-' || *p == '_' || *p == ' ')) p++;
+
+  for (uint32_t i = 0; p < ext; i++) {
+    if (!isdigit((unsigned char) *p)) return false;
+
+    uint32_t num = 0;
+    while (p < ext && isdigit((unsigned char) *p)) {
+      if (num < 0xffff) num = num * 10 + (uint32_t) (*p - '0');
+      p++;
+    }
+    if (i < VERSION_COUNT) version[i] = (uint16_t) (num < 0xffff ? num : 0xffff);
+
+    if (p < ext) {
+      if (*p != '.') return false;
+      p++;
+    }
+  }
+
+  return true;
+}
+
+static int version_cmp(uint16_t const a[VERSION_COUNT], uint16_t const b[VERSION_COUNT]) {
+  for (uint32_t i = 0; i < VERSION_COUNT; i++) {
+    if (a[i] != b[i]) return (a[i] > b[i]) ? 1 : -1;
+  }
+  return 0;
+}
+
+// Find firmware file with the highest version in root directory, .uf2 wins over .bin of same version
+static bool find_firmware(void) {
+  DIR dir;
+  FILINFO fno;
+  bool found = false;
+
+  if (f_opendir(&dir, "/") != FR_OK) return false;
+
+  while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0]) {
+    uint16_t version[VERSION_COUNT];
+    bool is_uf2;
+
+    if (fno.fattrib & AM_DIR) continue;
+    if (!parse_name(fno.fname, version, &is_uf2)) continue;
+
+    if (found) {
+      int const cmp = version_cmp(version, _fw.version);
+      if (cmp < 0 || (cmp == 0 && (_fw.is_uf2 || !is_uf2))) continue;
+    }
+
+    found = true;
+    memcpy(_fw.version, version, sizeof(version));
+    _fw.is_uf2 = is_uf2;
+    _fw.size = (uint32_t) fno.fsize;
+    _fw.datetime = ((uint32_t) fno.fdate << 16) | fno.ftime;
+    strcpy(_fw.name, fno.fname);
+  }
+
+  f_closedir(&dir);
+  return found;
+}
+
+//--------------------------------------------------------------------+
+// Block handlers
+//--------------------------------------------------------------------+
+
+// UF2 block of this board that goes to flash (RAM run blocks are ignored)
+static bool is_app_block(UF2_Block const* bl, uint32_t len) {
+  return (len == SD_BLOCK_SIZE) &&
+         (bl->magicStart0 == UF2_MAGIC_START0) &&
+         (bl->magicStart1 == UF2_MAGIC_START1) &&
+         (bl->magicEnd == UF2_MAGIC_END) &&
+         (bl->flags & UF2_FLAG_FAMILYID) &&
+         !(bl->flags & UF2_FLAG_NOFLASH) &&
+         (bl->familyID == CFG_UF2_FAMILY_ID) &&
+         (bl->payloadSize <= sizeof(bl->data)) &&
+         !(board_ram_run_range && board_ram_run_range(bl->targetAddr, bl->payloadSize));
+}
+
+static bool bin_in_flash(uint32_t offset, uint32_t len) {
+  uint32_t end = BOARD_FLASH_ADDR_ZERO + board_flash_size();
+  uint32_t const addr = BOARD_FLASH_APP_START + offset;
+
+  // record usually sits above application, image must stop short of it
+  if (BOARD_FLASH_SD_UPDATE_ADDR > BOARD_FLASH_APP_START) end = BOARD_FLASH_SD_UPDATE_ADDR;
+#if TINYUF2_APP_CHECK
+  if (BOARD_FLASH_APP_CHECK_ADDR > BOARD_FLASH_APP_START && BOARD_FLASH_APP_CHECK_ADDR < end) {
+    end = BOARD_FLASH_APP_CHECK_ADDR;
+  }
+#endif
+
+  return (addr <= end) && (len <= end - addr);
+}
+
+static int verify_uf2(uint32_t offset, uint8_t* data, uint32_t len) {
+  (void) offset;
+  UF2_Block const* bl = (UF2_Block const*) data;
+  if (!is_app_block(bl, len)) return 1;
+
+  board_flash_read(bl->targetAddr, _flash_buf, bl->payloadSize);
+  return memcmp(_flash_buf, bl->data, bl->payloadSize) ? -1 : 1;
+}
+
+static int write_uf2(uint32_t offset, uint8_t* data, uint32_t len) {
+  if (!is_app_block((UF2_Block const*) data, len)) return 1;
+
+  // 0 if previous block is still being programmed, -2 if flash write failed
+  int const wr = uf2_write_block(offset / SD_BLOCK_SIZE, data, &_wr_state);
+  return (wr < 0) ? -1 : (wr ? 1 : 0);
+}
+
+static int verify_bin(uint32_t offset, uint8_t* data, uint32_t len) {
+  if (!bin_in_flash(offset, len)) return -1;
+
+  board_flash_read(BOARD_FLASH_APP_START + offset, _flash_buf, len);
+  return memcmp(_flash_buf, data, len) ? -1 : 1;
+}
+
+static int write_bin(uint32_t offset, uint8_t* data, uint32_t len) {
+  if (!bin_in_flash(offset, len)) return -1;
+  if (board_flash_busy && board_flash_busy()) return 0;
+
+  return uf2_flash_write(BOARD_FLASH_APP_START + offset, data, len) ? 1 : -1;
+}
+
+//--------------------------------------------------------------------+
+// Applied record
+//--------------------------------------------------------------------+
+
+static uint32_t record_crc(sd_record_t const* rec) {
+  return tuf2_crc32(0, rec, offsetof(sd_record_t, rec_crc));
+}
+
+static void record_make(sd_record_t* rec) {
+  rec->magic = SD_RECORD_MAGIC;
+  rec->size = _fw.size;
+  rec->datetime = _fw.datetime;
+  rec->name_crc = tuf2_crc32(0, _fw.name, (uint32_t) strlen(_fw.name));
+  rec->rec_crc = record_crc(rec);
+}
+
+static bool record_matches(sd_record_t const* rec) {
+  sd_record_t cur;
+  board_flash_read(BOARD_FLASH_SD_UPDATE_ADDR, &cur, sizeof(cur));
+  return 0 == memcmp(&cur, rec, sizeof(cur));
+}
+
+static bool record_write(sd_record_t const* rec) {
+  while (board_flash_busy && board_flash_busy()) {}
+  if (!uf2_flash_write(BOARD_FLASH_SD_UPDATE_ADDR, rec, sizeof(*rec))) return false;
+  return board_flash_flush() && record_matches(rec);
+}
+
+// Image is incomplete: erase its first sector (or whole application) so that bootloader stays in DFU.
+// Programming 0xFF over the vector is not enough, ports without read-modify-write cache don't erase a
+// sector twice per session
+static bool invalidate_app(void) {
+  while (board_flash_busy && board_flash_busy()) {}
+  if (board_flash_erase_sector) {
+    (void) board_flash_erase_sector(BOARD_FLASH_APP_START);
+  } else {
+    board_flash_erase_app();
+  }
+  return !board_app_valid();
+}
+
+//--------------------------------------------------------------------+
+// Streaming
+//--------------------------------------------------------------------+
+
+// Feed whole file to handler, return false on read error or mismatch
+static bool stream_file(block_handler_t handler) {
+  UINT count[2] = { 0, 0 };
+  uint8_t idx = 0;
+  uint32_t offset = 0;
+
+  if (f_lseek(&_file, 0) != FR_OK) return false;
+  if (f_read(&_file, _buf[0], TINYUF2_SD_UPDATE_BUFSIZE, &count[0]) != FR_OK) return false;
+
+  while (count[idx]) {
+    bool next_ready = false;
+
+    for (uint32_t pos = 0; pos < count[idx]; pos += SD_BLOCK_SIZE) {
+      uint32_t const len = (count[idx] - pos < SD_BLOCK_SIZE) ? (count[idx] - pos) : SD_BLOCK_SIZE;
+      int ret;
+
+      while (0 == (ret = handler(offset + pos, _buf[idx] + pos, len))) {
+        // flash is busy: good time to fetch next chunk
+        if (!next_ready) {
+          if (f_read(&_file, _buf[idx ^ 1], TINYUF2_SD_UPDATE_BUFSIZE, &count[idx ^ 1]) != FR_OK) return false;
+          next_ready = true;
+        }
+      }
+
+      if (ret < 0) return false;
+    }
+
+    offset += count[idx];
+
+    if (!next_ready) {
+      if (f_read(&_file, _buf[idx ^ 1], TINYUF2_SD_UPDATE_BUFSIZE, &count[idx ^ 1]) != FR_OK) return false;
+    }
+    idx ^= 1;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+bool sd_update(void) {
+  bool updated = false;
+
+  if (!board_sd_init()) return false;
+
+  if (f_mount(&_fs, "", 1) != FR_OK) {
+    TUF2_LOG1("SD: no filesystem\r\n");
+    board_sd_deinit();
+    return false;
+  }
+
+  if (!find_firmware()) {
+    TUF2_LOG1("SD: no firmware file\r\n");
+  } else if (f_open(&_file, _fw.name, FA_READ) != FR_OK) {
+    TUF2_LOG1("SD: failed to open %s\r\n", _fw.name);
+  } else {
+    TUF2_LOG1("SD: found %s\r\n", _fw.name);
+
+    block_handler_t const verify = _fw.is_uf2 ? verify_uf2 : verify_bin;
+    block_handler_t const write = _fw.is_uf2 ? write_uf2 : write_bin;
+
+    // same file as last time: leave flash alone even if application changed it since
+    sd_record_t rec;
+    record_make(&rec);
+
+    if (record_matches(&rec)) {
+      TUF2_LOG1("SD: already applied\r\n");
+    } else if (stream_file(verify)) {
+      TUF2_LOG1("SD: application is up to date\r\n");
+      if (!record_write(&rec)) TUF2_LOG1("SD: failed to record file\r\n");
+    } else {
+      TUF2_LOG1("SD: updating application\r\n");
+      indicator_set(STATE_WRITING_STARTED);
+
+      memset(&_wr_state, 0, sizeof(_wr_state));
+      bool ok = stream_file(write);
+      ok = board_flash_flush() && ok;
+
+      // read back what was written
+      ok = ok && stream_file(verify);
+      updated = ok;
+
+      if (ok) {
+#if TINYUF2_APP_CHECK
+        // uf2 image completed by uf2_write_block() is recorded by uf2_task()
+        if (_fw.is_uf2) {
+          uf2_task();
+        } else {
+          (void) app_check_record(BOARD_FLASH_APP_START, (uint32_t) f_size(&_file));
+        }
+#endif
+        if (!record_write(&rec)) TUF2_LOG1("SD: failed to record file\r\n");
+      } else if (!invalidate_app()) {
+        TUF2_LOG1("SD: failed to erase application\r\n");
+      }
+
+      indicator_set(STATE_WRITING_FINISHED);
+      TUF2_LOG1("SD: update %s\r\n", ok ? "done" : "failed");
+    }
+
+    f_close(&_file);
+  }
+
+  f_unmount("");
+  board_sd_deinit();
+
+  return updated;
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef SD_UPDATE_H_
+#define SD_UPDATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//--------------------------------------------------------------------+
+// Offline update from SD card (TINYUF2_SD_UPDATE)
+//
+// At boot the root directory of the card is searched for firmware.uf2 or
+// firmware.bin, optionally versioned e.g firmware-1.2.3.uf2. The highest
+// version is picked and, if its contents differ from the installed image,
+// streamed into flash with the same UF2 write path (and board write-back
+// cache) as the MSC drive. A .bin is written to BOARD_FLASH_APP_START.
+//
+// Name, size and modification time of the applied file are recorded at
+// BOARD_FLASH_SD_UPDATE_ADDR. A matching file is skipped without being read, so
+// it is not flashed again on later boots even if application has since updated
+// itself. If writing or read back fails the application is erased and
+// bootloader stays in DFU mode.
+//--------------------------------------------------------------------+
+
+// Look for firmware on SD card and flash it if needed. Return true if application was updated
+bool sd_update(void);
+
+#endif
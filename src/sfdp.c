@@ -0,0 +1,292 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <string.h>
+#include "sfdp.h"
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM
+//--------------------------------------------------------------------+
+
+#define SFDP_SIGNATURE        0x50444653UL // "SFDP"
+
+// Parameter ID (MSB << 8 | LSB)
+#define SFDP_ID_BFPT          0xFF00
+#define SFDP_ID_4BAIT         0xFF84
+
+// JESD216F has 23 DWORDs, later ones are about xSPI profiles we don't use
+#define BFPT_DWORDS_MAX       20
+
+//--------------------------------------------------------------------+
+// Internal Helper
+//--------------------------------------------------------------------+
+
+static inline uint32_t u32_le(uint8_t const* p) {
+  return ((uint32_t) p[3] << 24) | ((uint32_t) p[2] << 16) | ((uint32_t) p[1] << 8) | p[0];
+}
+
+// Fast read parameters are 16-bit: opcode [15:8], mode clocks [7:5], wait states [4:0]
+static void add_read(sfdp_flash_t* flash, uint32_t param, uint8_t inst_lines, uint8_t addr_lines, uint8_t data_lines) {
+  uint8_t const opcode = (uint8_t) (param >> 8);
+  if (opcode == 0x00 || opcode == 0xFF || flash->read_count >= SFDP_READ_MODE_MAX) return;
+
+  sfdp_read_mode_t* mode = &flash->read[flash->read_count++];
+  mode->opcode = opcode;
+  mode->inst_lines = inst_lines;
+  mode->addr_lines = addr_lines;
+  mode->data_lines = data_lines;
+  mode->mode_clocks = (param >> 5) & 0x07;
+  mode->dummy_clocks = (uint8_t) (mode->mode_clocks + (param & 0x1F));
+}
+
+// Typical time is (count+1) * unit
+static uint16_t erase_time_ms(uint32_t count, uint32_t unit) {
+  static const uint16_t unit_ms[4] = { 1, 16, 128, 1000 };
+  return (uint16_t) ((count + 1) * unit_ms[unit & 0x03]);
+}
+
+// Replace 3-byte address opcodes with ones from 4-byte Address Instruction Table
+static void apply_4bait(sfdp_flash_t* flash, uint32_t support, uint32_t erase_opcodes, uint8_t const erase_type[]) {
+  // 3-byte opcode, 4-byte opcode, support bit in 4BAIT DWORD 1
+  static const struct {
+    uint8_t opcode;
+    uint8_t opcode_4b;
+    uint8_t bit;
+  } read_map[] = {
+    { 0x0B, 0x0C, 1 }, { 0x3B, 0x3C, 2 }, { 0xBB, 0xBC, 3 }, { 0x6B, 0x6C, 4 }, { 0xEB, 0xEC, 5 }
+  };
+
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < flash->read_count; i++) {
+    sfdp_read_mode_t mode = flash->read[i];
+    bool found = false;
+
+    for (uint8_t m = 0; m < sizeof(read_map) / sizeof(read_map[0]); m++) {
+      if (mode.opcode == read_map[m].opcode && (support & (1UL << read_map[m].bit))) {
+        mode.opcode = read_map[m].opcode_4b;
+        found = true;
+        break;
+      }
+    }
+
+    // modes without 4-byte opcode are not usable without entering 4-byte mode
+    if (found) flash->read[count++] = mode;
+  }
+  flash->read_count = count;
+
+  if (support & (1UL << 7)) {
+    flash->program_opcode = 0x34;
+    flash->program_lines = 4;
+  } else {
+    flash->program_opcode = 0x12;
+    flash->program_lines = 1;
+  }
+
+  count = 0;
+  for (uint8_t i = 0; i < flash->erase_count; i++) {
+    uint8_t const type = erase_type[i];
+    if (support & (1UL << (9 + type))) {
+      flash->erase[count] = flash->erase[i];
+      flash->erase[count].opcode = (uint8_t) (erase_opcodes >> (8 * type));
+      count++;
+    }
+  }
+  flash->erase_count = count;
+}
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+bool sfdp_parse(sfdp_read_cb_t read_cb, sfdp_flash_t* flash) {
+  memset(flash, 0, sizeof(sfdp_flash_t));
+
+  uint8_t header[8];
+  if (!read_cb(0, header, sizeof(header)) || u32_le(header) != SFDP_SIGNATURE) return false;
+
+  // locate BFPT (latest revision if there are several) and 4BAIT
+  uint16_t const nph = (uint16_t) (header[6] + 1);
+  uint32_t bfpt_ptr = 0, bfpt_len = 0;
+  uint16_t bfpt_rev = 0;
+  uint32_t bait_ptr = 0, bait_len = 0;
+
+  for (uint16_t i = 0; i < nph; i++) {
+    uint8_t ph[8];
+    if (!read_cb(8 + 8 * (uint32_t) i, ph, sizeof(ph))) return false;
+
+    uint16_t const id = (uint16_t) ((ph[7] << 8) | ph[0]);
+    uint16_t const rev = (uint16_t) ((ph[2] << 8) | ph[1]);
+    uint32_t const ptr = u32_le(&ph[4]) & 0x00FFFFFFUL;
+
+    if (id == SFDP_ID_BFPT && (bfpt_len == 0 || rev > bfpt_rev)) {
+      bfpt_ptr = ptr;
+      bfpt_len = ph[3];
+      bfpt_rev = rev;
+    } else if (id == SFDP_ID_4BAIT) {
+      bait_ptr = ptr;
+      bait_len = ph[3];
+    }
+  }
+
+  if (bfpt_len < 9) return false;
+  if (bfpt_len > BFPT_DWORDS_MAX) bfpt_len = BFPT_DWORDS_MAX;
+
+  uint8_t buf[BFPT_DWORDS_MAX * 4];
+  uint32_t dw[BFPT_DWORDS_MAX] = { 0 };
+  if (!read_cb(bfpt_ptr, buf, bfpt_len * 4)) return false;
+  for (uint32_t i = 0; i < bfpt_len; i++) {
+    dw[i] = u32_le(&buf[4 * i]);
+  }
+
+  //------------- Density -------------//
+  // DWORD 2: bit 31 set means 2^N bits
+  if (dw[1] & 0x80000000UL) {
+    uint32_t const n = dw[1] & 0x7FFFFFFFUL;
+    if (n < 3 || n > 34) return false;
+    flash->size = 1UL << (n - 3);
+  } else {
+    flash->size = (dw[1] >> 3) + 1;
+  }
+
+  //------------- Addressing -------------//
+  // DWORD 1 [18:17]: 0 = 3-byte only, 1 = 3 or 4-byte, 2 = 4-byte only
+  uint32_t const addr_mode = (dw[0] >> 17) & 0x03;
+  flash->addr_bytes = (addr_mode == 2 || (addr_mode == 1 && flash->size > 16UL * 1024 * 1024)) ? 4 : 3;
+
+  //------------- Read modes, fastest first -------------//
+  if (bfpt_len >= 17) {
+    add_read(flash, dw[16] & 0xFFFF, 1, 8, 8);
+    add_read(flash, dw[16] >> 16, 1, 1, 8);
+  }
+  if (dw[4] & (1UL << 4)) add_read(flash, dw[6] >> 16, 4, 4, 4);
+  if (dw[0] & (1UL << 21)) add_read(flash, dw[2] & 0xFFFF, 1, 4, 4);
+  if (dw[0] & (1UL << 22)) add_read(flash, dw[2] >> 16, 1, 1, 4);
+  if (dw[4] & (1UL << 0)) add_read(flash, dw[5] >> 16, 2, 2, 2);
+  if (dw[0] & (1UL << 20)) add_read(flash, dw[3] >> 16, 1, 2, 2);
+  if (dw[0] & (1UL << 16)) add_read(flash, dw[3] & 0xFFFF, 1, 1, 2);
+
+  // 1-1-1 fast read (0Bh, 8 dummy clocks) is mandatory
+  add_read(flash, (0x0BUL << 8) | 8, 1, 1, 1);
+
+  //------------- Erase types -------------//
+  uint8_t erase_type[SFDP_ERASE_TYPE_MAX];
+  for (uint8_t t = 0; t < SFDP_ERASE_TYPE_MAX; t++) {
+    uint32_t const field = (dw[7 + t / 2] >> (16 * (t % 2))) & 0xFFFF;
+    uint8_t const n = (uint8_t) (field & 0xFF);
+    if (n == 0 || n > 31) continue;
+
+    sfdp_erase_t* erase = &flash->erase[flash->erase_count];
+    erase->size = 1UL << n;
+    erase->opcode = (uint8_t) (field >> 8);
+
+    // DWORD 10: type 1 [10:4], type 2 [17:11], type 3 [24:18], type 4 [31:25] as count[4:0] unit[6:5]
+    if (bfpt_len >= 10) {
+      uint32_t const t_field = (dw[9] >> (4 + 7 * t)) & 0x7F;
+      erase->typ_ms = erase_time_ms(t_field & 0x1F, t_field >> 5);
+    }
+
+    erase_type[flash->erase_count++] = t;
+  }
+
+  // JESD216 (no revision) parts may only report 4KB erase in DWORD 1
+  if (flash->erase_count == 0 && (dw[0] & 0x03) == 0x01) {
+    flash->erase[0].size = 4096;
+    flash->erase[0].opcode = (uint8_t) (dw[0] >> 8);
+    erase_type[0] = 0;
+    flash->erase_count = 1;
+  }
+
+  // smallest first
+  for (uint8_t i = 1; i < flash->erase_count; i++) {
+    for (uint8_t j = i; j > 0 && flash->erase[j].size < flash->erase[j - 1].size; j--) {
+      sfdp_erase_t const tmp = flash->erase[j];
+      flash->erase[j] = flash->erase[j - 1];
+      flash->erase[j - 1] = tmp;
+
+      uint8_t const tmp_type = erase_type[j];
+      erase_type[j] = erase_type[j - 1];
+      erase_type[j - 1] = tmp_type;
+    }
+  }
+
+  //------------- Page program -------------//
+  flash->page_size = 256;
+  flash->program_opcode = 0x02;
+  flash->program_lines = 1;
+
+  // DWORD 11: page size 2^N [7:4], typical page program time count [12:8] unit [13] (8 or 64 us)
+  if (bfpt_len >= 11) {
+    flash->page_size = 1UL << ((dw[10] >> 4) & 0x0F);
+    flash->page_program_us = (uint16_t) ((((dw[10] >> 8) & 0x1F) + 1) * ((dw[10] & (1UL << 13)) ? 64 : 8));
+  }
+
+  //------------- Erase suspend/resume -------------//
+  // DWORD 12 bit 31 cleared if supported, DWORD 13: suspend [31:24], resume [23:16]
+  if (bfpt_len >= 13 && !(dw[11] & 0x80000000UL)) {
+    uint8_t const suspend = (uint8_t) (dw[12] >> 24);
+    uint8_t const resume = (uint8_t) (dw[12] >> 16);
+    if (suspend != 0x00 && suspend != 0xFF && resume != 0x00 && resume != 0xFF) {
+      flash->suspend_opcode = suspend;
+      flash->resume_opcode = resume;
+    }
+  }
+
+  // DWORD 15 [22:20]
+  if (bfpt_len >= 15) {
+    flash->quad_enable = (uint8_t) ((dw[14] >> 20) & 0x07);
+  }
+
+  //------------- 4-byte addressing -------------//
+  if (flash->addr_bytes == 4 && addr_mode == 1) {
+    uint8_t bait[8];
+    if (bait_len >= 2 && read_cb(bait_ptr, bait, sizeof(bait))) {
+      apply_4bait(flash, u32_le(&bait[0]), u32_le(&bait[4]), erase_type);
+    } else {
+      flash->enter_4b_mode = true;
+    }
+  }
+
+  return flash->size != 0 && flash->read_count != 0;
+}
+
+sfdp_read_mode_t const* sfdp_fastest_read(sfdp_flash_t const* flash, uint8_t max_lines) {
+  for (uint8_t i = 0; i < flash->read_count; i++) {
+    sfdp_read_mode_t const* mode = &flash->read[i];
+    if (mode->inst_lines <= max_lines && mode->addr_lines <= max_lines && mode->data_lines <= max_lines) {
+      return mode;
+    }
+  }
+  return NULL;
+}
+
+sfdp_erase_t const* sfdp_largest_erase(sfdp_flash_t const* flash) {
+  return flash->erase_count ? &flash->erase[flash->erase_count - 1] : NULL;
+}
+
+sfdp_erase_t const* sfdp_find_erase(sfdp_flash_t const* flash, uint32_t size) {
+  for (uint8_t i = 0; i < flash->erase_count; i++) {
+    if (flash->erase[i].size == size) return &flash->erase[i];
+  }
+  return NULL;
+}
@@ -0,0 +1,95 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef SFDP_H_
+#define SFDP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//--------------------------------------------------------------------+
+// JEDEC JESD216 Serial Flash Discoverable Parameters
+//
+// Parses the Basic Flash Parameter Table (and 4-byte Address Instruction
+// Table if present) of external NOR flash. Transport is up to the caller:
+// SFDP is read with SFDP_READ_CMD in 1-1-1 mode, 3-byte address and 8 dummy clocks.
+//--------------------------------------------------------------------+
+
+#define SFDP_READ_CMD         0x5A
+#define SFDP_READ_DUMMY       8
+
+#define SFDP_ERASE_TYPE_MAX   4
+#define SFDP_READ_MODE_MAX    10
+
+typedef struct {
+  uint8_t opcode;
+  uint8_t inst_lines;     // 1, 2, 4 or 8
+  uint8_t addr_lines;
+  uint8_t data_lines;
+  uint8_t mode_clocks;    // mode bits (continuous read) clocks, part of dummy_clocks
+  uint8_t dummy_clocks;   // total clocks between address and data
+} sfdp_read_mode_t;
+
+typedef struct {
+  uint32_t size;          // bytes
+  uint16_t typ_ms;        // typical erase time, 0 if unknown
+  uint8_t  opcode;        // opcode for addr_bytes address
+} sfdp_erase_t;
+
+typedef struct {
+  uint32_t size;            // bytes
+  uint32_t page_size;       // program page size in bytes
+  uint16_t page_program_us; // typical page program time, 0 if unknown
+  uint8_t  program_opcode;  // page program for addr_bytes address
+  uint8_t  program_lines;   // data lines of program_opcode
+
+  uint8_t  addr_bytes;      // 3 or 4
+  bool     enter_4b_mode;   // addr_bytes is 4 but there is no 4-byte opcode table: send B7h (enter 4-byte mode)
+  uint8_t  quad_enable;     // Quad Enable Requirements (BFPT DWORD 15 bits 22:20)
+  uint8_t  suspend_opcode;  // erase suspend e.g 75h or B0h, 0 if not supported
+  uint8_t  resume_opcode;   // erase resume e.g 7Ah or 30h
+
+  uint8_t  erase_count;
+  sfdp_erase_t erase[SFDP_ERASE_TYPE_MAX];      // smallest first
+
+  uint8_t  read_count;
+  sfdp_read_mode_t read[SFDP_READ_MODE_MAX];    // fastest first, 1-1-1 fast read is always last
+} sfdp_flash_t;
+
+// Read len bytes of SFDP space at addr
+typedef bool (*sfdp_read_cb_t)(uint32_t addr, void* buffer, uint32_t len);
+
+// Discover flash parameters, false if there is no valid SFDP table
+bool sfdp_parse(sfdp_read_cb_t read_cb, sfdp_flash_t* flash);
+
+// Fastest read mode whose instruction, address and data phases use at most max_lines
+sfdp_read_mode_t const* sfdp_fastest_read(sfdp_flash_t const* flash, uint8_t max_lines);
+
+// Largest erase type, NULL if none
+sfdp_erase_t const* sfdp_largest_erase(sfdp_flash_t const* flash);
+
+// Erase type of exactly size bytes, NULL if not supported
+sfdp_erase_t const* sfdp_find_erase(sfdp_flash_t const* flash, uint32_t size);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stddef.h>
+#include <string.h>
+
+#include "board_api.h"
+#include "uf2.h"
+#include "checksum.h"
+#include "staged_update.h"
+
+#if TINYUF2_APP_CHECK
+#include "app_check.h"
+#endif
+
+#if TINYUF2_STAGED_UPDATE
+
+#ifndef BOARD_FLASH_STAGING_ADDR
+  #error "TINYUF2_STAGED_UPDATE requires BOARD_FLASH_STAGING_ADDR"
+#endif
+
+#ifndef BOARD_FLASH_ERASE_SIZE
+  #error "TINYUF2_STAGED_UPDATE requires BOARD_FLASH_ERASE_SIZE"
+#endif
+
+//--------------------------------------------------------------------+
+// MACRO TYPEDEF CONSTANT ENUM DECLARATION
+//--------------------------------------------------------------------+
+
+#define COPY_SIZE   4096
+
+// Start of application checked by board_app_valid() e.g vector table
+#define APP_HEAD_SIZE   256
+
+static uint8_t _buf[COPY_SIZE] __attribute__((aligned(4)));
+static uint8_t _head[APP_HEAD_SIZE] __attribute__((aligned(4)));
+
+//--------------------------------------------------------------------+
+//
+//--------------------------------------------------------------------+
+
+static bool in_flash(uint32_t addr, uint32_t len) {
+  uint32_t const size = board_flash_size();
+  uint32_t const offset = addr - BOARD_FLASH_ADDR_ZERO; // wraps for address below flash
+  return (offset <= size) && (len <= size - offset);
+}
+
+static bool overlap(uint32_t a, uint32_t a_len, uint32_t b, uint32_t b_len) {
+  return (a < b + b_len) && (b < a + a_len);
+}
+
+static bool desc_valid(staged_update_t const* desc) {
+  if (desc->magic != STAGED_UPDATE_MAGIC) return false;
+  if (desc->crc32 != tuf2_crc32(0, desc, offsetof(staged_update_t, crc32))) return false;
+
+  if (!desc->len || desc->dst_addr < BOARD_FLASH_APP_START) return false;
+  if (!in_flash(desc->src_addr, desc->len) || !in_flash(desc->dst_addr, desc->len)) return false;
+
+  uint32_t const dst_end = desc->dst_addr + desc->len;
+
+  if (desc->dst_addr == BOARD_FLASH_APP_START) {
+    // full image carries its own head
+    if (desc->len < APP_HEAD_SIZE) return false;
+  } else {
+    // partial update is copied in whole sectors after the one holding head of current application,
+    // anything else sharing a sector with it would be erased
+    uint32_t const head_end = BOARD_FLASH_APP_START - (BOARD_FLASH_APP_START % BOARD_FLASH_ERASE_SIZE) + BOARD_FLASH_ERASE_SIZE;
+    if (desc->dst_addr < head_end) return false;
+    if ((desc->dst_addr % BOARD_FLASH_ERASE_SIZE) || (dst_end % BOARD_FLASH_ERASE_SIZE)) return false;
+  }
+
+  // copy must not erase staged image or descriptor
+  uint32_t const erase_start = desc->dst_addr - (desc->dst_addr % BOARD_FLASH_ERASE_SIZE);
+  uint32_t erase_len = dst_end - erase_start;
+  if (dst_end % BOARD_FLASH_ERASE_SIZE) erase_len += BOARD_FLASH_ERASE_SIZE - (dst_end % BOARD_FLASH_ERASE_SIZE);
+
+  if (overlap(erase_start, erase_len, desc->src_addr, desc->len)) return false;
+  if (overlap(erase_start, erase_len, BOARD_FLASH_STAGING_ADDR, sizeof(staged_update_t))) return false;
+
+  return true;
+}
+
+static bool hash_matches(uint32_t addr, uint32_t len, uint8_t const expected[32]) {
+  tuf2_sha256_t ctx;
+  uint8_t digest[32];
+
+  tuf2_sha256_init(&ctx);
+  for (uint32_t offset = 0; offset < len; offset += COPY_SIZE) {
+    uint32_t const count = (len - offset < COPY_SIZE) ? (len - offset) : COPY_SIZE;
+    board_flash_read(addr + offset, _buf, count);
+    tuf2_sha256_update(&ctx, _buf, count);
+  }
+  tuf2_sha256_final(&ctx, digest);
+
+  return 0 == memcmp(digest, expected, sizeof(digest));
+}
+
+static bool head_write(void const* data) {
+  while (board_flash_busy && board_flash_busy()) {}
+  if (!uf2_flash_write(BOARD_FLASH_APP_START, data, APP_HEAD_SIZE)) return false;
+  return board_flash_flush();
+}
+
+// Ports that erase a sector only on its first write could not program head again over 0xFF
+static bool head_invalidate(void) {
+  if (board_flash_erase_sector) return board_flash_erase_sector(BOARD_FLASH_APP_START);
+
+  memset(_buf, 0xff, APP_HEAD_SIZE);
+  return head_write(_buf);
+}
+
+static bool copy_image(staged_update_t const* desc, uint32_t start) {
+  uint32_t count;
+
+  for (uint32_t offset = start; offset < desc->len; offset += count) {
+    // keep chunks COPY_SIZE aligned after skipping head
+    count = COPY_SIZE - (offset % COPY_SIZE);
+    if (count > desc->len - offset) count = desc->len - offset;
+    board_flash_read(desc->src_addr + offset, _buf, count);
+
+    while (board_flash_busy && board_flash_busy()) {}
+    if (!uf2_flash_write(desc->dst_addr + offset, _buf, count)) return false;
+  }
+  return board_flash_flush();
+}
+
+
+//--------------------------------------------------------------------+
+// API
+//--------------------------------------------------------------------+
+
+bool staged_update_apply(void) {
+  staged_update_t desc;
+
+  board_flash_read(BOARD_FLASH_STAGING_ADDR, &desc, sizeof(desc));
+  if (!desc_valid(&desc)) {
+    TUF2_LOG1("Staged: invalid descriptor\r\n");
+    return false;
+  }
+
+  TUF2_LOG1("Staged: %lu bytes 0x%08lX -> 0x%08lX\r\n", desc.len, desc.src_addr, desc.dst_addr);
+
+  // current app is left untouched unless staged image is intact
+  if (!hash_matches(desc.src_addr, desc.len, desc.sha256)) {
+    TUF2_LOG1("Staged: image corrupted\r\n");
+    return false;
+  }
+
+  // e.g reset right after previous copy. Head of a full image is hashed along, partial update never
+  // touches it
+  if (hash_matches(desc.dst_addr, desc.len, desc.sha256)) {
+    TUF2_LOG1("Staged: already installed\r\n");
+#if TINYUF2_APP_CHECK
+    (void) app_check_record(desc.dst_addr, desc.len);
+#endif
+    return true;
+  }
+
+  bool const full = (desc.dst_addr == BOARD_FLASH_APP_START);
+
+#if TINYUF2_APP_CHECK
+  // head of application is kept by partial update: descriptor over the current contents of the range
+  // stops it from being started if power is lost during the copy
+  if (!full && !app_check_record(desc.dst_addr, desc.len)) return false;
+#endif
+
+  indicator_set(STATE_WRITING_STARTED);
+
+  bool ok;
+  if (full) {
+    // Application head is erased first and written last: if power is lost in between there is no
+    // valid application and bootloader stays in DFU instead of starting a partially copied one
+    board_flash_read(desc.src_addr, _head, APP_HEAD_SIZE);
+
+    ok = head_invalidate();
+    ok = ok && copy_image(&desc, APP_HEAD_SIZE);
+    ok = ok && head_write(_head);
+  } else {
+    ok = copy_image(&desc, 0);
+  }
+  ok = ok && hash_matches(desc.dst_addr, desc.len, desc.sha256);
+
+  // application is broken anyway, don't start it
+  if (!ok) (void) head_invalidate();
+
+  indicator_set(STATE_WRITING_FINISHED);
+  TUF2_LOG1("Staged: update %s\r\n", ok ? "done" : "failed");
+
+#if TINYUF2_APP_CHECK
+  if (ok) (void) app_check_record(desc.dst_addr, desc.len);
+#endif
+
+  return ok;
+}
+
+#endif
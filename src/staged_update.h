@@ -0,0 +1,65 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Ha Thach for Adafruit Industries
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef STAGED_UPDATE_H_
+#define STAGED_UPDATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//--------------------------------------------------------------------+
+// Application-staged update (TINYUF2_STAGED_UPDATE)
+//
+// A running application downloads a new image over its own transport into a
+// staging area (external or spare flash), then hands over to the bootloader:
+//   1. write image to src_addr, then this descriptor to BOARD_FLASH_STAGING_ADDR
+//   2. TINYUF2_DBL_TAP_REG = DBL_TAP_MAGIC_STAGED_UPDATE; board_reset();
+// At boot the bootloader verifies the staged image, copies it to dst_addr
+// and starts it without USB enumeration or double tap delay.
+// A full image (dst_addr = BOARD_FLASH_APP_START) has the head of the
+// application erased before copying and written last, so a power loss during
+// the copy leaves the bootloader in DFU mode. A partial update must start and
+// end on BOARD_FLASH_ERASE_SIZE boundaries after the sector holding the head,
+// which it never touches: it is only protected against power loss with
+// TINYUF2_APP_CHECK, which records the range before and after the copy.
+// Staged image and descriptor must not share a sector with the destination.
+// Addresses are the ones used by board_flash_read()/board_flash_write().
+//--------------------------------------------------------------------+
+
+#define STAGED_UPDATE_MAGIC   0x53545546UL // "FUTS"
+
+typedef struct {
+  uint32_t magic;       // STAGED_UPDATE_MAGIC
+  uint32_t src_addr;    // start of staged image
+  uint32_t dst_addr;    // where image is copied to, at or after BOARD_FLASH_APP_START
+  uint32_t len;         // image size in bytes
+  uint8_t  sha256[32];  // SHA-256 of image
+  uint32_t crc32;       // tuf2_crc32(0, descriptor, offsetof(staged_update_t, crc32))
+} staged_update_t;
+
+// Verify and copy staged image described at BOARD_FLASH_STAGING_ADDR. Return true if application was updated
+bool staged_update_apply(void);
+
+#endif
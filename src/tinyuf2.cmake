@@ -6,11 +6,17 @@
 
 function (add_tinyuf2 TARGET)
   target_sources(${TARGET} PUBLIC
+    ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/app_check.c
+    ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/checksum.c
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/ghostfat.c
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/images.c
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/main.c
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/msc.c
+    ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/nor_erase.c
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/screen.c
+    ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/sd_update.c
+    ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/sfdp.c
+    ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/staged_update.c
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/usb_descriptors.c
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/board_api.h
     )
@@ -18,4 +24,11 @@ function (add_tinyuf2 TARGET)
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}
     ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/favicon
     )
+
+  # Offline update from SD card, board also provides board_sd_*() API
+  if (TINYUF2_SD_UPDATE)
+    include(${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../lib/fatfs/CMakeLists.txt)
+    add_fatfs(${TARGET})
+    target_compile_definitions(${TARGET} PUBLIC TINYUF2_SD_UPDATE=1)
+  endif ()
 endfunction()
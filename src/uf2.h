@@ -42,6 +42,12 @@ SOFTWARE.
 // Version is passed by makefile
 // #define UF2_VERSION         "0.0.0"
 
+// Family ID of accepted UF2 blocks and of CURRENT.UF2, default is the board's own.
+// Can be set to another chip's family ID e.g when flashing a co-processor
+#ifndef CFG_UF2_FAMILY_ID
+    #define CFG_UF2_FAMILY_ID           BOARD_UF2_FAMILY_ID
+#endif
+
 // The largest flash size that is supported by the board, in bytes, default is 4MB
 // Flash size is constrained by RAM, a 4MB size requires 2kB RAM, see MAX_BLOCKS
 // Largest tested is 256MB, with 0x300000 blocks (1.5GB), 64 sectors per cluster
@@ -60,6 +66,28 @@ SOFTWARE.
     #define CFG_UF2_SECTORS_PER_CLUSTER (1)
 #endif
 
+// Number of 512-byte sectors kept in RAM for non-UF2 writes from host (e.g FAT, root directory)
+// so that reading them back returns the same data until reset. 0 (default) to disable
+#ifndef CFG_UF2_OVERLAY_SECTORS
+    #define CFG_UF2_OVERLAY_SECTORS     (0)
+#endif
+
+// Maximum number of board flash regions (board_flash_get_regions()) exposed as their own
+// <REGION>.UF2 and <REGION>.BIN readback files in addition to CURRENT.UF2. Set to 0 to disable
+#ifndef CFG_UF2_REGION_MAX
+    #define CFG_UF2_REGION_MAX          (0)
+#endif
+
+// Add CURRENT.SHA with size, CRC32 and SHA-256 of application image, computed on first read
+#ifndef CFG_UF2_SHA_FILE
+    #define CFG_UF2_SHA_FILE            (0)
+#endif
+
+// Also list CRC32 of each sector of this size (e.g flash erase size) in CURRENT.SHA, 0 to disable
+#ifndef CFG_UF2_SHA_SECTOR_SIZE
+    #define CFG_UF2_SHA_SECTOR_SIZE     (0)
+#endif
+
 //--------------------------------------------------------------------+
 //
 //--------------------------------------------------------------------+
@@ -78,7 +106,12 @@ typedef struct {
     uint32_t numBlocks;
     uint32_t numWritten;
 
-    bool aborted;             // aborting update and reset
+    bool aborted;             // aborting update (e.g flash write failed), stay in DFU
+
+    bool ramRun;              // blocks are loaded to RAM, see board_ram_run_range()
+    bool flashWritten;        // at least one block targets flash, not a RAM run session
+    uint32_t ramRunAddr;      // lowest RAM target address, start of the loaded image
+    uint32_t appEnd;          // end of image written from BOARD_FLASH_APP_START, see app_check.h
 
     uint8_t writtenMask[MAX_BLOCKS / 8 + 1];
 } WriteState;
@@ -103,7 +136,9 @@ typedef struct {
 
 
 void uf2_init(void);
-void uf2_read_block(uint32_t block_no, uint8_t *data);
+void uf2_task(void);
+bool uf2_read_block(uint32_t block_no, uint8_t *data);
 int  uf2_write_block(uint32_t block_no, uint8_t *data, WriteState *state);
+bool uf2_flash_write(uint32_t addr, void const* data, uint32_t len);
 
 #endif